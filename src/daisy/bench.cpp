@@ -0,0 +1,1423 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: bench.cpp
+
+*/
+
+#include "bench.h"
+
+bench_config * newBenchConfig(){
+
+  bench_config * config = (bench_config*) malloc(sizeof(bench_config));
+
+  /* Standard ranges QVGA,VGA,SVGA,XGA,SXGA,SXGA+,UXGA,QXGA*/
+  int heights[8] = {320,640,800,1024,1280,1400,1600,2048};
+  int widths[8] = {240,480,600,768,1024,1050,1200,1536};
+
+  config->sizesNo = 8;
+  for(int i = 0; i < config->sizesNo; i++){
+    config->heights[i] = heights[i];
+    config->widths[i] = widths[i];
+  }
+
+  // matching needs the whole target in one descriptor section
+  config->matchSizesNo = 2;
+  config->matchHeights[0] = 256; config->matchWidths[0] = 256;
+  config->matchHeights[1] = 512; config->matchWidths[1] = 512;
+
+  config->iterations = 10;
+  config->warmup = 2;
+  config->pattern = SYNTH_TEXTURE;
+  config->warp = WARP_SIMILARITY;
+  config->seed = 1;
+  config->cpuTransfer = 0;
+  config->extraction = 1;
+  config->matching = 0;
+  config->incremental = 0;
+  config->pyramidOctaves = 0;
+  config->templatesNo = 0;
+  config->verbose = 0;
+  config->templateFile = NULL;
+  config->targetFile = NULL;
+  config->truthFile = NULL;
+  config->memoryBudget = 0;
+  for(int i = 0; i < SMOOTHINGS_NO; i++)
+    config->smoothingModes[i] = SMOOTHING_FIR;
+  config->smoothingAccuracy = 0;
+  config->halfStorage = 0;
+  config->imageInput = 1;
+  config->orientDescriptors = 0;
+  config->trackRadius = -1;
+
+  return config;
+
+}
+
+bench_results * newBenchResults(){
+
+  bench_results * results = (bench_results*) malloc(sizeof(bench_results));
+  results->metricsNo = 0;
+  results->metricsSize = 64;
+  results->metrics = (bench_metric*) malloc(sizeof(bench_metric) * results->metricsSize);
+  strcpy(results->device, "unknown");
+  results->iterations = 0;
+
+  return results;
+
+}
+
+void freeBenchResults(bench_results * results){
+
+  for(int i = 0; i < results->metricsNo; i++)
+    free(results->metrics[i].samples);
+
+  free(results->metrics);
+  free(results);
+
+}
+
+// Parses "HxW,HxW,..." into the arrays, returns the number of sizes or -1
+int parseBenchSizes(const char * str, int * heights, int * widths, int * sizesNo){
+
+  int n = 0;
+  const char * c = str;
+
+  while(*c != '\0' && n < BENCH_MAX_SIZES){
+
+    int h, w, read;
+    if(sscanf(c, "%dx%d%n", &h, &w, &read) != 2 || h <= 0 || w <= 0)
+      return -1;
+
+    heights[n] = h;
+    widths[n] = w;
+    n++;
+
+    c += read;
+    if(*c == ',') c++;
+
+  }
+
+  *sizesNo = n;
+
+  return n;
+
+}
+
+// Parses "G1,G2" into the layers smoothed with SMOOTHING_IIR, returns their number or -1
+int parseSmoothingModes(const char * str, short int * modes){
+
+  int n = 0;
+  const char * c = str;
+
+  for(int i = 0; i < SMOOTHINGS_NO; i++)
+    modes[i] = SMOOTHING_FIR;
+
+  while(*c != '\0'){
+
+    int layer, read;
+    if(sscanf(c, "G%d%n", &layer, &read) != 1 || layer < 0 || layer >= SMOOTHINGS_NO)
+      return -1;
+
+    modes[layer] = SMOOTHING_IIR;
+    n++;
+
+    c += read;
+    if(*c == ',') c++;
+
+  }
+
+  return n;
+
+}
+
+void addBenchSample(bench_results * results, const char * config, const char * name,
+                    int height, int width, short int cpuTransfer, double ms){
+
+  bench_metric * metric = NULL;
+
+  for(int i = 0; i < results->metricsNo; i++){
+    bench_metric * m = &results->metrics[i];
+    if(m->height == height && m->width == width && m->cpuTransfer == cpuTransfer &&
+       !strcmp(m->config, config) && !strcmp(m->name, name)){
+      metric = m;
+      break;
+    }
+  }
+
+  if(metric == NULL){
+
+    if(results->metricsNo == results->metricsSize){
+      results->metricsSize *= 2;
+      results->metrics = (bench_metric*) realloc(results->metrics, sizeof(bench_metric) * results->metricsSize);
+    }
+
+    metric = &results->metrics[results->metricsNo++];
+    strncpy(metric->config, config, BENCH_NAME_LENGTH-1);
+    metric->config[BENCH_NAME_LENGTH-1] = '\0';
+    strncpy(metric->name, name, BENCH_NAME_LENGTH-1);
+    metric->name[BENCH_NAME_LENGTH-1] = '\0';
+    metric->height = height;
+    metric->width = width;
+    metric->cpuTransfer = cpuTransfer;
+    metric->samplesNo = 0;
+    metric->samplesSize = 16;
+    metric->samples = (double*) malloc(sizeof(double) * metric->samplesSize);
+
+  }
+
+  if(metric->samplesNo == metric->samplesSize){
+    metric->samplesSize *= 2;
+    metric->samples = (double*) realloc(metric->samples, sizeof(double) * metric->samplesSize);
+  }
+
+  metric->samples[metric->samplesNo++] = ms;
+
+}
+
+int compareDoubles(const void * a, const void * b){
+
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+
+  return (x > y) - (x < y);
+
+}
+
+void computeBenchStats(double * samples, int samplesNo, bench_stats * stats){
+
+  stats->min = stats->median = stats->p95 = stats->mean = stats->std = 0;
+
+  if(samplesNo == 0) return;
+
+  double * sorted = (double*) malloc(sizeof(double) * samplesNo);
+  memcpy(sorted, samples, sizeof(double) * samplesNo);
+  qsort(sorted, samplesNo, sizeof(double), compareDoubles);
+
+  stats->min = sorted[0];
+  stats->median = (samplesNo % 2 ? sorted[samplesNo / 2] :
+                                   (sorted[samplesNo / 2 - 1] + sorted[samplesNo / 2]) / 2);
+
+  // nearest rank
+  int p95 = (int)ceil(0.95 * samplesNo) - 1;
+  stats->p95 = sorted[max(p95, 0)];
+
+  for(int i = 0; i < samplesNo; i++)
+    stats->mean += samples[i];
+  stats->mean /= samplesNo;
+
+  for(int i = 0; i < samplesNo; i++)
+    stats->std += pow(samples[i] - stats->mean, 2);
+  stats->std = sqrt(stats->std / samplesNo);
+
+  free(sorted);
+
+}
+
+void finaliseBenchResults(bench_results * results){
+
+  for(int i = 0; i < results->metricsNo; i++)
+    computeBenchStats(results->metrics[i].samples, results->metrics[i].samplesNo,
+                      &results->metrics[i].stats);
+
+}
+
+int benchDeviceName(ocl_constructs * daisyCl, char * name, int length){
+
+  if(daisyCl->deviceId == NULL) return 1;
+
+  int error = clGetDeviceInfo(daisyCl->deviceId, CL_DEVICE_NAME, length, name, NULL);
+
+  // keep the name usable as a csv field
+  for(char * c = name; !error && *c != '\0'; c++)
+    if(*c == ',' || *c == '"') *c = ' ';
+
+  return error;
+
+}
+
+// Kernels are built once and shared by all the runs of a benchmark
+ocl_daisy_kernels * benchKernels(ocl_constructs * daisyCl){
+
+  static ocl_daisy_kernels * kernels = NULL;
+
+  if(kernels == NULL){
+
+    daisy_params * daisy = newDaisyParams("", NULL, 0, 0, 0);
+
+    if(initOcl(daisy, daisyCl) || initOclMatch(daisy, daisyCl))
+      return NULL;
+
+    kernels = daisy->oclKernels;
+
+  }
+
+  return kernels;
+
+}
+
+void freeBenchDaisy(daisy_params * daisy, short int freeDescriptors){
+
+  if(freeDescriptors && daisy->descriptors != NULL)
+    free(daisy->descriptors);
+
+  free(daisy->buffers);
+  free(daisy->filename);
+  free(daisy);
+
+}
+
+void addExtractionSamples(bench_results * results, daisy_params * daisy, time_params * times){
+
+  int h = daisy->height;
+  int w = daisy->width;
+  short int t = daisy->cpuTransfer;
+
+  addBenchSample(results, BENCH_EXTRACT, "grad", h, w, t, timeDiff(times->startGrad, times->endGrad));
+  addBenchSample(results, BENCH_EXTRACT, "conv", h, w, t, timeDiff(times->startConv, times->endConv));
+  addBenchSample(results, BENCH_EXTRACT, "convgrad", h, w, t, timeDiff(times->startConvGrad, times->endConvGrad));
+  addBenchSample(results, BENCH_EXTRACT, "transA", h, w, t, timeDiff(times->startTransGrad, times->endTransGrad));
+  addBenchSample(results, BENCH_EXTRACT, "transB", h, w, t, timeDiff(times->startTransDaisy, times->endTransDaisy));
+
+  if(t){
+    addBenchSample(results, BENCH_EXTRACT, "transPinned", h, w, t, times->transPinned);
+    addBenchSample(results, BENCH_EXTRACT, "transRam", h, w, t, times->transRam);
+  }
+
+  addBenchSample(results, BENCH_EXTRACT, "full", h, w, t, timeDiff(times->startFull, times->endFull));
+
+  char name[BENCH_NAME_LENGTH];
+
+  for(int k = 0; k < times->kernelsTimed; k++){
+    snprintf(name, BENCH_NAME_LENGTH, "kernel:%s", times->kernelNames[k]);
+    addBenchSample(results, BENCH_EXTRACT, name, h, w, t, times->kernelTimes[k]);
+  }
+
+}
+
+int benchExtraction(bench_config * config, ocl_constructs * daisyCl, bench_results * results){
+
+  ocl_daisy_kernels * kernels = benchKernels(daisyCl);
+
+  if(kernels == NULL){
+    fprintf(stderr, "bench.cpp::benchExtraction could not build the kernels\n");
+    return 1;
+  }
+
+  benchDeviceName(daisyCl, results->device, sizeof(results->device));
+
+  int error = 0;
+
+  for(int s = 0; s < config->sizesNo; s++){
+
+    int height = config->heights[s];
+    int width = config->widths[s];
+
+    printf("Extraction %dx%d (%s)\n", height, width, (config->cpuTransfer ? "transfer" : "no transfer"));
+
+    unsigned char * array = generateSyntheticImage(config->pattern, height, width, config->seed);
+
+    daisy_params * daisy = newDaisyParams("", array, height, width, config->cpuTransfer);
+    free(daisy->oclKernels);
+    daisy->oclKernels = kernels;
+    daisy->memoryBudget = config->memoryBudget;
+    memcpy(daisy->smoothingModes, config->smoothingModes, sizeof(config->smoothingModes));
+    daisy->halfStorage = config->halfStorage;
+    daisy->imageInput = config->imageInput;
+    daisy->orientDescriptors = config->orientDescriptors;
+
+    short int sectioned = 0;
+
+    for(int i = 0; i < config->warmup + config->iterations; i++){
+
+      time_params times;
+      memset(&times, 0, sizeof(time_params));
+      times.measureDeviceHostTransfers = config->cpuTransfer;
+
+      error = oclDaisy(daisy, daisyCl, &times);
+
+      sectioned = (daisy->plan.sectionsNo > 1);
+
+      if(i == 0 && !error)
+        displayMemoryPlan(&daisy->plan, height, width);
+
+      daisyReleaseBuffers(daisy);
+
+      if(error){
+        fprintf(stderr, "bench.cpp::benchExtraction oclDaisy failed at %dx%d: %d\n", height, width, error);
+        break;
+      }
+
+      if(config->verbose)
+        displayTimes(daisy, &times);
+
+      if(i >= config->warmup)
+        addExtractionSamples(results, daisy, &times);
+
+    }
+
+    // a single section transfer leaves the descriptors in pinned memory
+    freeBenchDaisy(daisy, config->cpuTransfer && sectioned);
+
+    if(!error && config->smoothingAccuracy)
+      error = benchSmoothingAccuracy(config, daisyCl, results, kernels, array, height, width);
+
+    free(array);
+
+    if(error) return error;
+
+  }
+
+  return error;
+
+}
+
+// Max and mean absolute difference of descriptors from reference, both laid out
+// as daisy's, and their mean L2 distance relative to the reference descriptor;
+// BENCH_ACCURACY_BORDER pixels at the borders are left out
+void descriptorError(float * reference, float * descriptors, daisy_params * daisy,
+                     double * maxError, double * meanError, double * relativeError){
+
+  long int compared = 0;
+
+  *maxError = *meanError = *relativeError = 0;
+
+  for(int y = BENCH_ACCURACY_BORDER; y < daisy->height - BENCH_ACCURACY_BORDER; y++)
+    for(int x = BENCH_ACCURACY_BORDER; x < daisy->width - BENCH_ACCURACY_BORDER; x++){
+
+      float * r = reference + (y * daisy->paddedWidth + x) * daisy->descriptorLength;
+      float * d = descriptors + (y * daisy->paddedWidth + x) * daisy->descriptorLength;
+
+      double differenceNorm = 0;
+      double referenceNorm = 0;
+
+      for(int i = 0; i < daisy->descriptorLength; i++){
+
+        double e = fabs(d[i] - r[i]);
+
+        *maxError = max(*maxError, e);
+        *meanError += e;
+        differenceNorm += e * e;
+        referenceNorm += r[i] * r[i];
+
+      }
+
+      if(referenceNorm > 0) *relativeError += sqrt(differenceNorm / referenceNorm);
+
+      compared++;
+
+    }
+
+  if(compared){
+    *meanError /= compared * daisy->descriptorLength;
+    *relativeError /= compared;
+  }
+
+}
+
+// Extracts the descriptors once with every layer FIR in float and once with the
+// smoothing modes and storage of the config, and records how far the latter are
+// from the former
+int benchSmoothingAccuracy(bench_config * config, ocl_constructs * daisyCl, bench_results * results,
+                           ocl_daisy_kernels * kernels, unsigned char * array, int height, int width){
+
+  daisy_params * daisy = newDaisyParams("", array, height, width, 0);
+  free(daisy->oclKernels);
+  daisy->oclKernels = kernels;
+  daisy->memoryBudget = config->memoryBudget;
+
+  float * descriptors[2] = {NULL, NULL};
+
+  int error = 0;
+  short int sectioned = 0;
+
+  for(int run = 0; run < 2 && !error && !sectioned; run++){
+
+    for(int l = 0; l < SMOOTHINGS_NO; l++)
+      daisy->smoothingModes[l] = (run ? config->smoothingModes[l] : SMOOTHING_FIR);
+
+    daisy->halfStorage = (run ? config->halfStorage : 0);
+
+    time_params times;
+    memset(&times, 0, sizeof(time_params));
+
+    error = oclDaisy(daisy, daisyCl, &times);
+
+    // without a transfer only a single section keeps all the descriptors on the device
+    sectioned = (!error && daisy->plan.sectionsNo > 1);
+
+    if(!error && !sectioned){
+
+      size_t descriptorsSize = daisy->paddedWidth * daisy->paddedHeight * daisy->descriptorLength * sizeof(float);
+      descriptors[run] = (float*) malloc(descriptorsSize);
+
+      clFinish(daisyCl->ooqueue);
+
+      error = clEnqueueReadBuffer(daisyCl->ioqueue, daisy->buffers[0], CL_TRUE, 0, descriptorsSize,
+                                  descriptors[run], 0, NULL, NULL);
+
+    }
+
+    daisyReleaseBuffers(daisy);
+
+  }
+
+  if(sectioned)
+    printf("Smoothing accuracy %dx%d skipped, the descriptors do not fit in one section\n", height, width);
+
+  if(!error && !sectioned){
+
+    double maxError, meanError, relativeError;
+
+    descriptorError(descriptors[0], descriptors[1], daisy, &maxError, &meanError, &relativeError);
+
+    printf("Smoothing accuracy %dx%d (G0 %s, G1 %s, G2 %s, %s against FIR fp32): max %.5f mean %.6f relative %.3f%%\n",
+           height, width,
+           (config->smoothingModes[0] == SMOOTHING_IIR ? "IIR" : "FIR"),
+           (config->smoothingModes[1] == SMOOTHING_IIR ? "IIR" : "FIR"),
+           (config->smoothingModes[2] == SMOOTHING_IIR ? "IIR" : "FIR"),
+           (config->halfStorage ? "fp16" : "fp32"),
+           maxError, meanError, relativeError * 100);
+
+    addBenchSample(results, BENCH_EXTRACT, "accuracy:descMaxError", height, width, config->cpuTransfer, maxError);
+    addBenchSample(results, BENCH_EXTRACT, "accuracy:descMeanError", height, width, config->cpuTransfer, meanError);
+    addBenchSample(results, BENCH_EXTRACT, "accuracy:descRelError(%)", height, width, config->cpuTransfer, relativeError * 100);
+
+  }
+
+  if(error)
+    fprintf(stderr, "bench.cpp::benchSmoothingAccuracy oclDaisy failed at %dx%d: %d\n", height, width, error);
+
+  free(descriptors[0]);
+  free(descriptors[1]);
+  freeBenchDaisy(daisy, 0);
+
+  return error;
+
+}
+
+// Frame frameNo of the incremental sequence, the patch moves right along the
+// middle rows of the background and starts over at the left edge
+void movePatch(unsigned char * frame, unsigned char * background, unsigned char * patch,
+               int height, int width, int frameNo){
+
+  memcpy(frame, background, (size_t)height * width);
+
+  int x0 = (frameNo * BENCH_PATCH_STEP) % (width - BENCH_PATCH_SIZE + 1);
+  int y0 = (height - BENCH_PATCH_SIZE) / 2;
+
+  for(int y = 0; y < BENCH_PATCH_SIZE; y++)
+    memcpy(frame + (y0 + y) * width + x0, patch + y * BENCH_PATCH_SIZE, BENCH_PATCH_SIZE);
+
+}
+
+// Extracts every frame of a patch moving across a static background once with
+// oclDaisyIncremental and once whole with oclDaisy, and records the time of both
+// and how much of the frame the incremental extraction covered. Frame 0 primes
+// the incremental state and is not measured; all layers are FIR.
+int benchIncremental(bench_config * config, ocl_constructs * daisyCl, bench_results * results){
+
+  ocl_daisy_kernels * kernels = benchKernels(daisyCl);
+
+  if(kernels == NULL){
+    fprintf(stderr, "bench.cpp::benchIncremental could not build the kernels\n");
+    return 1;
+  }
+
+  benchDeviceName(daisyCl, results->device, sizeof(results->device));
+
+  int error = 0;
+
+  for(int s = 0; s < config->sizesNo && !error; s++){
+
+    int height = config->heights[s];
+    int width = config->widths[s];
+
+    if(height < BENCH_PATCH_SIZE || width < BENCH_PATCH_SIZE + BENCH_PATCH_STEP){
+      printf("Incremental %dx%d skipped, smaller than the moving patch\n", height, width);
+      continue;
+    }
+
+    printf("Incremental %dx%d, %dx%d patch moving %d pixels a frame\n", height, width,
+           BENCH_PATCH_SIZE, BENCH_PATCH_SIZE, BENCH_PATCH_STEP);
+
+    unsigned char * background = generateSyntheticImage(config->pattern, height, width, config->seed);
+    unsigned char * patch = generateSyntheticImage(config->pattern, BENCH_PATCH_SIZE, BENCH_PATCH_SIZE, config->seed + 1);
+    unsigned char * frame = (unsigned char*) malloc((size_t)height * width);
+
+    daisy_params * daisy[2];
+
+    for(int d = 0; d < 2; d++){
+      daisy[d] = newDaisyParams("", frame, height, width, 0);
+      free(daisy[d]->oclKernels);
+      daisy[d]->oclKernels = kernels;
+      daisy[d]->memoryBudget = config->memoryBudget;
+      daisy[d]->halfStorage = config->halfStorage;
+      daisy[d]->imageInput = config->imageInput;
+      daisy[d]->orientDescriptors = config->orientDescriptors;
+    }
+
+    daisy_params * incremental = daisy[0];
+    daisy_params * full = daisy[1];
+
+    incremental_state * state = newIncrementalState(incremental, daisyCl, BENCH_CHANGE_THRESHOLD);
+
+    if(state == NULL){
+      fprintf(stderr, "bench.cpp::benchIncremental could not set up the state for %dx%d\n", height, width);
+      error = 1;
+    }
+
+    for(int i = 0; state != NULL && i <= config->warmup + config->iterations; i++){
+
+      movePatch(frame, background, patch, height, width, i);
+
+      time_params times;
+      memset(&times, 0, sizeof(time_params));
+
+      struct timeval start, end;
+      gettimeofday(&start, NULL);
+
+      error = oclDaisyIncremental(incremental, daisyCl, &times, state, frame);
+
+      gettimeofday(&end, NULL);
+
+      if(error){
+        fprintf(stderr, "bench.cpp::benchIncremental oclDaisyIncremental failed at %dx%d: %d\n", height, width, error);
+        break;
+      }
+
+      if(i == 0) continue;
+
+      double incrementalTime = timeDiff(start, end);
+
+      memset(&times, 0, sizeof(time_params));
+
+      gettimeofday(&start, NULL);
+
+      error = oclDaisy(full, daisyCl, &times);
+
+      gettimeofday(&end, NULL);
+
+      daisyReleaseBuffers(full);
+
+      if(error){
+        fprintf(stderr, "bench.cpp::benchIncremental oclDaisy failed at %dx%d: %d\n", height, width, error);
+        break;
+      }
+
+      double fullTime = timeDiff(start, end);
+
+      if(config->verbose || i == config->warmup + 1)
+        printf("Frame %d: %d of %d tiles changed, %ld of %d pixels extracted, %.2f ms against %.2f ms whole\n",
+               i, state->changedTilesNo, state->tilesX * state->tilesY, state->pixelsExtracted,
+               height * width, incrementalTime, fullTime);
+
+      if(i <= config->warmup) continue;
+
+      addBenchSample(results, BENCH_INCREMENTAL, "frame", height, width, 0, incrementalTime);
+      addBenchSample(results, BENCH_INCREMENTAL, "full", height, width, 0, fullTime);
+      addBenchSample(results, BENCH_INCREMENTAL, "pixelsExtracted", height, width, 0, state->pixelsExtracted);
+      addBenchSample(results, BENCH_INCREMENTAL, "changedTiles", height, width, 0, state->changedTilesNo);
+
+    }
+
+    if(state != NULL)
+      freeIncrementalState(state);
+
+    daisyReleaseBuffers(incremental);
+
+    freeBenchDaisy(incremental, 0);
+    freeBenchDaisy(full, 0);
+
+    free(background);
+    free(patch);
+    free(frame);
+
+  }
+
+  return error;
+
+}
+
+// Descriptors of daisy read back from the device, NULL unless they are all in buffers[0]
+float * readBenchDescriptors(daisy_params * daisy, ocl_constructs * daisyCl){
+
+  if(daisy->cpuTransfer || daisy->plan.sectionsNo > 1) return NULL;
+
+  size_t descriptorsSize = daisy->paddedWidth * daisy->paddedHeight * daisy->descriptorLength * sizeof(float);
+  float * descriptors = (float*) malloc(descriptorsSize);
+
+  clFinish(daisyCl->ooqueue);
+
+  if(clEnqueueReadBuffer(daisyCl->ioqueue, daisy->buffers[0], CL_TRUE, 0, descriptorsSize,
+                         descriptors, 0, NULL, NULL)){
+    free(descriptors);
+    return NULL;
+  }
+
+  return descriptors;
+
+}
+
+// Extracts the octaves of every size with oclDaisyPyramid and each of them
+// separately with oclDaisy from the input halved as often, and records the
+// time of both. The last iteration compares the descriptors of every octave
+// above 0 with the separate ones. All layers are FIR.
+int benchPyramid(bench_config * config, ocl_constructs * daisyCl, bench_results * results){
+
+  ocl_daisy_kernels * kernels = benchKernels(daisyCl);
+
+  if(kernels == NULL){
+    fprintf(stderr, "bench.cpp::benchPyramid could not build the kernels\n");
+    return 1;
+  }
+
+  benchDeviceName(daisyCl, results->device, sizeof(results->device));
+
+  int error = 0;
+
+  for(int s = 0; s < config->sizesNo && !error; s++){
+
+    int height = config->heights[s];
+    int width = config->widths[s];
+
+    unsigned char * images[PYRAMID_MAX_OCTAVES];
+    images[0] = generateSyntheticImage(config->pattern, height, width, config->seed);
+
+    daisy_params * base = newDaisyParams("", images[0], height, width, 0);
+    free(base->oclKernels);
+    base->oclKernels = kernels;
+    base->memoryBudget = config->memoryBudget;
+    base->halfStorage = config->halfStorage;
+    base->imageInput = config->imageInput;
+    base->orientDescriptors = config->orientDescriptors;
+
+    daisy_pyramid * pyramid = newDaisyPyramid(base, config->pyramidOctaves);
+
+    printf("Pyramid %dx%d, %d octaves\n", height, width, pyramid->octavesNo);
+
+    daisy_params * separate[PYRAMID_MAX_OCTAVES];
+
+    for(int o = 0; o < pyramid->octavesNo; o++){
+
+      daisy_params * octave = pyramid->octaves[o];
+
+      if(o > 0)
+        images[o] = halveImage(images[o-1], pyramid->octaves[o-1]->height, pyramid->octaves[o-1]->width);
+
+      separate[o] = newDaisyParams("", images[o], octave->height, octave->width, 0);
+      free(separate[o]->oclKernels);
+      separate[o]->oclKernels = kernels;
+      separate[o]->memoryBudget = config->memoryBudget;
+      separate[o]->halfStorage = config->halfStorage;
+      separate[o]->imageInput = config->imageInput;
+      separate[o]->orientDescriptors = config->orientDescriptors;
+
+    }
+
+    for(int i = 0; i < config->warmup + config->iterations && !error; i++){
+
+      time_params times;
+      memset(&times, 0, sizeof(time_params));
+
+      error = oclDaisyPyramid(pyramid, daisyCl, &times);
+
+      if(error){
+        fprintf(stderr, "bench.cpp::benchPyramid oclDaisyPyramid failed at %dx%d: %d\n", height, width, error);
+        break;
+      }
+
+      short int last = (i == config->warmup + config->iterations - 1);
+      double separateTime = 0;
+
+      for(int o = 0; o < pyramid->octavesNo && !error; o++){
+
+        memset(&times, 0, sizeof(time_params));
+
+        struct timeval start, end;
+        gettimeofday(&start, NULL);
+
+        error = oclDaisy(separate[o], daisyCl, &times);
+
+        gettimeofday(&end, NULL);
+
+        separateTime += timeDiff(start, end);
+
+        if(error)
+          fprintf(stderr, "bench.cpp::benchPyramid oclDaisy failed at %dx%d: %d\n",
+                  separate[o]->height, separate[o]->width, error);
+
+        // octave 0 is the same extraction either way
+        if(!error && last && o > 0){
+
+          float * octaveDescriptors = readBenchDescriptors(pyramid->octaves[o], daisyCl);
+          float * separateDescriptors = readBenchDescriptors(separate[o], daisyCl);
+
+          if(octaveDescriptors != NULL && separateDescriptors != NULL){
+
+            double maxError, meanError, relativeError;
+
+            descriptorError(separateDescriptors, octaveDescriptors, separate[o], &maxError, &meanError, &relativeError);
+
+            printf("Octave %d (%dx%d) against oclDaisy on the halved input: max %.5f mean %.6f relative %.3f%%\n",
+                   o, separate[o]->height, separate[o]->width, maxError, meanError, relativeError * 100);
+
+            char name[BENCH_NAME_LENGTH];
+
+            snprintf(name, BENCH_NAME_LENGTH, "octave%d:descMeanError", o);
+            addBenchSample(results, BENCH_PYRAMID, name, height, width, 0, meanError);
+            snprintf(name, BENCH_NAME_LENGTH, "octave%d:descRelError(%%)", o);
+            addBenchSample(results, BENCH_PYRAMID, name, height, width, 0, relativeError * 100);
+
+          }
+          else{
+            printf("Octave %d (%dx%d) not compared, its descriptors do not fit in one section\n",
+                   o, separate[o]->height, separate[o]->width);
+          }
+
+          free(octaveDescriptors);
+          free(separateDescriptors);
+
+        }
+
+        daisyReleaseBuffers(separate[o]);
+
+      }
+
+      if(error) break;
+
+      if(config->verbose)
+        printf("Pyramid %.2f ms, separate octaves %.2f ms\n", pyramid->difft, separateTime);
+
+      if(i < config->warmup) continue;
+
+      addBenchSample(results, BENCH_PYRAMID, "pyramid", height, width, 0, pyramid->difft);
+      addBenchSample(results, BENCH_PYRAMID, "separate", height, width, 0, separateTime);
+
+    }
+
+    for(int o = 0; o < pyramid->octavesNo; o++){
+      freeBenchDaisy(separate[o], 0);
+      free(images[o]);
+    }
+
+    freeDaisyPyramid(pyramid);
+
+    daisyReleaseBuffers(base);
+    freeBenchDaisy(base, 0);
+
+  }
+
+  return error;
+
+}
+
+// Inlier rate of the seed correspondences against the ground truth homography H
+// (template to target) and the mean distance of the template corners projected
+// by the estimated transform from where H puts them
+void matchAccuracy(match_result * result, double * H, int templateHeight, int templateWidth,
+                   double * inlierRate, double * cornerError){
+
+  int inliers = 0;
+
+  for(int i = 0; i < result->pointsNo; i++){
+
+    double u, v;
+    point_transform_via_homography(H, result->templatePoints[i].x, result->templatePoints[i].y, u, v);
+
+    if(sqrt(pow(result->targetPoints[i].x - u, 2) + pow(result->targetPoints[i].y - v, 2)) <= BENCH_INLIER_DISTANCE)
+      inliers++;
+
+  }
+
+  *inlierRate = (result->pointsNo ? inliers / (double)result->pointsNo : 0);
+
+  point corners[4] = { {0, 0}, {(float)templateWidth-1, 0},
+                       {(float)templateWidth-1, (float)templateHeight-1}, {0, (float)templateHeight-1} };
+
+  *cornerError = 0;
+
+  for(int c = 0; c < 4; c++){
+
+    point p;
+    projectPoint(corners[c], result->t, &p);
+
+    double u, v;
+    point_transform_via_homography(H, corners[c].x, corners[c].y, u, v);
+
+    *cornerError += sqrt(pow(p.x - u, 2) + pow(p.y - v, 2)) / 4;
+
+  }
+
+}
+
+int benchMatchPair(bench_config * config, ocl_constructs * daisyCl, bench_results * results,
+                   ocl_daisy_kernels * kernels,
+                   unsigned char * templateArray, int templateHeight, int templateWidth,
+                   unsigned char * targetArray, int targetHeight, int targetWidth, double * H){
+
+  int error = 0;
+
+  daisy_params * daisyTemplate = newDaisyParams("template", templateArray, templateHeight, templateWidth, 0);
+  daisy_params * daisyTarget = newDaisyParams("target", targetArray, targetHeight, targetWidth, 0);
+
+  free(daisyTemplate->oclKernels);
+  free(daisyTarget->oclKernels);
+  daisyTemplate->oclKernels = kernels;
+  daisyTarget->oclKernels = kernels;
+  daisyTemplate->memoryBudget = config->memoryBudget;
+  daisyTarget->memoryBudget = config->memoryBudget;
+  daisyTemplate->padding = ARRAY_PADDING;
+  daisyTarget->padding = ARRAY_PADDING;
+  daisyTemplate->orientDescriptors = config->orientDescriptors;
+  daisyTarget->orientDescriptors = config->orientDescriptors;
+
+  time_params times;
+  memset(&times, 0, sizeof(time_params));
+
+  error = oclDaisy(daisyTemplate, daisyCl, &times);
+  error |= oclDaisy(daisyTarget, daisyCl, &times);
+
+  if(error){
+    fprintf(stderr, "bench.cpp::benchMatching oclDaisy failed: %d\n", error);
+  }
+  else if(daisyTemplate->plan.sectionsNo > 1 || daisyTarget->plan.sectionsNo > 1){
+    fprintf(stderr, "bench.cpp::benchMatching skipping %dx%d, matching needs the descriptors in one section\n",
+                    targetHeight, targetWidth);
+  }
+  else{
+
+    // buffers, grids and kernel arguments are set up once, the iterations are warm matches
+    match_session * session = newMatchSession(daisyTemplate, daisyTarget, daisyCl);
+
+    if(session == NULL){
+      fprintf(stderr, "bench.cpp::benchMatching could not set up a session for %dx%d\n", targetHeight, targetWidth);
+      error = 1;
+    }
+    else{
+
+      printf("Match session %dx%d set up in %.2f ms\n", targetHeight, targetWidth, session->difft);
+
+      // the same pair every iteration, the warmup matches find the window
+      if(config->trackRadius >= 0)
+        trackMatchSession(session, config->trackRadius, TRACK_MIN_VOTES);
+
+    }
+
+    for(int i = 0; session != NULL && i < config->warmup + config->iterations; i++){
+
+      memset(&times, 0, sizeof(time_params));
+      times.enabled = 1;
+
+      match_result match;
+      memset(&match, 0, sizeof(match_result));
+
+      struct timeval start, end;
+      gettimeofday(&start, NULL);
+
+      error = oclMatchDaisySession(session, daisyTarget, daisyCl, &times, &match);
+
+      gettimeofday(&end, NULL);
+
+      if(error){
+        fprintf(stderr, "bench.cpp::benchMatching oclMatchDaisy failed at %dx%d: %d\n", targetHeight, targetWidth, error);
+        freeMatchResult(&match);
+        break;
+      }
+
+      double inlierRate = -1, cornerError = -1;
+
+      if(H != NULL)
+        matchAccuracy(&match, H, templateHeight, templateWidth, &inlierRate, &cornerError);
+
+      freeMatchResult(&match);
+
+      if(i < config->warmup) continue;
+
+      int h = targetHeight;
+      int w = targetWidth;
+
+      addBenchSample(results, BENCH_MATCH, "diffCoarse", h, w, 0, times.diffCoarse);
+      addBenchSample(results, BENCH_MATCH, "reduceMin", h, w, 0, times.reduceMin);
+      addBenchSample(results, BENCH_MATCH, "reduce", h, w, 0, times.reduceMin);
+      addBenchSample(results, BENCH_MATCH, "coarse", h, w, 0, times.diffCoarse + times.reduceMin);
+      addBenchSample(results, BENCH_MATCH, "diffMiddle", h, w, 0, timeDiff(times.startDiffMiddle, times.endDiffMiddle));
+      addBenchSample(results, BENCH_MATCH, "full", h, w, 0, timeDiff(times.startMatchDaisy, times.endMatchDaisy));
+      addBenchSample(results, BENCH_MATCH, "session", h, w, 0, timeDiff(start, end));
+
+      // lower is better for both, like the times, so baselines catch accuracy losses too
+      if(H != NULL){
+
+        addBenchSample(results, BENCH_MATCH, "accuracy:outliers(%)", h, w, 0, 100 * (1 - inlierRate));
+        addBenchSample(results, BENCH_MATCH, "accuracy:cornerError(px)", h, w, 0, cornerError);
+
+        if(config->verbose || i == config->warmup)
+          printf("Inlier rate %.1f%%, transform error %.2f px\n", 100 * inlierRate, cornerError);
+
+      }
+
+      if(config->trackRadius >= 0){
+
+        addBenchSample(results, BENCH_MATCH, "tracking:fullSearches(%)", h, w, 0,
+                       (session->tracking.path == MATCH_PATH_WINDOW ? 0 : 100));
+
+      }
+
+    }
+
+    if(session != NULL)
+      freeMatchSession(session, daisyCl);
+
+  }
+
+  daisyReleaseBuffers(daisyTemplate);
+  daisyReleaseBuffers(daisyTarget);
+
+  freeBenchDaisy(daisyTemplate, 0);
+  freeBenchDaisy(daisyTarget, 0);
+
+  return error;
+
+}
+
+int benchMatching(bench_config * config, ocl_constructs * daisyCl, bench_results * results){
+
+  ocl_daisy_kernels * kernels = benchKernels(daisyCl);
+
+  if(kernels == NULL){
+    fprintf(stderr, "bench.cpp::benchMatching could not build the kernels\n");
+    return 1;
+  }
+
+  benchDeviceName(daisyCl, results->device, sizeof(results->device));
+
+  int error = 0;
+
+  if(config->templateFile != NULL && config->targetFile != NULL){
+
+    unsigned char * templateArray = NULL;
+    unsigned char * targetArray = NULL;
+    int templateHeight, templateWidth, targetHeight, targetWidth;
+
+    load_gray_image(config->templateFile, templateArray, templateHeight, templateWidth);
+    load_gray_image(config->targetFile, targetArray, targetHeight, targetWidth);
+
+    printf("Matching %s (%dx%d) to %s (%dx%d)\n", config->templateFile, templateHeight, templateWidth,
+                                                  config->targetFile, targetHeight, targetWidth);
+
+    double H[9];
+    short int hasTruth = (config->truthFile != NULL && !loadHomography(config->truthFile, H));
+
+    error = benchMatchPair(config, daisyCl, results, kernels,
+                           templateArray, templateHeight, templateWidth,
+                           targetArray, targetHeight, targetWidth, (hasTruth ? H : NULL));
+
+    delete[] templateArray;
+    delete[] targetArray;
+
+    return error;
+
+  }
+
+  for(int s = 0; s < config->matchSizesNo; s++){
+
+    int targetHeight = config->matchHeights[s];
+    int targetWidth = config->matchWidths[s];
+
+    // template is half the size of the target, warped into it
+    int templateHeight = targetHeight / 2;
+    int templateWidth = targetWidth / 2;
+
+    printf("Matching %dx%d to %dx%d, %s warp\n", templateHeight, templateWidth, targetHeight, targetWidth,
+                                                warpName(config->warp));
+
+    double H[9];
+    unsigned char * templateArray = NULL;
+    unsigned char * targetArray = generateWarpedPair(config->pattern, config->warp,
+                                                     templateHeight, templateWidth,
+                                                     targetHeight, targetWidth,
+                                                     config->seed + s, &templateArray, H);
+
+    error = benchMatchPair(config, daisyCl, results, kernels,
+                           templateArray, templateHeight, templateWidth,
+                           targetArray, targetHeight, targetWidth, H);
+
+    free(templateArray);
+    free(targetArray);
+
+    if(error) return error;
+
+  }
+
+  return error;
+
+}
+
+// Matches the templates of session to the target in every warm-up and measured
+// run, adding the time of each run (ms) to runTimes and the outliers (%) and
+// transform errors (px) of its templates to runOutliers and runErrors
+int benchSessionRuns(bench_config * config, ocl_constructs * daisyCl, match_session * session,
+                     daisy_params * daisyTarget, double * H, int templateHeight, int templateWidth,
+                     double * runTimes, double * runOutliers, double * runErrors){
+
+  int error = 0;
+
+  match_result * matches = (match_result*) calloc(session->templatesNo, sizeof(match_result));
+
+  for(int i = 0; i < config->warmup + config->iterations && !error; i++){
+
+    time_params times;
+    memset(&times, 0, sizeof(time_params));
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    error = oclMatchDaisySession(session, daisyTarget, daisyCl, &times, matches);
+
+    gettimeofday(&end, NULL);
+
+    if(error)
+      fprintf(stderr, "bench.cpp::benchTemplates oclMatchDaisySession failed at %dx%d: %d\n",
+              daisyTarget->height, daisyTarget->width, error);
+    else
+      runTimes[i] += timeDiff(start, end);
+
+    for(int n = 0; n < session->templatesNo; n++){
+
+      double inlierRate, cornerError;
+
+      if(!error){
+        matchAccuracy(&matches[n], H + n * 9, templateHeight, templateWidth, &inlierRate, &cornerError);
+        runOutliers[i] += 100 * (1 - inlierRate);
+        runErrors[i] += cornerError;
+      }
+
+      freeMatchResult(&matches[n]);
+
+    }
+
+  }
+
+  free(matches);
+
+  return error;
+
+}
+
+// Crops config->templatesNo templates from one synthetic target of every match
+// size and matches them once in a catalogue session and once in a session per
+// template, and records the time and accuracy of both. The templates are half
+// the size of the target, so the ground truth is their translation.
+int benchTemplates(bench_config * config, ocl_constructs * daisyCl, bench_results * results){
+
+  ocl_daisy_kernels * kernels = benchKernels(daisyCl);
+
+  if(kernels == NULL){
+    fprintf(stderr, "bench.cpp::benchTemplates could not build the kernels\n");
+    return 1;
+  }
+
+  benchDeviceName(daisyCl, results->device, sizeof(results->device));
+
+  int templatesNo = config->templatesNo;
+  int runsNo = config->warmup + config->iterations;
+
+  char catalogue[BENCH_NAME_LENGTH];
+  snprintf(catalogue, BENCH_NAME_LENGTH, "%s%d", BENCH_CATALOGUE, templatesNo);
+
+  int error = 0;
+
+  for(int s = 0; s < config->matchSizesNo && !error; s++){
+
+    int targetHeight = config->matchHeights[s];
+    int targetWidth = config->matchWidths[s];
+    int templateHeight = targetHeight / 2;
+    int templateWidth = targetWidth / 2;
+
+    printf("Catalogue of %d %dx%d templates cropped from %dx%d\n", templatesNo, templateHeight, templateWidth,
+                                                                   targetHeight, targetWidth);
+
+    unsigned char * targetArray = generateSyntheticImage(config->pattern, targetHeight, targetWidth, config->seed + s);
+
+    daisy_params * daisyTarget = newDaisyParams("target", targetArray, targetHeight, targetWidth, 0);
+    daisy_params ** templates = (daisy_params**) malloc(sizeof(daisy_params*) * templatesNo);
+    unsigned char ** templateArrays = (unsigned char**) malloc(sizeof(unsigned char*) * templatesNo);
+    double * H = (double*) malloc(sizeof(double) * 9 * templatesNo);
+
+    // spread along the anti-diagonal of the target
+    for(int n = 0; n < templatesNo; n++){
+
+      int left = (n + 1) * (targetWidth - templateWidth) / (templatesNo + 1);
+      int top = (templatesNo - n) * (targetHeight - templateHeight) / (templatesNo + 1);
+
+      double translation[9] = {1, 0, (double)left,
+                               0, 1, (double)top,
+                               0, 0, 1};
+
+      memcpy(H + n * 9, translation, sizeof(translation));
+
+      templateArrays[n] = cropImage(targetArray, targetHeight, targetWidth, top, left, templateHeight, templateWidth);
+      templates[n] = newDaisyParams("template", templateArrays[n], templateHeight, templateWidth, 0);
+
+    }
+
+    for(int n = -1; n < templatesNo; n++){
+
+      daisy_params * daisy = (n < 0 ? daisyTarget : templates[n]);
+
+      free(daisy->oclKernels);
+      daisy->oclKernels = kernels;
+      daisy->memoryBudget = config->memoryBudget;
+      daisy->padding = ARRAY_PADDING;
+      daisy->orientDescriptors = config->orientDescriptors;
+
+    }
+
+    time_params times;
+    memset(&times, 0, sizeof(time_params));
+
+    short int sectioned = 0;
+
+    for(int n = -1; n < templatesNo && !error; n++){
+
+      daisy_params * daisy = (n < 0 ? daisyTarget : templates[n]);
+
+      error = oclDaisy(daisy, daisyCl, &times);
+
+      sectioned = sectioned || (daisy->plan.sectionsNo > 1);
+
+    }
+
+    if(error)
+      fprintf(stderr, "bench.cpp::benchTemplates oclDaisy failed: %d\n", error);
+    else if(sectioned)
+      fprintf(stderr, "bench.cpp::benchTemplates skipping %dx%d, matching needs the descriptors in one section\n",
+                      targetHeight, targetWidth);
+
+    // [0] the catalogue, [1] the sessions of one template added up
+    double * runTimes[2], * runOutliers[2], * runErrors[2];
+
+    for(int k = 0; k < 2; k++){
+      runTimes[k] = (double*) calloc(runsNo, sizeof(double));
+      runOutliers[k] = (double*) calloc(runsNo, sizeof(double));
+      runErrors[k] = (double*) calloc(runsNo, sizeof(double));
+    }
+
+    for(int n = -1; n < templatesNo && !error && !sectioned; n++){
+
+      match_session * session = (n < 0 ? newMatchCatalogue(templates, templatesNo, daisyTarget, daisyCl)
+                                       : newMatchSession(templates[n], daisyTarget, daisyCl));
+
+      if(session == NULL){
+        fprintf(stderr, "bench.cpp::benchTemplates could not set up a session for %dx%d\n", targetHeight, targetWidth);
+        error = 1;
+        break;
+      }
+
+      int k = (n < 0 ? 0 : 1);
+
+      error = benchSessionRuns(config, daisyCl, session, daisyTarget, (n < 0 ? H : H + n * 9),
+                               templateHeight, templateWidth, runTimes[k], runOutliers[k], runErrors[k]);
+
+      freeMatchSession(session, daisyCl);
+
+    }
+
+    for(int i = config->warmup; i < runsNo && !error && !sectioned; i++){
+
+      int h = targetHeight;
+      int w = targetWidth;
+
+      addBenchSample(results, catalogue, "catalogue", h, w, 0, runTimes[0][i]);
+      addBenchSample(results, catalogue, "separate", h, w, 0, runTimes[1][i]);
+      addBenchSample(results, catalogue, "accuracy:outliers(%)", h, w, 0, runOutliers[0][i] / templatesNo);
+      addBenchSample(results, catalogue, "accuracy:cornerError(px)", h, w, 0, runErrors[0][i] / templatesNo);
+      addBenchSample(results, catalogue, "separate:outliers(%)", h, w, 0, runOutliers[1][i] / templatesNo);
+      addBenchSample(results, catalogue, "separate:cornerError(px)", h, w, 0, runErrors[1][i] / templatesNo);
+
+      if(config->verbose || i == config->warmup)
+        printf("Catalogue %.2f ms, %.1f%% outliers, %.2f px; separate sessions %.2f ms, %.1f%% outliers, %.2f px\n",
+               runTimes[0][i], runOutliers[0][i] / templatesNo, runErrors[0][i] / templatesNo,
+               runTimes[1][i], runOutliers[1][i] / templatesNo, runErrors[1][i] / templatesNo);
+
+    }
+
+    for(int k = 0; k < 2; k++){
+      free(runTimes[k]);
+      free(runOutliers[k]);
+      free(runErrors[k]);
+    }
+
+    for(int n = 0; n < templatesNo; n++){
+      daisyReleaseBuffers(templates[n]);
+      freeBenchDaisy(templates[n], 0);
+      free(templateArrays[n]);
+    }
+
+    daisyReleaseBuffers(daisyTarget);
+    freeBenchDaisy(daisyTarget, 0);
+
+    free(templates);
+    free(templateArrays);
+    free(targetArray);
+    free(H);
+
+  }
+
+  return error;
+
+}
+
+// Writes the synthetic pairs of every match size with their ground truth, so that
+// they can be matched again with -pair and -truth or by other tools
+int generateMatchPairs(bench_config * config, const char * prefix){
+
+  char name[1024];
+
+  for(int s = 0; s < config->matchSizesNo; s++){
+
+    int targetHeight = config->matchHeights[s];
+    int targetWidth = config->matchWidths[s];
+    int templateHeight = targetHeight / 2;
+    int templateWidth = targetWidth / 2;
+
+    double H[9];
+    unsigned char * templateArray = NULL;
+    unsigned char * targetArray = generateWarpedPair(config->pattern, config->warp,
+                                                     templateHeight, templateWidth,
+                                                     targetHeight, targetWidth,
+                                                     config->seed + s, &templateArray, H);
+
+    if(targetArray == NULL){
+      fprintf(stderr, "bench.cpp::generateMatchPairs could not generate %dx%d\n", targetHeight, targetWidth);
+      free(templateArray);
+      return 1;
+    }
+
+    snprintf(name, sizeof(name), "%s-%dx%d", prefix, targetHeight, targetWidth);
+
+    int error = writeWarpedPair(name, templateArray, templateHeight, templateWidth,
+                                targetArray, targetHeight, targetWidth, H);
+
+    free(templateArray);
+    free(targetArray);
+
+    if(error) return error;
+
+    printf("Wrote %s-template.pgm, %s-target.pgm and %s-H.txt\n", name, name, name);
+
+  }
+
+  return 0;
+
+}
+
+void displayBenchResults(bench_results * results){
+
+  printf("\nDevice: %s\n", results->device);
+  printf("%-8s %-11s %-3s %-32s %9s %9s %9s %9s %9s %5s\n",
+         "config", "HxW", "tr", "metric", "min", "median", "p95", "mean", "std", "n");
+
+  char size[32];
+
+  for(int i = 0; i < results->metricsNo; i++){
+
+    bench_metric * m = &results->metrics[i];
+    sprintf(size, "%dx%d", m->height, m->width);
+
+    printf("%-8s %-11s %-3d %-32s %9.3f %9.3f %9.3f %9.3f %9.3f %5d\n",
+           m->config, size, m->cpuTransfer, m->name,
+           m->stats.min, m->stats.median, m->stats.p95, m->stats.mean, m->stats.std,
+           m->samplesNo);
+
+  }
+
+}
+
+int writeBenchJson(bench_results * results, bench_config * config, const char * filename){
+
+  FILE * fp = fopen(filename, "w");
+
+  if(fp == NULL){
+    fprintf(stderr, "bench.cpp::writeBenchJson cannot open %s\n", filename);
+    return 1;
+  }
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"device\": \"%s\",\n", results->device);
+  fprintf(fp, "  \"iterations\": %d,\n", config->iterations);
+  fprintf(fp, "  \"warmup\": %d,\n", config->warmup);
+  fprintf(fp, "  \"pattern\": \"%s\",\n", syntheticPatternName(config->pattern));
+  fprintf(fp, "  \"warp\": \"%s\",\n", warpName(config->warp));
+  fprintf(fp, "  \"seed\": %u,\n", config->seed);
+  fprintf(fp, "  \"build\": { \"DM_WGX\": %d, \"DM_WG_TARGETS_NO\": %d, \"DM_TARGETS_PER_LOOP\": %d, "
+              "\"COARSE_TEMPLATES_NO\": %d, \"MIDDLE_TEMPLATES_NO\": %d, \"DM_SEARCH_WIDTH\": %d, \"DM_ROTATIONS_NO\": %d, "
+              "\"COARSE_CANDIDATES_NO\": %d, \"COARSE_SUPPRESS_RADIUS\": %d, \"DF_SEARCH_WIDTH\": %d },\n",
+              DM_WGX, DM_WG_TARGETS_NO, DM_TARGETS_PER_LOOP, COARSE_TEMPLATES_NO, MIDDLE_TEMPLATES_NO,
+              DM_SEARCH_WIDTH, DM_ROTATIONS_NO, COARSE_CANDIDATES_NO, COARSE_SUPPRESS_RADIUS, DF_SEARCH_WIDTH);
+  fprintf(fp, "  \"metrics\": [\n");
+
+  for(int i = 0; i < results->metricsNo; i++){
+
+    bench_metric * m = &results->metrics[i];
+
+    fprintf(fp, "    { \"config\": \"%s\", \"height\": %d, \"width\": %d, \"transfer\": %d, \"metric\": \"%s\",\n",
+                m->config, m->height, m->width, m->cpuTransfer, m->name);
+    fprintf(fp, "      \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"mean\": %.4f, \"std\": %.4f,\n",
+                m->stats.min, m->stats.median, m->stats.p95, m->stats.mean, m->stats.std);
+    fprintf(fp, "      \"samples\": [");
+
+    for(int j = 0; j < m->samplesNo; j++)
+      fprintf(fp, "%s%.4f", (j ? ", " : ""), m->samples[j]);
+
+    fprintf(fp, "] }%s\n", (i < results->metricsNo-1 ? "," : ""));
+
+  }
+
+  fprintf(fp, "  ]\n}\n");
+
+  fclose(fp);
+
+  return 0;
+
+}
+
+// Appends one row per metric, the per iteration samples go in the last column separated by ';'
+int writeBenchCsv(bench_results * results, const char * filename){
+
+  short int newFile = (access(filename, F_OK) == -1);
+
+  FILE * fp = fopen(filename, "a");
+
+  if(fp == NULL){
+    fprintf(stderr, "bench.cpp::writeBenchCsv cannot open %s\n", filename);
+    return 1;
+  }
+
+  if(newFile)
+    fprintf(fp, "device,config,height,width,transfer,metric,min,median,p95,mean,std,iterations,samples\n");
+
+  for(int i = 0; i < results->metricsNo; i++){
+
+    bench_metric * m = &results->metrics[i];
+
+    fprintf(fp, "%s,%s,%d,%d,%d,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%d,",
+                results->device, m->config, m->height, m->width, m->cpuTransfer, m->name,
+                m->stats.min, m->stats.median, m->stats.p95, m->stats.mean, m->stats.std,
+                m->samplesNo);
+
+    for(int j = 0; j < m->samplesNo; j++)
+      fprintf(fp, "%s%.4f", (j ? ";" : ""), m->samples[j]);
+
+    fprintf(fp, "\n");
+
+  }
+
+  fclose(fp);
+
+  return 0;
+
+}
@@ -0,0 +1,163 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: bench.h
+
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "oclMatchDaisy.h"
+#include "incremental.h"
+#include "pyramid.h"
+#include "synthetic.h"
+
+#define BENCH_MAX_SIZES 32
+#define BENCH_NAME_LENGTH 64
+
+#define BENCH_EXTRACT "extract"
+#define BENCH_MATCH "match"
+#define BENCH_INCREMENTAL "incremental"
+#define BENCH_PYRAMID "pyramid"
+#define BENCH_CATALOGUE "catalogue" // followed by the number of templates
+
+// A seed correspondence further than this (pixels) from the ground truth is an outlier
+#define BENCH_INLIER_DISTANCE 4
+
+// Descriptors this close (pixels) to the image borders are left out of the smoothing accuracy
+#define BENCH_ACCURACY_BORDER 15
+
+// The incremental sequence moves a patch of this side (pixels) across a static
+// background by BENCH_PATCH_STEP pixels a frame, tiles that change by more than
+// BENCH_CHANGE_THRESHOLD grey levels are extracted again
+#define BENCH_PATCH_SIZE 64
+#define BENCH_PATCH_STEP 8
+#define BENCH_CHANGE_THRESHOLD 8
+
+#ifndef BENCH_CONFIG
+#define BENCH_CONFIG
+typedef struct bench_config_tag{
+  int heights[BENCH_MAX_SIZES];
+  int widths[BENCH_MAX_SIZES];
+  int sizesNo;
+  int matchHeights[BENCH_MAX_SIZES]; // target sizes, template is a centre crop of half the size
+  int matchWidths[BENCH_MAX_SIZES];
+  int matchSizesNo;
+  int iterations;
+  int warmup;
+  int pattern;
+  int warp;     // ground truth transform of the synthetic matching pairs
+  unsigned int seed;
+  short int cpuTransfer;
+  short int extraction;
+  short int matching;
+  short int incremental; // oclDaisyIncremental against oclDaisy on a moving patch sequence
+  int pyramidOctaves;    // oclDaisyPyramid against oclDaisy on each octave, 0 for none
+  int templatesNo;       // one catalogue session against as many single template sessions, 0 for none
+  short int verbose;
+  char * templateFile; // optional real image pair for matching
+  char * targetFile;
+  char * truthFile;    // optional ground truth homography of the pair
+  unsigned long int memoryBudget; // device memory budget in bytes, 0 for most of the device
+  short int smoothingModes[SMOOTHINGS_NO]; // SMOOTHING_FIR or SMOOTHING_IIR per layer
+  short int smoothingAccuracy; // compare the descriptors of smoothingModes and halfStorage with all FIR float ones
+  short int halfStorage;       // gradients and transposed layers stored as half floats
+  short int imageInput;        // input read through an image when the device supports it
+  short int orientDescriptors; // rotation normalised descriptors, matched at rotation 0 only
+  float trackRadius;           // coarse search window around the last match in pixels, negative for the whole target
+} bench_config;
+#endif
+
+#ifndef BENCH_STATS
+#define BENCH_STATS
+typedef struct bench_stats_tag{
+  double min;
+  double median;
+  double p95;
+  double mean;
+  double std;
+} bench_stats;
+#endif
+
+// One metric is a timed stage or kernel of one configuration,
+// with all of its per iteration samples in ms
+#ifndef BENCH_METRIC
+#define BENCH_METRIC
+typedef struct bench_metric_tag{
+  char config[BENCH_NAME_LENGTH];
+  char name[BENCH_NAME_LENGTH];
+  int height;
+  int width;
+  short int cpuTransfer;
+  double * samples;
+  int samplesNo;
+  int samplesSize;
+  bench_stats stats;
+} bench_metric;
+#endif
+
+#ifndef BENCH_RESULTS
+#define BENCH_RESULTS
+typedef struct bench_results_tag{
+  bench_metric * metrics;
+  int metricsNo;
+  int metricsSize;
+  char device[256];
+  int iterations;   // measured iterations of one run, the largest of a loaded csv's rows
+} bench_results;
+#endif
+
+bench_config * newBenchConfig();
+
+bench_results * newBenchResults();
+
+void freeBenchResults(bench_results *);
+
+int parseBenchSizes(const char *, int *, int *, int *);
+
+void addBenchSample(bench_results *, const char *, const char *, int, int, short int, double);
+
+void computeBenchStats(double *, int, bench_stats *);
+
+void finaliseBenchResults(bench_results *);
+
+int benchDeviceName(ocl_constructs *, char *, int);
+
+int parseSmoothingModes(const char *, short int *);
+
+int benchExtraction(bench_config *, ocl_constructs *, bench_results *);
+
+int benchSmoothingAccuracy(bench_config *, ocl_constructs *, bench_results *, ocl_daisy_kernels *,
+                           unsigned char *, int, int);
+
+void descriptorError(float *, float *, daisy_params *, double *, double *, double *);
+
+int benchIncremental(bench_config *, ocl_constructs *, bench_results *);
+
+int benchPyramid(bench_config *, ocl_constructs *, bench_results *);
+
+int benchMatching(bench_config *, ocl_constructs *, bench_results *);
+
+void matchAccuracy(match_result *, double *, int, int, double *, double *);
+
+int benchTemplates(bench_config *, ocl_constructs *, bench_results *);
+
+int generateMatchPairs(bench_config *, const char *);
+
+void displayBenchResults(bench_results *);
+
+int writeBenchJson(bench_results *, bench_config *, const char *);
+
+int writeBenchCsv(bench_results *, const char *);
+
+int loadBenchCsv(bench_results *, const char *);
+
+void benchConfigFromResults(bench_config *, bench_results *);
+
+double mannWhitneyU(double *, int, double *, int);
+
+int compareBenchResults(bench_results *, bench_results *, double, double, short int);
@@ -0,0 +1,299 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: benchCompare.cpp
+
+*/
+
+#include "bench.h"
+
+// Stages shown in the comparison table, the rest are only shown with allMetrics
+const char * benchStageMetrics[] = {"grad", "conv", "transA", "transB", "full", "frame", "pyramid",
+                                    "diffCoarse", "reduce", "diffMiddle", "catalogue",
+                                    "accuracy:outliers(%)", "accuracy:cornerError(px)",
+                                    "accuracy:descRelError(%)"};
+const int benchStageMetricsNo = 14;
+
+// Loads a csv written by writeBenchCsv, rows of repeated configurations are
+// merged; refuses csvs whose rows come from more than one device
+int loadBenchCsv(bench_results * results, const char * filename){
+
+  FILE * fp = fopen(filename, "r");
+
+  if(fp == NULL){
+    fprintf(stderr, "benchCompare.cpp::loadBenchCsv cannot open %s\n", filename);
+    return 1;
+  }
+
+  int lineLength = 1 << 16;
+  char * line = (char*) malloc(sizeof(char) * lineLength);
+  int rows = 0;
+
+  // header
+  if(fgets(line, lineLength, fp) == NULL || strncmp(line, "device,config", 13)){
+    fprintf(stderr, "benchCompare.cpp::loadBenchCsv %s is not a gdaisy-bench csv\n", filename);
+    free(line);
+    fclose(fp);
+    return 1;
+  }
+
+  while(fgets(line, lineLength, fp) != NULL){
+
+    char * fields[13];
+    int fieldsNo = 0;
+
+    char * c = strtok(line, ",\n");
+    while(c != NULL && fieldsNo < 13){
+      fields[fieldsNo++] = c;
+      c = strtok(NULL, ",\n");
+    }
+
+    if(fieldsNo < 13) continue;
+
+    // runs appended from another device are not a baseline of this one
+    if(rows > 0 && strncmp(results->device, fields[0], sizeof(results->device)-1)){
+      fprintf(stderr, "benchCompare.cpp::loadBenchCsv %s mixes runs of %s and %s, keep one device per baseline\n",
+                      filename, results->device, fields[0]);
+      free(line);
+      fclose(fp);
+      return 1;
+    }
+
+    strncpy(results->device, fields[0], sizeof(results->device)-1);
+    results->device[sizeof(results->device)-1] = '\0';
+
+    results->iterations = max(results->iterations, atoi(fields[11]));
+
+    const char * config = fields[1];
+    int height = atoi(fields[2]);
+    int width = atoi(fields[3]);
+    short int cpuTransfer = atoi(fields[4]);
+    const char * name = fields[5];
+
+    char * sample = strtok(fields[12], ";");
+    while(sample != NULL){
+      addBenchSample(results, config, name, height, width, cpuTransfer, atof(sample));
+      sample = strtok(NULL, ";");
+    }
+
+    rows++;
+
+  }
+
+  free(line);
+  fclose(fp);
+
+  finaliseBenchResults(results);
+
+  return (rows == 0);
+
+}
+
+// Reruns the configurations found in the baseline with the iterations of one
+// of its runs, however many runs were appended to it
+void benchConfigFromResults(bench_config * config, bench_results * baseline){
+
+  config->sizesNo = 0;
+  config->matchSizesNo = 0;
+  config->extraction = 0;
+  config->matching = 0;
+  config->incremental = 0;
+  config->pyramidOctaves = 0;
+  config->templatesNo = 0;
+  config->iterations = 0;
+
+  for(int i = 0; i < baseline->metricsNo; i++){
+
+    bench_metric * m = &baseline->metrics[i];
+
+    int templatesNo = 0;
+    short int isCatalogue = (sscanf(m->config, BENCH_CATALOGUE "%d", &templatesNo) == 1);
+    short int isMatch = !strcmp(m->config, BENCH_MATCH) || isCatalogue;
+
+    int * heights = (isMatch ? config->matchHeights : config->heights);
+    int * widths = (isMatch ? config->matchWidths : config->widths);
+    int * sizesNo = (isMatch ? &config->matchSizesNo : &config->sizesNo);
+
+    int s;
+    for(s = 0; s < *sizesNo; s++)
+      if(heights[s] == m->height && widths[s] == m->width) break;
+
+    if(s == *sizesNo && s < BENCH_MAX_SIZES){
+      heights[s] = m->height;
+      widths[s] = m->width;
+      (*sizesNo)++;
+    }
+
+    if(isCatalogue) config->templatesNo = templatesNo;
+    else if(isMatch) config->matching = 1;
+    else if(!strcmp(m->config, BENCH_INCREMENTAL)) config->incremental = 1;
+    else if(!strcmp(m->config, BENCH_PYRAMID)){
+      // the deepest compared octave gives the octave count
+      int octave = 1;
+      sscanf(m->name, "octave%d:", &octave);
+      config->pyramidOctaves = max(config->pyramidOctaves, octave + 1);
+    }
+    else{
+      config->extraction = 1;
+      config->cpuTransfer = m->cpuTransfer;
+    }
+
+  }
+
+  config->iterations = baseline->iterations;
+
+}
+
+// One sided Mann-Whitney U test that the samples of b are larger than those of a,
+// returns the p-value from the normal approximation with tie and continuity correction
+double mannWhitneyU(double * a, int aNo, double * b, int bNo){
+
+  int n = aNo + bNo;
+
+  if(aNo == 0 || bNo == 0) return 1.0;
+
+  double * values = (double*) malloc(sizeof(double) * n);
+  short int * fromB = (short int*) malloc(sizeof(short int) * n);
+  double * ranks = (double*) malloc(sizeof(double) * n);
+
+  // sort all samples keeping track of their group (insertion sort, samples are few)
+  for(int i = 0; i < n; i++){
+
+    double v = (i < aNo ? a[i] : b[i - aNo]);
+    short int g = (i >= aNo);
+
+    int j = i - 1;
+    while(j >= 0 && values[j] > v){
+      values[j+1] = values[j];
+      fromB[j+1] = fromB[j];
+      j--;
+    }
+    values[j+1] = v;
+    fromB[j+1] = g;
+
+  }
+
+  // mid ranks for ties
+  double tieSum = 0;
+  for(int i = 0; i < n; ){
+
+    int j = i;
+    while(j + 1 < n && values[j+1] == values[i]) j++;
+
+    double rank = (i + j) / 2.0 + 1;
+    for(int k = i; k <= j; k++)
+      ranks[k] = rank;
+
+    double t = j - i + 1;
+    tieSum += t * t * t - t;
+
+    i = j + 1;
+
+  }
+
+  double rankSumB = 0;
+  for(int i = 0; i < n; i++)
+    if(fromB[i]) rankSumB += ranks[i];
+
+  double u = rankSumB - bNo * (bNo + 1) / 2.0;
+  double mean = aNo * bNo / 2.0;
+  double sigma = sqrt((aNo * bNo / 12.0) * ((n + 1) - tieSum / (n * (double)(n - 1))));
+
+  free(values);
+  free(fromB);
+  free(ranks);
+
+  if(sigma == 0) return (u > mean ? 0.0 : 1.0);
+
+  double z = (u - mean - 0.5) / sigma;
+
+  return 0.5 * erfc(z / sqrt(2.0));
+
+}
+
+short int isStageMetric(const char * name){
+
+  for(int i = 0; i < benchStageMetricsNo; i++)
+    if(!strcmp(name, benchStageMetrics[i])) return 1;
+
+  return 0;
+
+}
+
+// Compares every metric of the current run with the same metric of the baseline,
+// a regression is a median slow-down above threshold (fraction) with p < alpha.
+// A baseline median of 0 (no outliers, no error) has no relative change, any
+// larger current median with p < alpha is a regression there.
+// Returns the number of regressions.
+int compareBenchResults(bench_results * baseline, bench_results * current,
+                        double threshold, double alpha, short int allMetrics){
+
+  int regressions = 0;
+  int compared = 0;
+
+  printf("\nBaseline device: %s\nCurrent device:  %s\n", baseline->device, current->device);
+  printf("Regression: median slower by more than %.1f%%, or above a median of 0, with p < %.3f (Mann-Whitney U)\n\n",
+         threshold * 100, alpha);
+
+  printf("%-8s %-11s %-32s %10s %10s %8s %8s  %s\n",
+         "config", "HxW", "metric", "base(ms)", "curr(ms)", "delta", "p", "verdict");
+
+  char size[32];
+
+  for(int i = 0; i < current->metricsNo; i++){
+
+    bench_metric * c = &current->metrics[i];
+    bench_metric * b = NULL;
+
+    for(int j = 0; j < baseline->metricsNo; j++){
+      bench_metric * m = &baseline->metrics[j];
+      if(m->height == c->height && m->width == c->width && m->cpuTransfer == c->cpuTransfer &&
+         !strcmp(m->config, c->config) && !strcmp(m->name, c->name)){
+        b = m;
+        break;
+      }
+    }
+
+    if(b == NULL) continue;
+
+    compared++;
+
+    short int zeroBaseline = (b->stats.median <= 0);
+
+    double delta = (zeroBaseline ? 0 : c->stats.median / b->stats.median - 1);
+    double pSlower = mannWhitneyU(b->samples, b->samplesNo, c->samples, c->samplesNo);
+    double pFaster = mannWhitneyU(c->samples, c->samplesNo, b->samples, b->samplesNo);
+
+    const char * verdict = "";
+    short int regressed = (pSlower < alpha && (zeroBaseline ? c->stats.median > b->stats.median : delta > threshold));
+
+    if(regressed){
+      verdict = "REGRESSION";
+      regressions++;
+    }
+    else if(pFaster < alpha && -delta > threshold)
+      verdict = "faster";
+
+    if(!regressed && !allMetrics && !isStageMetric(c->name)) continue;
+
+    sprintf(size, "%dx%d", c->height, c->width);
+
+    char change[16];
+
+    if(zeroBaseline) sprintf(change, "%8s", "n/a");
+    else sprintf(change, "%+7.1f%%", delta * 100);
+
+    printf("%-8s %-11s %-32s %10.3f %10.3f %s %8.4f  %s\n",
+           c->config, size, c->name, b->stats.median, c->stats.median,
+           change, (regressed || pFaster >= alpha ? pSlower : pFaster), verdict);
+
+  }
+
+  printf("\n%d metrics compared, %d regressions\n", compared, regressions);
+
+  return regressions;
+
+}
@@ -0,0 +1,279 @@
+/*
+
+  File: benchMain.cpp
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+*/
+
+#include "bench.h"
+
+void benchUsage(){
+
+  fprintf(stderr, "Usage: gdaisy-bench [options]\n\
+  -extract             benchmark descriptor extraction (default)\n\
+  -match               benchmark template matching\n\
+  -incremental         time incremental against whole extraction of a moving patch at -sizes (all FIR)\n\
+  -pyramid N           time an N octave pyramid against oclDaisy on each halved input and compare them (all FIR)\n\
+  -templates N         match N templates cropped from a -matchSizes target in one catalogue session against N sessions\n\
+  -sizes HxW,...       extraction sizes (default QVGA..QXGA)\n\
+  -matchSizes HxW,...  matching target sizes, template is a centre crop of half size (default 256x256,512x512)\n\
+  -pair tmpl targ      match a real image pair instead of synthetic images\n\
+  -truth file          ground truth homography of the pair, as written by -generate\n\
+  -warp W              synthetic pair transform: none, similarity, homography (default similarity)\n\
+  -generate prefix     write the synthetic pairs of -matchSizes with their ground truth and exit\n\
+  -iterations N        measured iterations per configuration (default 10)\n\
+  -warmup N            unmeasured runs before the measured ones (default 2)\n\
+  -transfer            include the transfer of descriptors to RAM\n\
+  -budget MB           device memory budget that sections are planned in (default 90%% of the device)\n\
+  -iir G1,G2           layers smoothed with the recursive Gaussian instead of the FIR kernels\n\
+  -bufferInput         read the input from a padded buffer even when the device has images\n\
+  -half                store gradients and smoothed layers as half floats (all FIR layers only)\n\
+  -accuracy            compare the extracted descriptors with the all FIR fp32 ones (default -iir G1,G2 without -half)\n\
+  -orient             normalise the descriptors to their dominant orientation and match them at one rotation\n\
+  -track R             match in tracking mode, the coarse layer searches R pixels around the last match\n\
+  -pattern P           synthetic input: ramp, noise, checker, texture (default texture)\n\
+  -seed N              seed of the synthetic input (default 1)\n\
+  -json file           write results and samples as JSON\n\
+  -csv file            append results and samples as CSV\n\
+  -baseline file       rerun the configurations of a CSV baseline and compare, exits with 2 on regressions\n\
+  -threshold P         minimum median slow-down in percent counted as a regression (default 5)\n\
+  -alpha A             significance level of the Mann-Whitney U test (default 0.01)\n\
+  -all                 show every compared metric, not only the stages\n\
+  -verbose             print the times of every run\n");
+
+}
+
+int main(int argc, char ** argv){
+
+  bench_config * config = newBenchConfig();
+
+  char * jsonFile = NULL;
+  char * csvFile = NULL;
+  char * baselineFile = NULL;
+  char * generatePrefix = NULL;
+
+  double threshold = 0.05;
+  double alpha = 0.01;
+  short int allMetrics = 0;
+
+  short int extractionSet = 0;
+  short int matchingSet = 0;
+  short int incrementalSet = 0;
+  int pyramidSet = 0;
+  int templatesSet = 0;
+
+  for(int counter = 1; counter < argc; counter++){
+
+    if(!strcmp("-extract", argv[counter])){
+      extractionSet = 1;
+    }
+    else if(!strcmp("-match", argv[counter])){
+      matchingSet = 1;
+    }
+    else if(!strcmp("-incremental", argv[counter])){
+      incrementalSet = 1;
+    }
+    else if(!strcmp("-pyramid", argv[counter]) && counter+1 < argc){
+      pyramidSet = atoi(argv[++counter]);
+      if(pyramidSet < 2){
+        fprintf(stderr, "A pyramid needs at least 2 octaves\n");
+        return 1;
+      }
+    }
+    else if(!strcmp("-templates", argv[counter]) && counter+1 < argc){
+      templatesSet = atoi(argv[++counter]);
+      if(templatesSet < 2){
+        fprintf(stderr, "A catalogue needs at least 2 templates\n");
+        return 1;
+      }
+    }
+    else if(!strcmp("-sizes", argv[counter]) && counter+1 < argc){
+      if(parseBenchSizes(argv[++counter], config->heights, config->widths, &config->sizesNo) < 1){
+        fprintf(stderr, "Invalid sizes %s, expected HxW,HxW,...\n", argv[counter]);
+        return 1;
+      }
+    }
+    else if(!strcmp("-matchSizes", argv[counter]) && counter+1 < argc){
+      if(parseBenchSizes(argv[++counter], config->matchHeights, config->matchWidths, &config->matchSizesNo) < 1){
+        fprintf(stderr, "Invalid sizes %s, expected HxW,HxW,...\n", argv[counter]);
+        return 1;
+      }
+    }
+    else if(!strcmp("-pair", argv[counter]) && counter+2 < argc){
+      config->templateFile = argv[++counter];
+      config->targetFile = argv[++counter];
+    }
+    else if(!strcmp("-truth", argv[counter]) && counter+1 < argc){
+      config->truthFile = argv[++counter];
+    }
+    else if(!strcmp("-warp", argv[counter]) && counter+1 < argc){
+      config->warp = parseWarp(argv[++counter]);
+      if(config->warp < 0){
+        fprintf(stderr, "Unknown warp %s\n", argv[counter]);
+        return 1;
+      }
+    }
+    else if(!strcmp("-generate", argv[counter]) && counter+1 < argc){
+      generatePrefix = argv[++counter];
+    }
+    else if(!strcmp("-iterations", argv[counter]) && counter+1 < argc){
+      config->iterations = atoi(argv[++counter]);
+    }
+    else if(!strcmp("-warmup", argv[counter]) && counter+1 < argc){
+      config->warmup = atoi(argv[++counter]);
+    }
+    else if(!strcmp("-budget", argv[counter]) && counter+1 < argc){
+      config->memoryBudget = strtoul(argv[++counter], NULL, 10) * 1024 * 1024;
+    }
+    else if(!strcmp("-iir", argv[counter]) && counter+1 < argc){
+      if(parseSmoothingModes(argv[++counter], config->smoothingModes) < 0){
+        fprintf(stderr, "Invalid layers %s, expected G0,G1,G2 or a subset\n", argv[counter]);
+        return 1;
+      }
+    }
+    else if(!strcmp("-bufferInput", argv[counter])){
+      config->imageInput = 0;
+    }
+    else if(!strcmp("-half", argv[counter])){
+      config->halfStorage = 1;
+    }
+    else if(!strcmp("-orient", argv[counter])){
+      config->orientDescriptors = 1;
+    }
+    else if(!strcmp("-track", argv[counter]) && counter+1 < argc){
+      config->trackRadius = atof(argv[++counter]);
+    }
+    else if(!strcmp("-accuracy", argv[counter])){
+      config->smoothingAccuracy = 1;
+    }
+    else if(!strcmp("-transfer", argv[counter])){
+      config->cpuTransfer = 1;
+    }
+    else if(!strcmp("-pattern", argv[counter]) && counter+1 < argc){
+      config->pattern = parseSyntheticPattern(argv[++counter]);
+      if(config->pattern < 0){
+        fprintf(stderr, "Unknown pattern %s\n", argv[counter]);
+        return 1;
+      }
+    }
+    else if(!strcmp("-seed", argv[counter]) && counter+1 < argc){
+      config->seed = (unsigned int)strtoul(argv[++counter], NULL, 10);
+    }
+    else if(!strcmp("-json", argv[counter]) && counter+1 < argc){
+      jsonFile = argv[++counter];
+    }
+    else if(!strcmp("-csv", argv[counter]) && counter+1 < argc){
+      csvFile = argv[++counter];
+    }
+    else if(!strcmp("-baseline", argv[counter]) && counter+1 < argc){
+      baselineFile = argv[++counter];
+    }
+    else if(!strcmp("-threshold", argv[counter]) && counter+1 < argc){
+      threshold = atof(argv[++counter]) / 100.0;
+    }
+    else if(!strcmp("-alpha", argv[counter]) && counter+1 < argc){
+      alpha = atof(argv[++counter]);
+    }
+    else if(!strcmp("-all", argv[counter])){
+      allMetrics = 1;
+    }
+    else if(!strcmp("-verbose", argv[counter])){
+      config->verbose = 1;
+    }
+    else{
+      benchUsage();
+      return 1;
+    }
+
+  }
+
+  if(generatePrefix != NULL)
+    return generateMatchPairs(config, generatePrefix);
+
+  if(config->iterations < 1 || config->warmup < 0){
+    fprintf(stderr, "Need at least one iteration and a non-negative warm-up\n");
+    return 1;
+  }
+
+  if(config->smoothingAccuracy){
+
+    short int iirLayers = 0;
+    for(int i = 0; i < SMOOTHINGS_NO; i++)
+      iirLayers += (config->smoothingModes[i] == SMOOTHING_IIR);
+
+    if(!iirLayers && !config->halfStorage)
+      config->smoothingModes[1] = config->smoothingModes[2] = SMOOTHING_IIR;
+
+  }
+
+  if(extractionSet || matchingSet || incrementalSet || pyramidSet || templatesSet){
+    config->extraction = extractionSet;
+    config->matching = matchingSet;
+    config->incremental = incrementalSet;
+    config->pyramidOctaves = pyramidSet;
+    config->templatesNo = templatesSet;
+  }
+
+  bench_results * baseline = NULL;
+
+  if(baselineFile != NULL){
+
+    baseline = newBenchResults();
+
+    if(loadBenchCsv(baseline, baselineFile)){
+      fprintf(stderr, "Could not load the baseline %s\n", baselineFile);
+      return 1;
+    }
+
+    // the sizes, iterations and stages all come from the baseline
+    benchConfigFromResults(config, baseline);
+
+  }
+
+  ocl_constructs * daisyCl = newOclConstructs(0,0,0);
+  bench_results * results = newBenchResults();
+
+  int error = 0;
+
+  if(config->extraction)
+    error = benchExtraction(config, daisyCl, results);
+
+  if(!error && config->incremental)
+    error = benchIncremental(config, daisyCl, results);
+
+  if(!error && config->pyramidOctaves)
+    error = benchPyramid(config, daisyCl, results);
+
+  if(!error && config->matching)
+    error = benchMatching(config, daisyCl, results);
+
+  if(!error && config->templatesNo)
+    error = benchTemplates(config, daisyCl, results);
+
+  finaliseBenchResults(results);
+
+  displayBenchResults(results);
+
+  if(jsonFile != NULL && !writeBenchJson(results, config, jsonFile))
+    printf("Benchmark results written to %s\n", jsonFile);
+
+  if(csvFile != NULL && !writeBenchCsv(results, csvFile))
+    printf("Benchmark results appended to %s\n", csvFile);
+
+  int regressions = 0;
+
+  if(!error && baseline != NULL){
+    regressions = compareBenchResults(baseline, results, threshold, alpha, allMetrics);
+    freeBenchResults(baseline);
+  }
+
+  freeBenchResults(results);
+
+  if(error) return 1;
+
+  return (regressions > 0 ? 2 : 0);
+
+}
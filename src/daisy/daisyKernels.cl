@@ -52,128 +52,210 @@
 
 */
 
-#define CONVX_GROUP_SIZE_X 16
-#define CONVX_GROUP_SIZE_Y 8
-#define CONVX_WORKER_STEPS 4
+#define DENGRAD_TILE 16
+#define DENGRAD_HALO 3
+#define DENGRAD_INPUT (DENGRAD_TILE + 2 * DENGRAD_HALO)
+#define DENGRAD_BLURRED (DENGRAD_TILE + 2)
+
+// projections of the gradient on the 8 orientations 0, pi/4, ... 7pi/4
+constant float gradientCos[8] = {1.0f, M_SQRT1_2_F, 0.0f, -M_SQRT1_2_F, -1.0f, -M_SQRT1_2_F, 0.0f, M_SQRT1_2_F};
+constant float gradientSin[8] = {0.0f, M_SQRT1_2_F, 1.0f, M_SQRT1_2_F, 0.0f, -M_SQRT1_2_F, -1.0f, -M_SQRT1_2_F};
+
+// Gradient planes and transposed layers are stored as float or, with halfStorage, as
+// half (arithmetic stays in float). Indices count elements of the stored type.
+float loadPlane(global const float * array, const int i, const int halfStorage)
+{
+  return (halfStorage ? vload_half(i, (global const half *)array) : array[i]);
+}
 
-kernel void convolve_denx(global   float * massArray,
-                            constant float * fltArray,
-                            const      int     pddWidth,
-                            const      int     pddHeight)
+void storePlane(global float * array, const int i, const float value, const int halfStorage)
+{
+  if(halfStorage) vstore_half(value, i, (global half *)array);
+  else array[i] = value;
+}
+
+// stores 8 consecutive elements at 8 * i
+void storePlane8(global float * array, const int i, const float8 value, const int halfStorage)
+{
+  if(halfStorage) vstore_half8(value, i, (global half *)array);
+  else vstore8(value, i, array);
+}
+
+// Blurs the input tile of a denoiseGradients group with the 5 tap SIGMA_DEN filter in
+// both directions and writes the 8 rectified orientation planes of its gradient from
+// dstOffset on. The tile has a halo of 3 pixels (2 for the filter, 1 for the central
+// differences) with the borders already replicated, both passes stay in local memory.
+// Tail groups past the right or bottom edge only help to load and blur.
+void denoiseGradientsTile(local    float   lclInput[][DENGRAD_INPUT],
+                          local    float   lclBlurX[][DENGRAD_BLURRED],
+                          local    float   lclBlur[][DENGRAD_BLURRED + 1],
+                          global   float * massArray,
+                          constant float * fltArray,
+                          const      int     pddWidth,
+                          const      int     pddHeight,
+                          const      int     dstOffset,
+                          const      int     halfStorage)
 {
 
   const int lx = get_local_id(0);
   const int ly = get_local_id(1);
-  local float lclArray[CONVX_GROUP_SIZE_Y][CONVX_GROUP_SIZE_X * (CONVX_WORKER_STEPS + 2)];
+  const int lid = ly * DENGRAD_TILE + lx;
 
-  const int srcOffsetX = (get_group_id(0) * CONVX_WORKER_STEPS-1) * CONVX_GROUP_SIZE_X + lx;
-  const int srcOffset = get_global_id(1) * pddWidth + srcOffsetX;
-
-  for(int i = 1; i < CONVX_WORKER_STEPS+1; i++)
-    lclArray[ly][i * CONVX_GROUP_SIZE_X + lx] = massArray[srcOffset + i * CONVX_GROUP_SIZE_X];
+  // blur X - every input row, one column either side of the tile
+  for(int i = lid; i < DENGRAD_INPUT * DENGRAD_BLURRED; i += DENGRAD_TILE * DENGRAD_TILE){
+    const int r = i / DENGRAD_BLURRED;
+    const int c = i % DENGRAD_BLURRED;
+    float s = 0;
 
-  lclArray[ly][lx] = (srcOffsetX >= 0 ? massArray[srcOffset]:lclArray[ly][CONVX_GROUP_SIZE_X]);
+    for(int k = 0; k < 5; k++)
+      s += lclInput[r][c + k] * fltArray[k];
 
-  lclArray[ly][lx + (CONVX_WORKER_STEPS+1) * CONVX_GROUP_SIZE_X] = (srcOffsetX + (CONVX_WORKER_STEPS+1) * CONVX_GROUP_SIZE_X < pddWidth ? massArray[srcOffset + (CONVX_WORKER_STEPS+1) * CONVX_GROUP_SIZE_X]:lclArray[ly][(CONVX_WORKER_STEPS+1) * CONVX_GROUP_SIZE_X-1]);
+    lclBlurX[r][c] = s;
+  }
 
   barrier(CLK_LOCAL_MEM_FENCE);
 
-  for(int w = 1; w < CONVX_WORKER_STEPS+1; w++){
-    const int dstOffset = pddWidth * pddHeight + srcOffset;
+  // blur Y - one row either side of the tile
+  for(int i = lid; i < DENGRAD_BLURRED * DENGRAD_BLURRED; i += DENGRAD_TILE * DENGRAD_TILE){
+    const int r = i / DENGRAD_BLURRED;
+    const int c = i % DENGRAD_BLURRED;
     float s = 0;
 
-    for(int i = lx-2; i < lx+3; i++)
-      s += lclArray[ly][w * CONVX_GROUP_SIZE_X + i] * fltArray[i-lx+2];
+    for(int k = 0; k < 5; k++)
+      s += lclBlurX[r + k][c] * fltArray[k];
 
-    massArray[dstOffset + w * CONVX_GROUP_SIZE_X] = s;
+    lclBlur[r][c] = s;
   }
-}
 
-#define CONVY_GROUP_SIZE_X 16
-#define CONVY_GROUP_SIZE_Y 8
-#define CONVY_WORKER_STEPS 4
+  barrier(CLK_LOCAL_MEM_FENCE);
 
-kernel void convolve_deny(global   float * massArray,
-                          constant float * fltArray,
-                          const      int     pddWidth,
-                          const      int     pddHeight)
+  const int gx = get_global_id(0);
+  const int gy = get_global_id(1);
+
+  // central differences, at the borders the pixel stands in for its missing neighbour
+  const float centre = lclBlur[ly+1][lx+1];
+  const float left  = (gx > 0           ? lclBlur[ly+1][lx]   : centre);
+  const float right = (gx < pddWidth-1  ? lclBlur[ly+1][lx+2] : centre);
+  const float up    = (gy > 0           ? lclBlur[ly][lx+1]   : centre);
+  const float down  = (gy < pddHeight-1 ? lclBlur[ly+2][lx+1] : centre);
+
+  const float dx = (right - left) * 0.5f;
+  const float dy = (down - up) * 0.5f;
+
+  if(gx >= pddWidth || gy >= pddHeight) return;
+
+  const int dstPixel = dstOffset + gy * pddWidth + gx;
+  const int push = pddWidth * pddHeight;
+
+  for(int g = 0; g < 8; g++)
+    storePlane(massArray, dstPixel + g * push, fmax(gradientCos[g] * dx + gradientSin[g] * dy, 0.0f), halfStorage);
+}
+
+// Denoises and differentiates the padded input plane at srcOffset of massArray,
+// 16x16 pixels per group, reading the tile once with its borders clamped
+kernel void denoiseGradients(global   float * massArray,
+                               constant float * fltArray,
+                               const      int     pddWidth,
+                               const      int     pddHeight,
+                               const      int     srcOffset,
+                               const      int     dstOffset,
+                               const      int     halfStorage)
 {
-  const int ly = get_local_id(1);
-  const int lx = get_local_id(0);  
-  local float lclArray[CONVY_GROUP_SIZE_X][CONVY_GROUP_SIZE_Y * (CONVY_WORKER_STEPS+2) + 1];
 
-  const int srcOffsetY = ((get_group_id(1) * CONVY_WORKER_STEPS-1) * CONVY_GROUP_SIZE_Y + ly);
-  const int srcOffset =  srcOffsetY * pddWidth + get_global_id(0) + pddWidth * pddHeight;
+  const int lid = get_local_id(1) * DENGRAD_TILE + get_local_id(0);
 
-  for(int i = 1; i < CONVY_WORKER_STEPS+1; i++)
-    lclArray[lx][i * CONVY_GROUP_SIZE_Y + ly] = massArray[srcOffset + i * CONVY_GROUP_SIZE_Y * pddWidth];
+  const int tileX = get_group_id(0) * DENGRAD_TILE - DENGRAD_HALO;
+  const int tileY = get_group_id(1) * DENGRAD_TILE - DENGRAD_HALO;
 
-  lclArray[lx][ly] = (srcOffsetY >= 0 ? massArray[srcOffset]:lclArray[lx][CONVY_GROUP_SIZE_Y]);
+  local float lclInput[DENGRAD_INPUT][DENGRAD_INPUT];
+  local float lclBlurX[DENGRAD_INPUT][DENGRAD_BLURRED];
+  local float lclBlur[DENGRAD_BLURRED][DENGRAD_BLURRED + 1];
 
-  lclArray[lx][(CONVY_WORKER_STEPS+1) * CONVY_GROUP_SIZE_Y + ly] = (srcOffsetY + (CONVY_WORKER_STEPS+1) * CONVY_GROUP_SIZE_Y < pddHeight ? massArray[srcOffset + (CONVY_WORKER_STEPS+1) * CONVY_GROUP_SIZE_Y * pddWidth]:lclArray[lx][(CONVY_WORKER_STEPS+1) * CONVY_GROUP_SIZE_Y-1]);
+  for(int i = lid; i < DENGRAD_INPUT * DENGRAD_INPUT; i += DENGRAD_TILE * DENGRAD_TILE){
+    const int x = clamp(tileX + i % DENGRAD_INPUT, 0, pddWidth-1);
+    const int y = clamp(tileY + i / DENGRAD_INPUT, 0, pddHeight-1);
+    lclInput[i / DENGRAD_INPUT][i % DENGRAD_INPUT] = massArray[srcOffset + y * pddWidth + x];
+  }
 
   barrier(CLK_LOCAL_MEM_FENCE);
 
-  for(int w = 1; w < CONVY_WORKER_STEPS+1; w++){
-    const int dstOffset = srcOffset + pddWidth * pddHeight * 7;
-    float s = 0;
+  denoiseGradientsTile(lclInput, lclBlurX, lclBlur, massArray, fltArray,
+                       pddWidth, pddHeight, dstOffset, halfStorage);
+}
 
-    for(int i = ly-2; i < ly+3; i++)
-      s += lclArray[lx][w * CONVY_GROUP_SIZE_Y + i] * fltArray[i-ly+2];
+// the sampler replicates the borders of an image like the host padding does
+const sampler_t clampSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+// Same as denoiseGradients but reads the unpadded 8 bit input through an image,
+// the texture cache serves the tile and its halo and the sampler clamps the borders
+kernel void denoiseGradientsImage(read_only image2d_t   input,
+                                  global    float     * massArray,
+                                  constant  float     * fltArray,
+                                  const       int       pddWidth,
+                                  const       int       pddHeight,
+                                  const       int       dstOffset,
+                                  const       int       halfStorage)
+{
 
-    massArray[dstOffset + w * CONVY_GROUP_SIZE_Y * pddWidth] = s;
+  const int lid = get_local_id(1) * DENGRAD_TILE + get_local_id(0);
+
+  const int tileX = get_group_id(0) * DENGRAD_TILE - DENGRAD_HALO;
+  const int tileY = get_group_id(1) * DENGRAD_TILE - DENGRAD_HALO;
+
+  local float lclInput[DENGRAD_INPUT][DENGRAD_INPUT];
+  local float lclBlurX[DENGRAD_INPUT][DENGRAD_BLURRED];
+  local float lclBlur[DENGRAD_BLURRED][DENGRAD_BLURRED + 1];
+
+  for(int i = lid; i < DENGRAD_INPUT * DENGRAD_INPUT; i += DENGRAD_TILE * DENGRAD_TILE){
+    const int2 xy = (int2)(tileX + i % DENGRAD_INPUT, tileY + i / DENGRAD_INPUT);
+    lclInput[i / DENGRAD_INPUT][i % DENGRAD_INPUT] = (float)read_imageui(input, clampSampler, xy).x;
   }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  denoiseGradientsTile(lclInput, lclBlurX, lclBlur, massArray, fltArray,
+                       pddWidth, pddHeight, dstOffset, halfStorage);
 }
 
-kernel void gradients(global float * massArray,
-                            const    int     pddWidth,
-                            const    int     pddHeight)
+// Gradients of the next octave of a pyramid from those of this one, a pixel per
+// work item and plane: [1 3 3 1]/8 both ways adds a variance of 0.75 to the 0.25
+// of SIGMA_DEN, which at half the resolution is SIGMA_DEN again. The rescaled
+// gradients differ by a factor of 2 that the normalised layers do not see.
+kernel void downsampleGradients(global const float * srcArray,
+                                global       float * dstArray,
+                                const        int     srcWidth,
+                                const        int     srcHeight,
+                                const        int     dstWidth,
+                                const        int     dstHeight,
+                                const        int     halfStorage)
 {
 
-  const int r = get_global_id(0) / pddWidth;
-  const int c = get_global_id(0) % pddWidth;
-  const int srcOffset = pddWidth * pddHeight * 8 + r * pddWidth + c;
-
-  float4 n;
-  n.x = (c > 0           ? massArray[srcOffset-1]:massArray[srcOffset]);
-  n.y = (r > 0           ? massArray[srcOffset-pddWidth]:massArray[srcOffset]);
-  n.z = (c < pddWidth-1  ? massArray[srcOffset+1]:massArray[srcOffset]);
-  n.w = (r < pddHeight-1 ? massArray[srcOffset+pddWidth]:massArray[srcOffset]);
-
-  float8 gradients;
-  const float8 angles = (float8)(0.0f, M_PI / 4, M_PI / 2, 3 * (M_PI / 4), M_PI,
-                                  5 * (M_PI / 4), 3 * (M_PI / 2), 7 * (M_PI / 4));
-  n.x = (n.z-n.x) * 0.5;
-  n.y = (n.w-n.y) * 0.5;
-
-  gradients.s0 = fmax(cos(angles.s0) * n.x + 
-                      sin(angles.s0) * n.y, 0.0);
-  gradients.s1 = fmax(cos(angles.s1) * n.x + 
-                      sin(angles.s1) * n.y, 0.0);
-  gradients.s2 = fmax(cos(angles.s2) * n.x + 
-                      sin(angles.s2) * n.y, 0.0);
-  gradients.s3 = fmax(cos(angles.s3) * n.x + 
-                      sin(angles.s3) * n.y, 0.0);
-  gradients.s4 = fmax(cos(angles.s4) * n.x + 
-                      sin(angles.s4) * n.y, 0.0);
-  gradients.s5 = fmax(cos(angles.s5) * n.x + 
-                      sin(angles.s5) * n.y, 0.0);
-  gradients.s6 = fmax(cos(angles.s6) * n.x + 
-                      sin(angles.s6) * n.y, 0.0);
-  gradients.s7 = fmax(cos(angles.s7) * n.x + 
-                      sin(angles.s7) * n.y, 0.0);
-
-  const int dstOffset = r * pddWidth + c;
-  const int push = pddWidth * pddHeight;
+  const int x = get_global_id(0);
+  const int y = get_global_id(1) % dstHeight;
+  const int g = get_global_id(1) / dstHeight;
+
+  if(x >= dstWidth) return;
+
+  const float taps[4] = {0.125f, 0.375f, 0.375f, 0.125f};
+
+  const int srcPlane = g * srcWidth * srcHeight;
+
+  float sum = 0;
+
+  for(int j = 0; j < 4; j++){
+
+    const int row = srcPlane + clamp(2 * y - 1 + j, 0, srcHeight-1) * srcWidth;
+
+    float rowSum = 0;
+
+    for(int i = 0; i < 4; i++)
+      rowSum += taps[i] * loadPlane(srcArray, row + clamp(2 * x - 1 + i, 0, srcWidth-1), halfStorage);
+
+    sum += taps[j] * rowSum;
+
+  }
 
-  massArray[dstOffset]        = gradients.s0;
-  massArray[dstOffset+push]   = gradients.s1;
-  massArray[dstOffset+2*push] = gradients.s2;
-  massArray[dstOffset+3*push] = gradients.s3;
-  massArray[dstOffset+4*push] = gradients.s4;
-  massArray[dstOffset+5*push] = gradients.s5;
-  massArray[dstOffset+6*push] = gradients.s6;
-  massArray[dstOffset+7*push] = gradients.s7;
+  storePlane(dstArray, g * dstWidth * dstHeight + y * dstWidth + x, sum, halfStorage);
 }
 
 #define CONVX_GROUP_SIZE_X 16
@@ -215,6 +297,7 @@ kernel void convolve_G0x(global   float * massArray,
   }
 }
 
+#define CONVY_GROUP_SIZE_X 16
 #define CONVY_GROUP_SIZE_Y 8
 #define CONVY_WORKER_STEPS 8
 
@@ -403,6 +486,365 @@ kernel void convolve_G2y(global   float * massArray,
   }
 }
 
+/*
+
+  Cascaded smoothing of all three layers
+  --------------------------------------
+
+  Produces the same layers as G0x/G0y, G1x/G1y and G2x/G2y, followed by
+  transposeGradients, but streams the gradients through global memory once
+  and writes the layers straight in their transposed and normalised layout.
+  A work group owns a strip of CASCADE_WIDTH columns and CASCADE_HEIGHT rows
+  of all 8 gradient planes, one plane per row of work items, and walks down it
+  row by row: each new gradient row is smoothed in X with G0 into a ring of the
+  last 11 rows, G0 in Y over that ring gives a row of layer 0, which is smoothed
+  in X with G1 into a ring of 23 rows, G1 in Y gives a row of layer 1, G2 in X
+  fills a ring of 27 rows and G2 in Y gives a row of layer 2. The rings live in
+  registers, every work item keeps the columns it filters and shifts them by one
+  row at a time. The X passes run on a halo wide enough for the passes after
+  them and every pass replicates the borders of its own input like the separate
+  kernels do: the first row of a plane fills its whole ring and the rows past
+  the last one repeat it. Groups start 29 rows above their strip to warm the
+  rings up.
+
+  Once a row of a layer is complete in local memory the first work item of each
+  column gathers its 8 gradients, normalises them and stores them as one float8,
+  giving the SxHxWxG layout of transBuffer. The gradients are read from the
+  start of massArray. With halfStorage both are half planes. The columns of
+  the tail strip past the right edge are filtered but not stored.
+
+*/
+
+#define CASCADE_WIDTH 32
+#define CASCADE_HEIGHT 256
+#define CASCADE_R0 5
+#define CASCADE_R1 11
+#define CASCADE_R2 13
+#define CASCADE_W1 (CASCADE_WIDTH + 2 * CASCADE_R2)
+#define CASCADE_W0 (CASCADE_W1 + 2 * CASCADE_R1)
+#define CASCADE_WIN (CASCADE_W0 + 2 * CASCADE_R0)
+#define CASCADE_HALO (CASCADE_R0 + CASCADE_R1 + CASCADE_R2)
+
+// columns of the layer 0 and layer 1 halos filtered by each work item
+#define CASCADE_COLUMNS0 ((CASCADE_W0 + CASCADE_WIDTH - 1) / CASCADE_WIDTH)
+#define CASCADE_COLUMNS1 ((CASCADE_W1 + CASCADE_WIDTH - 1) / CASCADE_WIDTH)
+
+// Shifts a ring of the last rows of one column by a row, the first
+// row of a plane fills all of it. With constant sizes the loops unroll
+// and the ring stays in registers.
+void ringPush(float * ring, const int size, const float value, const int fill)
+{
+  for(int k = 0; k < size-1; k++)
+    ring[k] = (fill ? value : ring[k+1]);
+
+  ring[size-1] = value;
+}
+
+float8 normaliseGradients(const float8 g)
+{
+  const float l2normSum = dot(g.lo, g.lo) + dot(g.hi, g.hi);
+
+  return (l2normSum == 0.0f ? g : g * rsqrt(l2normSum));
+}
+
+kernel void convolveCascade(global   float * massArray,
+                              global   float * dstArray,
+                              constant float * fltArray,
+                              const      int     pddWidth,
+                              const      int     pddHeight,
+                              const      int     halfStorage)
+{
+
+  const int lx = get_local_id(0);
+  const int g = get_local_id(1);
+  const int x0 = get_group_id(0) * CASCADE_WIDTH;
+  const int c0 = get_group_id(1) * CASCADE_HEIGHT;
+  const int c1 = min(c0 + CASCADE_HEIGHT, pddHeight);
+  const int planeSize = pddWidth * pddHeight;
+  const int inside = (x0 + lx < pddWidth);
+
+  const int srcPlane = g * planeSize;
+
+  constant float * filterG0 = fltArray + 7;
+  constant float * filterG1 = fltArray + (7+11);
+  constant float * filterG2 = fltArray + (7+11+23);
+
+  local float lclRow[8][CASCADE_WIN];
+  local float lclLayer0[8][CASCADE_W0];
+  local float lclLayer1[8][CASCADE_W1];
+  local float lclLayer2[8][CASCADE_WIDTH];
+
+  float ring0[CASCADE_COLUMNS0][2 * CASCADE_R0 + 1];
+  float ring1[CASCADE_COLUMNS1][2 * CASCADE_R1 + 1];
+  float ring2[2 * CASCADE_R2 + 1];
+
+  // rows of layers 0 and 1 that the rows after them need
+  const int lower0 = max(0, c0 - CASCADE_R1 - CASCADE_R2);
+  const int lower1 = max(0, c0 - CASCADE_R2);
+
+  for(int t = max(0, c0 - CASCADE_HALO); t < c1 + CASCADE_HALO; t++){
+
+    // G0 in X on gradient row t
+    if(t < pddHeight){
+
+      for(int j = lx; j < CASCADE_WIN; j += CASCADE_WIDTH)
+        lclRow[g][j] = loadPlane(massArray, srcPlane + t * pddWidth + clamp(x0 - CASCADE_HALO + j, 0, pddWidth-1), halfStorage);
+
+      barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for(int c = 0; c < CASCADE_COLUMNS0; c++){
+      const int j = lx + c * CASCADE_WIDTH;
+      float s = ring0[c][2 * CASCADE_R0];
+
+      if(t < pddHeight && j < CASCADE_W0){
+        s = 0;
+
+        for(int k = 0; k < 2 * CASCADE_R0 + 1; k++)
+          s += lclRow[g][j + k] * filterG0[k];
+      }
+
+      ringPush(ring0[c], 2 * CASCADE_R0 + 1, s, t == 0);
+    }
+
+    // G0 in Y gives row y0 of layer 0, G1 in X on it
+    const int y0 = t - CASCADE_R0;
+
+    if(y0 >= lower0 && y0 < c1 + CASCADE_R1 + CASCADE_R2){
+
+      if(y0 < pddHeight){
+
+        for(int c = 0; c < CASCADE_COLUMNS0; c++){
+          const int j = lx + c * CASCADE_WIDTH;
+          float s = 0;
+
+          for(int k = 0; k < 2 * CASCADE_R0 + 1; k++)
+            s += ring0[c][k] * filterG0[k];
+
+          if(j < CASCADE_W0) lclLayer0[g][j] = s;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if(g == 0 && inside && y0 >= c0 && y0 < c1){
+          const int x = CASCADE_R1 + CASCADE_R2 + lx;
+          const float8 v = (float8)(lclLayer0[0][x], lclLayer0[1][x], lclLayer0[2][x], lclLayer0[3][x],
+                                    lclLayer0[4][x], lclLayer0[5][x], lclLayer0[6][x], lclLayer0[7][x]);
+          storePlane8(dstArray, y0 * pddWidth + x0 + lx, normaliseGradients(v), halfStorage);
+        }
+      }
+
+      for(int c = 0; c < CASCADE_COLUMNS1; c++){
+        const int j = lx + c * CASCADE_WIDTH;
+        float s = ring1[c][2 * CASCADE_R1];
+
+        if(y0 < pddHeight && j < CASCADE_W1){
+          s = 0;
+
+          for(int k = 0; k < 2 * CASCADE_R1 + 1; k++)
+            s += lclLayer0[g][clamp(x0 - CASCADE_R2 - CASCADE_R1 + j + k, 0, pddWidth-1) - x0 + CASCADE_R1 + CASCADE_R2] * filterG1[k];
+        }
+
+        ringPush(ring1[c], 2 * CASCADE_R1 + 1, s, y0 == 0);
+      }
+    }
+
+    // G1 in Y gives row y1 of layer 1, G2 in X on it
+    const int y1 = y0 - CASCADE_R1;
+
+    if(y1 >= lower1 && y1 < c1 + CASCADE_R2){
+
+      if(y1 < pddHeight){
+
+        for(int c = 0; c < CASCADE_COLUMNS1; c++){
+          const int j = lx + c * CASCADE_WIDTH;
+          float s = 0;
+
+          for(int k = 0; k < 2 * CASCADE_R1 + 1; k++)
+            s += ring1[c][k] * filterG1[k];
+
+          if(j < CASCADE_W1) lclLayer1[g][j] = s;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if(g == 0 && inside && y1 >= c0 && y1 < c1){
+          const int x = CASCADE_R2 + lx;
+          const float8 v = (float8)(lclLayer1[0][x], lclLayer1[1][x], lclLayer1[2][x], lclLayer1[3][x],
+                                    lclLayer1[4][x], lclLayer1[5][x], lclLayer1[6][x], lclLayer1[7][x]);
+          storePlane8(dstArray, planeSize + y1 * pddWidth + x0 + lx, normaliseGradients(v), halfStorage);
+        }
+      }
+
+      float s = ring2[2 * CASCADE_R2];
+
+      if(y1 < pddHeight){
+        s = 0;
+
+        for(int k = 0; k < 2 * CASCADE_R2 + 1; k++)
+          s += lclLayer1[g][clamp(x0 - CASCADE_R2 + lx + k, 0, pddWidth-1) - x0 + CASCADE_R2] * filterG2[k];
+      }
+
+      ringPush(ring2, 2 * CASCADE_R2 + 1, s, y1 == 0);
+    }
+
+    // G2 in Y gives row y2 of layer 2
+    const int y2 = y1 - CASCADE_R2;
+
+    if(y2 >= c0 && y2 < c1){
+      float s = 0;
+
+      for(int k = 0; k < 2 * CASCADE_R2 + 1; k++)
+        s += ring2[k] * filterG2[k];
+
+      lclLayer2[g][lx] = s;
+
+      barrier(CLK_LOCAL_MEM_FENCE);
+
+      if(g == 0 && inside){
+        const float8 v = (float8)(lclLayer2[0][lx], lclLayer2[1][lx], lclLayer2[2][lx], lclLayer2[3][lx],
+                                  lclLayer2[4][lx], lclLayer2[5][lx], lclLayer2[6][lx], lclLayer2[7][lx]);
+        storePlane8(dstArray, planeSize * 2 + y2 * pddWidth + x0 + lx, normaliseGradients(v), halfStorage);
+      }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+/*
+
+  Recursive Gaussian smoothing (Young & van Vliet)
+  ------------------------------------------------
+
+  An alternative to the FIR convolutions above whose cost does not depend
+  on sigma. Every row (or column) is filtered with a causal and then an
+  anticausal 3rd order recursion,
+
+    w[n] = B * x[n] + b1 * w[n-1] + b2 * w[n-2] + b3 * w[n-3]
+    y[n] = B * w[n] + b1 * y[n+1] + b2 * y[n+2] + b3 * y[n+3]
+
+  with coefficients = (B, b1, b2, b3) computed on the host for the sigma
+  of the layer (already divided by b0). Each recursion starts from the
+  steady state of its border pixel, like the replicated borders of the FIR
+  kernels. The offsets select the massBuffer sections of source and
+  destination, the anticausal pass runs in place on the destination.
+
+*/
+
+#define IIR_GROUP_SIZE 64
+#define IIR_TILE_WIDTH 16
+
+// one work item per row of all 8 gradient planes, the rows of a group
+// are staged through local memory in tiles to keep the reads coalesced
+kernel void convolve_iirx(global   float * massArray,
+                            const      float4  coefficients,
+                            const      int     pddWidth,
+                            const      int     srcOffset,
+                            const      int     dstOffset)
+{
+
+  const int lx = get_local_id(0);
+  local float lclArray[IIR_GROUP_SIZE][IIR_TILE_WIDTH + 1];
+
+  global float * srcRows = massArray + srcOffset + get_group_id(0) * IIR_GROUP_SIZE * pddWidth;
+  global float * dstRows = massArray + dstOffset + get_group_id(0) * IIR_GROUP_SIZE * pddWidth;
+
+  float w1 = srcRows[lx * pddWidth];
+  float w2 = w1;
+  float w3 = w1;
+
+  for(int tileX = 0; tileX < pddWidth; tileX += IIR_TILE_WIDTH){
+
+    for(int i = lx; i < IIR_GROUP_SIZE * IIR_TILE_WIDTH; i += IIR_GROUP_SIZE)
+      lclArray[i / IIR_TILE_WIDTH][i % IIR_TILE_WIDTH] = srcRows[(i / IIR_TILE_WIDTH) * pddWidth + tileX + i % IIR_TILE_WIDTH];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int x = 0; x < IIR_TILE_WIDTH; x++){
+      const float w = coefficients.x * lclArray[lx][x] + coefficients.y * w1 + coefficients.z * w2 + coefficients.w * w3;
+      lclArray[lx][x] = w;
+      w3 = w2;
+      w2 = w1;
+      w1 = w;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int i = lx; i < IIR_GROUP_SIZE * IIR_TILE_WIDTH; i += IIR_GROUP_SIZE)
+      dstRows[(i / IIR_TILE_WIDTH) * pddWidth + tileX + i % IIR_TILE_WIDTH] = lclArray[i / IIR_TILE_WIDTH][i % IIR_TILE_WIDTH];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  float y1 = w1;
+  float y2 = w1;
+  float y3 = w1;
+
+  for(int tileX = pddWidth - IIR_TILE_WIDTH; tileX >= 0; tileX -= IIR_TILE_WIDTH){
+
+    for(int i = lx; i < IIR_GROUP_SIZE * IIR_TILE_WIDTH; i += IIR_GROUP_SIZE)
+      lclArray[i / IIR_TILE_WIDTH][i % IIR_TILE_WIDTH] = dstRows[(i / IIR_TILE_WIDTH) * pddWidth + tileX + i % IIR_TILE_WIDTH];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int x = IIR_TILE_WIDTH-1; x >= 0; x--){
+      const float y = coefficients.x * lclArray[lx][x] + coefficients.y * y1 + coefficients.z * y2 + coefficients.w * y3;
+      lclArray[lx][x] = y;
+      y3 = y2;
+      y2 = y1;
+      y1 = y;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int i = lx; i < IIR_GROUP_SIZE * IIR_TILE_WIDTH; i += IIR_GROUP_SIZE)
+      dstRows[(i / IIR_TILE_WIDTH) * pddWidth + tileX + i % IIR_TILE_WIDTH] = lclArray[i / IIR_TILE_WIDTH][i % IIR_TILE_WIDTH];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+// one work item per column of each gradient plane (global id 1),
+// neighbouring work items read neighbouring pixels of the same row
+kernel void convolve_iiry(global   float * massArray,
+                            const      float4  coefficients,
+                            const      int     pddWidth,
+                            const      int     pddHeight,
+                            const      int     srcOffset,
+                            const      int     dstOffset)
+{
+
+  const int columnOffset = get_global_id(1) * pddWidth * pddHeight + get_global_id(0);
+
+  global float * srcColumn = massArray + srcOffset + columnOffset;
+  global float * dstColumn = massArray + dstOffset + columnOffset;
+
+  float w1 = srcColumn[0];
+  float w2 = w1;
+  float w3 = w1;
+
+  for(int y = 0; y < pddHeight * pddWidth; y += pddWidth){
+    const float w = coefficients.x * srcColumn[y] + coefficients.y * w1 + coefficients.z * w2 + coefficients.w * w3;
+    dstColumn[y] = w;
+    w3 = w2;
+    w2 = w1;
+    w1 = w;
+  }
+
+  float y1 = w1;
+  float y2 = w1;
+  float y3 = w1;
+
+  for(int y = (pddHeight-1) * pddWidth; y >= 0; y -= pddWidth){
+    const float v = coefficients.x * dstColumn[y] + coefficients.y * y1 + coefficients.z * y2 + coefficients.w * y3;
+    dstColumn[y] = v;
+    y3 = y2;
+    y2 = y1;
+    y1 = v;
+  }
+}
+
 #define SMOOTHINGS_NO 3
 #define GRADIENTS_NO 8
 #define TOTAL_PETALS_NO 25
@@ -567,7 +1009,13 @@ kernel void transposeDaisyPairs(global  float * srcArray,
                                   const     int     sectionHeight,
                                   const     int     petalTwoY,
                                   const     int     petalTwoX,      // offset in pixels
-                                  const     int     petalOutOffset) // offset in petals = pixels * totalPetals + petalNo
+                                  const     int     petalOutOffset, // offset in petals = pixels * totalPetals + petalNo
+                                  const     int     blockHeight,    // rows of a full section, as planned by the host
+                                  const     int     halfStorage,
+                                  const     int     roiX,           // window of descriptors written, in plane pixels
+                                  const     int     roiY,
+                                  const     int     dstWidth,
+                                  const     int     xStart)         // first source column of the first group
 {
   // Y range = blockNo * blockHeight - 15 : (blockNo+1) * blockHeight + 15
 
@@ -588,7 +1036,7 @@ kernel void transposeDaisyPairs(global  float * srcArray,
     }
     else{
 
-      int sourceX = get_group_id(0) * ((TRANSD_FAST_WG_X * TRANSD_FAST_STEPS) / (2 * GRADIENTS_NO)) + 
+      int sourceX = xStart + get_group_id(0) * ((TRANSD_FAST_WG_X * TRANSD_FAST_STEPS) / (2 * GRADIENTS_NO)) + 
                     (lx % (TRANSD_FAST_PETAL_PAIRS * GRADIENTS_NO)) / GRADIENTS_NO + petalTwoX;
 
       const int offset = ((get_global_id(1) + petalTwoY) * srcWidth) * GRADIENTS_NO + 
@@ -599,38 +1047,38 @@ kernel void transposeDaisyPairs(global  float * srcArray,
         lclArray[(k+TRANSD_FAST_STEPS-1) * TRANSD_FAST_PETAL_PAIRS * GRADIENTS_NO + lx] = (
           
           (sourceX < 0 || sourceX >= srcWidth) ? 0 : 
-           srcArray[offset + sourceX * GRADIENTS_NO]);
+           loadPlane(srcArray, offset + sourceX * GRADIENTS_NO, halfStorage));
 
       }
     }
   }
   else{
 
-    int sourceX = get_group_id(0) * ((TRANSD_FAST_WG_X * TRANSD_FAST_STEPS) / (2 * GRADIENTS_NO)) + 
+    int sourceX = xStart + get_group_id(0) * ((TRANSD_FAST_WG_X * TRANSD_FAST_STEPS) / (2 * GRADIENTS_NO)) + 
                   (lx % (TRANSD_FAST_PETAL_PAIRS * GRADIENTS_NO)) / GRADIENTS_NO;
 
     for(int k = 0; k < TRANSD_FAST_STEPS; k++, sourceX += TRANSD_FAST_PETAL_PAIRS)
 
-      lclArray[k * TRANSD_FAST_PETAL_PAIRS * GRADIENTS_NO + lx] = 
+      lclArray[k * TRANSD_FAST_PETAL_PAIRS * GRADIENTS_NO + lx] = (
 
-          srcArray[(get_global_id(1) * srcWidth + sourceX) * GRADIENTS_NO + lx % GRADIENTS_NO];
+          (sourceX < 0 || sourceX >= srcWidth) ? 0 :
+          loadPlane(srcArray, (get_global_id(1) * srcWidth + sourceX) * GRADIENTS_NO + lx % GRADIENTS_NO, halfStorage));
   }
 
   barrier(CLK_LOCAL_MEM_FENCE);
 
 //  const int targetY = sourceY % ((TRANSD_BLOCK_WIDTH * TRANSD_BLOCK_WIDTH) / srcWidth) + 
 //                      (petalOutOffset / TOTAL_PETALS_NO) / srcWidth;
-  const int blockHeight = ((TRANSD_BLOCK_WIDTH * TRANSD_BLOCK_WIDTH) / srcWidth);
 
-  const int targetY = (sourceY % blockHeight + blockHeight +
+  const int targetY = ((sourceY - roiY) % blockHeight + blockHeight +
                       (petalOutOffset / TOTAL_PETALS_NO) / srcWidth) % blockHeight;
 
   if(targetY < 0 || targetY >= sectionHeight) return;
 
-  int targetX = get_group_id(0) * ((TRANSD_FAST_WG_X * TRANSD_FAST_STEPS) / (2 * GRADIENTS_NO)) + 
+  int targetX = xStart + get_group_id(0) * ((TRANSD_FAST_WG_X * TRANSD_FAST_STEPS) / (2 * GRADIENTS_NO)) + 
                 (petalOutOffset / TOTAL_PETALS_NO) % srcWidth + lx / (GRADIENTS_NO * 2);
 
-  int targetPetalOffset = ((targetY * srcWidth + targetX) * (TOTAL_PETALS_NO + 0) + 
+  int targetPetalOffset = ((targetY * dstWidth + targetX - roiX) * (TOTAL_PETALS_NO + 0) + 
                           abs(petalOutOffset % TOTAL_PETALS_NO) + TRANSD_FAST_PETAL_PADDING) * GRADIENTS_NO;
 
   int localOffset = (TRANSD_FAST_PETAL_PAIRS * TRANSD_FAST_STEPS * ((lx / GRADIENTS_NO) % 2) + 
@@ -643,8 +1091,8 @@ kernel void transposeDaisyPairs(global  float * srcArray,
           targetPetalOffset += TRANSD_FAST_PETAL_PAIRS * (TOTAL_PETALS_NO + TRANSD_FAST_PETAL_PADDING) * GRADIENTS_NO,
           localOffset += TRANSD_FAST_PETAL_PAIRS * GRADIENTS_NO){
 
-    // kill target petals outside
-    if(targetX < 0 || targetX >= srcWidth) continue;
+    // kill target petals outside the window
+    if(targetX < roiX || targetX >= roiX + dstWidth) continue;
 
     dstArray[targetPetalOffset + lx % (GRADIENTS_NO * 2)] = lclArray[localOffset];
 
@@ -656,20 +1104,27 @@ kernel void transposeDaisyPairs(global  float * srcArray,
 #define TRANSD_FAST_SINGLES_WG_X 128
 kernel void transposeDaisySingles(global float * srcArray,
                                   global float * dstArray,
-                                  const    int     blockHeight)
+                                  const    int     blockHeight,
+                                  const    int     halfStorage,
+                                  const    int     srcWidth,
+                                  const    int     roiX,      // window of descriptors written, in plane pixels
+                                  const    int     roiY,
+                                  const    int     dstWidth)
 { 
   // blockHeight should be the maximum, ie daisyBlockHeight from the .cpp
 
-   // Moves from index range 0-srcWidth to 0-srcWidth*26, filling in petal no 1 out of 0-25
+   // Moves from index range 0-dstWidth to 0-dstWidth*26, filling in petal no 1 out of 0-25
    const int gy = get_global_id(1);
    const int gx = get_global_id(0);
-   const int gsx = get_global_size(0);
+
+   // the tail group of a row may reach past it
+   if(gx >= dstWidth * GRADIENTS_NO) return;
 
    // no steps//TRANSD_FAST_PETAL_PADDING) + 
-   dstArray[(((gy % blockHeight) * (gsx / GRADIENTS_NO) + gx / GRADIENTS_NO) * 
+   dstArray[((((gy - roiY) % blockHeight) * dstWidth + gx / GRADIENTS_NO) * 
               (TOTAL_PETALS_NO + TRANSD_FAST_PETAL_PADDING) + 
               TRANSD_FAST_PETAL_PADDING) * GRADIENTS_NO +
-              gx % GRADIENTS_NO] = srcArray[gy * gsx + gx];
+              gx % GRADIENTS_NO] = loadPlane(srcArray, (gy * srcWidth + roiX) * GRADIENTS_NO + gx, halfStorage);
 
 }
 
@@ -716,6 +1171,117 @@ kernel void fetchDaisy(global float * array)
 
 }
 
+/*
+
+  Rotation normalisation - the dominant bin of the centre histogram
+  becomes bin 0 of every histogram and the petals of each ring are
+  shifted by as many places, so that descriptors of a rotated patch
+  compare at rotation 0. One group per descriptor, the dominant bin
+  is kept in orientations
+
+*/
+
+#define ORIENT_WG_X 64
+
+kernel void orientDescriptors(global float * descriptors,
+                              global uchar * orientations,
+                              const  int     orientationsOffset)
+{
+
+  local float lclDescriptor[DESCRIPTOR_LENGTH];
+  local int dominant;
+
+  const int daisyNo = get_group_id(0);
+  const int lx = get_local_id(0);
+
+  global float * descriptor = descriptors + daisyNo * DESCRIPTOR_LENGTH;
+
+  for(int i = lx; i < DESCRIPTOR_LENGTH; i += ORIENT_WG_X)
+    lclDescriptor[i] = descriptor[i];
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if(lx == 0){
+
+    const int centre = TRANSD_FAST_PETAL_PADDING * GRADIENTS_NO;
+
+    int g0 = 0;
+    for(int g = 1; g < GRADIENTS_NO; g++)
+      g0 = (lclDescriptor[centre + g] > lclDescriptor[centre + g0] ? g : g0);
+
+    dominant = g0;
+    orientations[orientationsOffset + daisyNo] = (uchar)g0;
+
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const int d = dominant;
+
+  for(int i = lx; i < DESCRIPTOR_LENGTH; i += ORIENT_WG_X){
+
+    const int petal = i / GRADIENTS_NO - TRANSD_FAST_PETAL_PADDING;
+
+    // the padding and the centre stay where they are, ring petals move within their ring
+    const int srcPetal = (petal < 1 ? petal :
+                          ((petal-1) / REGION_PETALS_NO) * REGION_PETALS_NO + 1 + ((petal-1) % REGION_PETALS_NO + d) % REGION_PETALS_NO);
+
+    descriptor[i] = lclDescriptor[(TRANSD_FAST_PETAL_PADDING + srcPetal) * GRADIENTS_NO + (i % GRADIENTS_NO + d) % GRADIENTS_NO];
+
+  }
+
+}
+
+/*
+
+  Incremental extraction - flag the CHANGE_TILE x CHANGE_TILE tiles of a
+  frame in which some pixel moved more than threshold grey levels away
+  from the frame the descriptors were extracted from, one group per tile
+
+*/
+
+#define CHANGE_TILE 64
+#define CHANGE_WG 16
+
+kernel void changedTiles(global const uchar * reference,
+                         global const uchar * frame,
+                         global       int   * tiles,
+                         const        int     width,
+                         const        int     height,
+                         const        int     threshold)
+{
+
+  local int changed;
+
+  const int lx = get_local_id(0);
+  const int ly = get_local_id(1);
+
+  if(lx == 0 && ly == 0) changed = 0;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const int x0 = get_group_id(0) * CHANGE_TILE;
+  const int y0 = get_group_id(1) * CHANGE_TILE;
+
+  const int x1 = min(x0 + CHANGE_TILE, width);
+  const int y1 = min(y0 + CHANGE_TILE, height);
+
+  int difference = 0;
+
+  for(int y = y0 + ly; y < y1; y += CHANGE_WG)
+    for(int x = x0 + lx; x < x1; x += CHANGE_WG)
+      difference = max(difference, abs((int)frame[y * width + x] - (int)reference[y * width + x]));
+
+  // every writer stores the same value
+  if(difference > threshold) changed = 1;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if(lx == 0 && ly == 0)
+    tiles[get_group_id(1) * get_num_groups(0) + get_group_id(0)] = changed;
+
+}
+
 
 /*
 
@@ -734,300 +1300,268 @@ kernel void fetchDaisy(global float * array)
 
 #define ROTATIONS_NO 8
 
-#define DC_TMP_PETALS_NO 8
 #define DC_TRG_PIXELS_NO 16
-#define DC_TRG_PER_LOOP 2
 #define DC_WGX 64
 #define DC_PX_SPACING 4
 
-#define DIFFSC ((DC_TRG_PER_LOOP * DC_TMP_PETALS_NO * GRADIENTS_NO * ROTATIONS_NO) / DC_WGX)
+/*
 
-#define DC_PX_PADDING 1
+  The coarse layer for a batch of template points in one launch - a group keeps the
+  three rings of its 16 target pixels in local memory and compares every
+  template point of the batch with them, each at rotationsNo rotations (1 for
+  descriptors normalised by orientDescriptors, ROTATIONS_NO otherwise). Only
+  the best of the 16 pixels per template point and rotation leaves the group,
+  template and rotation major, for reduceMinPlanes to finish. The NDRange may
+  cover a window of the coarse plane only, the groups are then numbered
+  within the window
 
-kernel void diffCoarse( global   float * tmp,
-                        global   float * trg,
-                        global   float * out,
-                        const    int     templateOffset,
-                        const    int     width,
-                        const    int     regionNo)
+*/
+
+#define DCB_RINGS_LENGTH (SMOOTHINGS_NO * REGION_PETALS_NO * GRADIENTS_NO)
+#define DCB_PX_PADDING 1
+
+kernel void diffCoarseBatched( global const float * tmpPetals,
+                               global const float * trg,
+                               global       float * outMin,
+                               global       int   * outArg,
+                               const        int     width,
+                               const        int     templatesNo,
+                               const        int     rotationsNo,
+                               const        int     templateOffset)
 {
-  local float lclTmp[REGION_PETALS_NO * GRADIENTS_NO];
-  local float lclTrg[DC_TRG_PER_LOOP * (REGION_PETALS_NO * GRADIENTS_NO + DC_PX_PADDING)];
+  local float lclTmp[DCB_RINGS_LENGTH];
+  local float lclTrg[DC_TRG_PIXELS_NO * (DCB_RINGS_LENGTH + DCB_PX_PADDING)];
+  local float lclSum[DC_WGX * 2];
 
   const int lid = get_local_id(0);
-  const int gx = get_global_id(0);
   const int gy = get_global_id(1);
 
-  // fetch template pixel
-  lclTmp[lid] = tmp[templateOffset * DESCRIPTOR_LENGTH + (TRANSD_FAST_PETAL_PADDING + regionNo * REGION_PETALS_NO + 1) * GRADIENTS_NO + lid];
-
-  int targetStep;
-  for(targetStep = 0; targetStep < DC_TRG_PIXELS_NO / DC_TRG_PER_LOOP; targetStep++){
-
-    // fetch target pixels to local memory; GRADIENTS_NO x REGION_PETALS_NO x TRG_PER_LOOP
-    int i;
-    for(i = 0; i < DC_TRG_PER_LOOP; i++){
-
-      lclTrg[i * (DC_WGX+DC_PX_PADDING) + lid] = 
+  const int coarseWidth = width / DC_PX_SPACING;
+  // launches over a window of the target start it with a global offset of whole groups
+  const int firstPixel = (get_global_offset(0) / DC_WGX + get_group_id(0)) * DC_TRG_PIXELS_NO;
 
-        trg[((gy * DC_PX_SPACING + max((DC_PX_SPACING / 2 -1),0)) * width + ((gx / DC_WGX) * DC_TRG_PIXELS_NO + targetStep * DC_TRG_PER_LOOP + i) * 
-             DC_PX_SPACING + max((DC_PX_SPACING / 2 -1),0)) * DESCRIPTOR_LENGTH +
-             (TRANSD_FAST_PETAL_PADDING + regionNo * REGION_PETALS_NO + 1) * GRADIENTS_NO + lid];
+  const int groupsNo = get_num_groups(0) * get_num_groups(1);
+  const int groupNo = get_group_id(1) * get_num_groups(0) + get_group_id(0);
 
-    }
+  // fetch the rings of the 16 target pixels once for the whole batch
+  for(int i = lid; i < DC_TRG_PIXELS_NO * DCB_RINGS_LENGTH; i += DC_WGX){
 
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    // do 4 diffs and sum them
-    float diffs = 0.0;
-    
-    for(i = 0; i < DIFFSC; i++){
+    const int pixelNo = i / DCB_RINGS_LENGTH;
 
-      // first 32 threads do diffs for the first pixel, others for the second pixel
-      // first 4 threads do diffs for rotation 0, next 4 threads rotation 1....
-      const int pixelNo = lid / (DC_WGX / DC_TRG_PER_LOOP);
-      const int rotationNo = (lid / (DC_WGX / (DC_TRG_PER_LOOP * ROTATIONS_NO))) % ROTATIONS_NO; 
+    lclTrg[pixelNo * (DCB_RINGS_LENGTH + DCB_PX_PADDING) + i % DCB_RINGS_LENGTH] =
 
-      const int petalNo = (lid % 4) * 2; // first template petal
+      trg[((gy * DC_PX_SPACING + max((DC_PX_SPACING / 2 -1),0)) * width + 
+           (firstPixel + pixelNo) * DC_PX_SPACING + max((DC_PX_SPACING / 2 -1),0)) * DESCRIPTOR_LENGTH +
+           (TRANSD_FAST_PETAL_PADDING + 1) * GRADIENTS_NO + i % DCB_RINGS_LENGTH];
 
-      // get these by rotationNo and lid
-      const int trgPetal = (petalNo + rotationNo) % REGION_PETALS_NO;
-      const int trgFirstGradient = rotationNo;
+  }
 
-      // pick pixel, pick rotation => pick petal, pick gradient
-      diffs += fabs(lclTmp[petalNo * GRADIENTS_NO + i] - 
-                    lclTrg[pixelNo * (REGION_PETALS_NO * GRADIENTS_NO + DC_PX_PADDING) + 
-                           ((trgPetal + i / GRADIENTS_NO) % REGION_PETALS_NO) * GRADIENTS_NO + 
-                            (trgFirstGradient + i) % GRADIENTS_NO]);
+  // one pixel and rotation per output, split in parts when there are fewer outputs than workers
+  const int outputsNo = DC_TRG_PIXELS_NO * rotationsNo;
+  const int parts = max(1, DC_WGX / outputsNo);
+  const int partLength = DCB_RINGS_LENGTH / parts;
 
-    }
+  for(int t = 0; t < templatesNo; t++){
 
     barrier(CLK_LOCAL_MEM_FENCE);
 
-    // put them in local memory
-    lclTrg[lid] = diffs;
+    for(int i = lid; i < DCB_RINGS_LENGTH; i += DC_WGX)
+      lclTmp[i] = tmpPetals[(templateOffset + t) * DCB_RINGS_LENGTH + i];
 
     barrier(CLK_LOCAL_MEM_FENCE);
 
-    // the first 32 threads sum half of the 64 values
-    if(lid < DC_WGX / 2)
-      lclTrg[lid * 2] = lclTrg[lid * 2] + 
-                        lclTrg[lid * 2 + 1];
+    for(int o = lid / parts; o < outputsNo; o += DC_WGX / parts){
 
+      const int pixelNo = o / rotationsNo;
+      const int rotationNo = o % rotationsNo;
+      const int first = (lid % parts) * partLength;
 
-    // the first 16 threads sum the half of half
-    if(lid < DC_WGX / 4){
+      const int pixel = pixelNo * (DCB_RINGS_LENGTH + DCB_PX_PADDING);
 
-      diffs = lclTrg[lid * 4] + lclTrg[lid * 4 + 2];
+      float diffs = 0.0;
 
-      // first 16 fetch and write to global
-      out[(gy * (width / DC_PX_SPACING) + gx / (DC_WGX / DC_TRG_PIXELS_NO) + targetStep * DC_TRG_PER_LOOP) * 
-              ROTATIONS_NO + lid] = 
+      // template petal p of a ring against target petal p + rotationNo of that ring, bins likewise
+      for(int i = first; i < first + partLength; i++){
 
-          (regionNo < 2 ? 
+        const int ring = i / (REGION_PETALS_NO * GRADIENTS_NO);
+        const int petal = (i / GRADIENTS_NO) % REGION_PETALS_NO;
 
-              out[(gy * (width / DC_PX_SPACING) + gx / (DC_WGX / DC_TRG_PIXELS_NO) + targetStep * DC_TRG_PER_LOOP) * ROTATIONS_NO + lid]
-                
-                  : 0) + diffs;
+        diffs += fabs(lclTmp[i] - 
+                      lclTrg[pixel + ring * REGION_PETALS_NO * GRADIENTS_NO + 
+                             ((petal + rotationNo) % REGION_PETALS_NO) * GRADIENTS_NO + 
+                             (i + rotationNo) % GRADIENTS_NO]);
 
-    
+      }
+
+      lclSum[o * parts + lid % parts] = diffs;
 
     }
 
     barrier(CLK_LOCAL_MEM_FENCE);
 
-  }
+    // a worker per rotation keeps the best pixel, ties go to the first
+    if(lid < rotationsNo){
 
-}
+      float minimum = MAXFLOAT;
+      int arg = 0;
 
-#define WGX_TRANSPOSE_ROTATIONS 128
-#define SEGMENT_SIZE (WGX_TRANSPOSE_ROTATIONS / ROTATIONS_NO)
-kernel void transposeRotations(global float * in,
-                               global float * out,
-                               const  int     height,
-                               const  int     width)
-{
+      for(int pixelNo = 0; pixelNo < DC_TRG_PIXELS_NO; pixelNo++){
 
-  local float lcl[WGX_TRANSPOSE_ROTATIONS];
-  const int lid = get_local_id(0);
-  const int gy = get_global_id(1);
-  const int gx = get_global_id(0);
+        float diffs = 0.0;
+        for(int p = 0; p < parts; p++)
+          diffs += lclSum[(pixelNo * rotationsNo + lid) * parts + p];
 
-  lcl[lid] = in[gy * width * ROTATIONS_NO + gx];
-  
-  barrier(CLK_LOCAL_MEM_FENCE);
+        if(isless(diffs, minimum)){ minimum = diffs; arg = pixelNo; }
+
+      }
 
-  // will have 32 threads per target rotation
-  const int rotation = lid / SEGMENT_SIZE;
+      const int partial = (t * rotationsNo + lid) * groupsNo + groupNo;
 
-  out[rotation * height * width + gy * width + 
-      get_group_id(0) * SEGMENT_SIZE + gx % SEGMENT_SIZE] = 
+      outMin[partial] = minimum;
+      outArg[partial] = gy * coarseWidth + firstPixel + arg;
 
-      lcl[rotation + (lid % SEGMENT_SIZE) * ROTATIONS_NO];
+    }
+
+  }
 
 }
 
-#define WGX_REDUCEMIN 256
+//
+// The COARSE_CANDIDATES_NO smallest partial minima of diffCoarseBatched in one
+// launch, a group per template point and rotation. Each worker keeps a sorted
+// list of its share, the lists are then merged pairwise in local memory.
+// A candidate within COARSE_SUPPRESS_RADIUS coarse pixels (both ways) of a
+// better one is dropped, as reduceMiddle leaves out the 3x3 around its best,
+// so the runners up are other minima rather than the slope of the best one.
+// Candidate c of rotation r goes to row r * COARSE_CANDIDATES_NO + c of out and
+// its minimum to row (r + ROTATIONS_NO) * COARSE_CANDIDATES_NO + c, best first;
+// unused candidates are left at MAXFLOAT
+//
+#define WGX_REDUCE_PLANES 256
+#ifndef COARSE_CANDIDATES_NO
+#define COARSE_CANDIDATES_NO 4
+#endif
+#ifndef COARSE_SUPPRESS_RADIUS
+#define COARSE_SUPPRESS_RADIUS 2
+#endif
+
+// ties go to the first pixel, as in a scan of the target
+#define CANDIDATE_LESS(value, pixel, otherValue, otherPixel) \
+          (isless(value, otherValue) || ((value) == (otherValue) && (pixel) < (otherPixel)))
 
-kernel void reduceMin(global float * in,
-                      global float * out,
-                      const  int     size,
-                      local  volatile float * lcl){
+#define CANDIDATE_NEAR(pixel, otherPixel, coarseWidth) \
+          (abs((pixel) / (coarseWidth) - (otherPixel) / (coarseWidth)) <= COARSE_SUPPRESS_RADIUS && \
+           abs((pixel) % (coarseWidth) - (otherPixel) % (coarseWidth)) <= COARSE_SUPPRESS_RADIUS)
 
-    // perform first level of reduction,
-    // reading from global memory, writing to shared memory
-    const int lid = get_local_id(0);
-    const int i = get_group_id(0) * (get_local_size(0) * 1) + lid;
+// Inserts a candidate into a sorted list that has no two candidates near each
+// other: it is dropped next to a better one, and drops the worse ones next to it
+void insertCandidate(float * minima, int * args, const float value, const int pixel, const int coarseWidth){
+
+  for(int c = 0; c < COARSE_CANDIDATES_NO; c++)
+    if(minima[c] != MAXFLOAT && CANDIDATE_NEAR(pixel, args[c], coarseWidth) &&
+       CANDIDATE_LESS(minima[c], args[c], value, pixel))
+      return;
+
+  int kept = 0;
 
-    short int isLess;
-    if(i < size){
-      lcl[lid] = in[get_global_id(0)];
+  for(int c = 0; c < COARSE_CANDIDATES_NO; c++){
+    if(minima[c] == MAXFLOAT || !CANDIDATE_NEAR(pixel, args[c], coarseWidth)){
+      minima[kept] = minima[c];
+      args[kept++] = args[c];
     }
-    else{ lcl[lid] = 999; return; }
+  }
 
-    barrier(CLK_LOCAL_MEM_FENCE);
+  for(; kept < COARSE_CANDIDATES_NO; kept++){
+    minima[kept] = MAXFLOAT;
+    args[kept] = 0;
+  }
 
-    if(lid < 128){
+  if(!CANDIDATE_LESS(value, pixel, minima[COARSE_CANDIDATES_NO-1], args[COARSE_CANDIDATES_NO-1])) return;
 
-      isLess = isless(lcl[lid], lcl[lid + 128]);
-      lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 128]);
-      lcl[lid + 128] = (isLess ? lid : lid + 128);
+  int c = COARSE_CANDIDATES_NO - 1;
 
-    }
+  for(; c > 0 && CANDIDATE_LESS(value, pixel, minima[c-1], args[c-1]); c--){
+    minima[c] = minima[c-1];
+    args[c] = args[c-1];
+  }
 
-    barrier(CLK_LOCAL_MEM_FENCE); 
+  minima[c] = value;
+  args[c] = pixel;
 
-    if(lid < 64) {
+}
 
-      isLess = isless(lcl[lid],lcl[lid + 64]);
-      lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 64]);
-      lcl[lid + 64] = (isLess ? lcl[lid + 128] : lcl[lid + 64 + 128]);
+kernel void reduceMinPlanes(global const float * in,
+                            global const int   * indices,
+                            global       float * out,
+                            const        int     planeSize,
+                            const        int     rotationsNo,
+                            const        int     templateOffset,
+                            const        int     outStride,
+                            const        int     coarseWidth){
 
-    }
-    barrier(CLK_LOCAL_MEM_FENCE); 
-    
-    if (lid < 32)
-    {
-        // Might need to end threads after each step...
-
-        // Assuming WGX_REDUCEMIN >= 128
-        isLess = isless(lcl[lid], lcl[lid + 32]);
-        lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 32]);
-        lcl[lid + 32] = (isLess ? lcl[lid + 64] : lcl[lid + 32 + 64]);
-
-        if(lid < 16){
-          // Assuming WGX_REDUCEMIN >= 64
-          isLess = isless(lcl[lid], lcl[lid + 16]);
-          lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 16]);
-          lcl[lid + 16] = (isLess ? lcl[lid + 32] : lcl[lid + 16 + 32]);
-        }
+    local float lclMin[WGX_REDUCE_PLANES * COARSE_CANDIDATES_NO];
+    local int lclArg[WGX_REDUCE_PLANES * COARSE_CANDIDATES_NO];
 
-        if(lid < 8){
-          // Assuming WGX_REDUCEMIN >= 32
-          isLess = isless(lcl[lid], lcl[lid + 8]);
-          lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 8]);
-          lcl[lid + 8] = (isLess ? lcl[lid + 16] : lcl[lid + 8 + 16]);
-        }
+    const int lid = get_local_id(0);
+    const int plane = get_group_id(0);
 
-        if(lid < 4){
-          // Assuming WGX_REDUCEMIN >= 16
-          isLess = isless(lcl[lid], lcl[lid + 4]);
-          lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 4]);
-          lcl[lid + 4] = (isLess ? lcl[lid + 8] : lcl[lid + 4 + 8]);
-        }
+    global const float * values = in + plane * planeSize;
+    global const int * pixels = indices + plane * planeSize;
 
-        if(lid < 2){
-          // Assuming WGX_REDUCEMIN >= 8
-          isLess = isless(lcl[lid], lcl[lid + 2]);
-          lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 2]);
-          lcl[lid + 2] = (isLess ? lcl[lid + 4] : lcl[lid + 2 + 4]);
-        }
+    float minima[COARSE_CANDIDATES_NO];
+    int args[COARSE_CANDIDATES_NO];
 
-        if(lid < 1){
-          // Assuming WGX_REDUCEMIN >= 4
-          isLess = isless(lcl[lid], lcl[lid + 1]);
-          lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 1]);
-          lcl[lid + 1] = (isLess ? lcl[lid + 2] : lcl[lid + 1 + 2]);
-        }
+    for(int c = 0; c < COARSE_CANDIDATES_NO; c++){
+      minima[c] = MAXFLOAT;
+      args[c] = 0;
+    }
+
+    // the last candidate drops out of a full list
+    for(int i = lid; i < planeSize; i += WGX_REDUCE_PLANES)
+      insertCandidate(minima, args, values[i], pixels[i], coarseWidth);
 
+    for(int c = 0; c < COARSE_CANDIDATES_NO; c++){
+      lclMin[lid * COARSE_CANDIDATES_NO + c] = minima[c];
+      lclArg[lid * COARSE_CANDIDATES_NO + c] = args[c];
     }
-    
-    const int groups = get_num_groups(0);
-    const int wgid = get_group_id(0);
-    const int dstOffset = (get_global_offset(0) / size) * groups;
 
-    // write result for this block to global mem 
-    if(lid == 0) out[dstOffset + wgid] = get_global_offset(0) + (i - lid) + lcl[1];
+    barrier(CLK_LOCAL_MEM_FENCE);
 
-}
+    // the second list is inserted into the first, it is not written this step
+    for(int s = WGX_REDUCE_PLANES / 2; s > 0; s >>= 1){
 
-//
-// Reduce the minima given by the workgroups of reduceMin but for all rotations
-//
-//#define WGX_REDUCEMINALL = minimaPerRotation = (coarseHeight*coarseWidth / WGX_REDUCEMIN)
-kernel void reduceMinAll(global float * in,
-                         global float * mid,
-                         global float * out,
-                         const  int     minimaPerRotation,
-                         local  float * lcl,
-                         const  int     outStride){
-  
-    short int isLess;
-    const int wgid = get_group_id(0); // rotationNo
-    const int lid = get_local_id(0);
+      if(lid < s){
 
-    lcl[lid] = (lid < minimaPerRotation ? in[(int)(mid[wgid * minimaPerRotation + lid])] : 999);
+        const int first = lid * COARSE_CANDIDATES_NO;
+        const int second = (lid + s) * COARSE_CANDIDATES_NO;
 
-    barrier(CLK_LOCAL_MEM_FENCE); 
+        for(int c = 0; c < COARSE_CANDIDATES_NO; c++){
+          minima[c] = lclMin[first + c];
+          args[c] = lclArg[first + c];
+        }
 
-    // If the number of minima is less than the workgroup size
-    if(lid >= minimaPerRotation) return;
+        for(int c = 0; c < COARSE_CANDIDATES_NO && lclMin[second + c] != MAXFLOAT; c++)
+          insertCandidate(minima, args, lclMin[second + c], lclArg[second + c], coarseWidth);
 
-    if(lid < 32){
-      // Assuming WGX_REDUCEMIN >= 128
-      isLess = isless(lcl[lid], lcl[lid + 32]);
-      lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 32]);
-      lcl[lid + 32] = (isLess ? mid[wgid * minimaPerRotation + lid] : mid[wgid * minimaPerRotation + lid + 32]);
-    }
+        for(int c = 0; c < COARSE_CANDIDATES_NO; c++){
+          lclMin[first + c] = minima[c];
+          lclArg[first + c] = args[c];
+        }
 
-    if(lid < 16){
-      // Assuming WGX_REDUCEMIN >= 64
-      isLess = isless(lcl[lid], lcl[lid + 16]);
-      lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 16]);
-      lcl[lid + 16] = (isLess ? lcl[lid + 32] : lcl[lid + 16 + 32]);
-    }
+      }
 
-    if(lid < 8){
-      // Assuming WGX_REDUCEMIN >= 32
-      isLess = isless(lcl[lid], lcl[lid + 8]);
-      lcl[lid] = min(lcl[lid], lcl[lid + 8]);
-      lcl[lid + 8] = (isLess ? lcl[lid + 16] : lcl[lid + 8 + 16]);
-    }
+      barrier(CLK_LOCAL_MEM_FENCE);
 
-    if(lid < 4){
-      // Assuming WGX_REDUCEMIN >= 16
-      isLess = isless(lcl[lid], lcl[lid + 4]);
-      lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 4]);
-      lcl[lid + 4] = (isLess ? lcl[lid + 8] : lcl[lid + 4 + 8]);
     }
 
-    if(lid < 2){
-      // Assuming WGX_REDUCEMIN >= 8
-      isLess = isless(lcl[lid], lcl[lid + 2]);
-      lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 2]);
-      lcl[lid + 2] = (isLess ? lcl[lid + 4] : lcl[lid + 2 + 4]);
-    }
+    if(lid < COARSE_CANDIDATES_NO){
 
-    if(lid < 1){
-      // Assuming WGX_REDUCEMIN >= 4
-      isLess = isless(lcl[lid], lcl[lid + 1]);
-      lcl[lid] = (isLess ? lcl[lid] : lcl[lid + 1]);
-      lcl[lid + 1] = (isLess ? lcl[lid + 2] : lcl[lid + 1 + 2]);
-    }
+      const int templateNo = templateOffset + plane / rotationsNo;
+      const int rotationNo = plane % rotationsNo;
+
+      out[(rotationNo * COARSE_CANDIDATES_NO + lid) * outStride + templateNo] = lclArg[lid];
+      out[((rotationNo + ROTATIONS_NO) * COARSE_CANDIDATES_NO + lid) * outStride + templateNo] = lclMin[lid];
 
-    if(lid == 0) {
-      out[wgid * outStride + get_global_offset(0)] = ((int)lcl[1]) % (minimaPerRotation * WGX_REDUCEMIN);
-      out[(wgid + ROTATIONS_NO) * outStride + get_global_offset(0)] = lcl[0];
     }
 
 }
@@ -1072,6 +1606,7 @@ kernel void normaliseRotation(global float * data,
 // trg - get target descriptors from
 // diff - store differences
 // corrs - get template coord and target coord using template index 0-(TEMPLATE_POINTS_NO-1)
+// templateNoOffset - where the launch's seeds start in corrs, diff holds the launch's seeds only
 kernel void diffMiddle( global   float * tmp,
                         global   float * trg,
                         global   float * diff,
@@ -1088,8 +1623,9 @@ kernel void diffMiddle( global   float * tmp,
 
   const int lx = get_local_id(0);
 
-  // get template pixel no
-  const int templateNo = templateNoOffset + get_global_id(1);
+  // get template pixel no, seedNo is its row of diff
+  const int seedNo = get_global_id(1);
+  const int templateNo = templateNoOffset + seedNo;
   const int searchNo = (get_global_id(0) / DM_WGX) * DM_WG_TARGETS_NO;
   const int searchOffset = (((searchNo / DM_SEARCH_WIDTH) - DM_SEARCH_WIDTH / 2) * width 
                          + ((searchNo % DM_SEARCH_WIDTH) - DM_SEARCH_WIDTH / 2)) * DM_PIXEL_SPACING;
@@ -1248,12 +1784,12 @@ kernel void diffMiddle( global   float * tmp,
     if(lx < DM_OUTPUT){
 
       // first 16 fetch and write to global
-      diff[templateNo * (DM_SEARCH_WIDTH * DM_SEARCH_WIDTH * DM_ROTATIONS_NO) + (searchNo + targetStep * DM_TARGETS_PER_LOOP) 
+      diff[seedNo * (DM_SEARCH_WIDTH * DM_SEARCH_WIDTH * DM_ROTATIONS_NO) + (searchNo + targetStep * DM_TARGETS_PER_LOOP) 
                       * DM_ROTATIONS_NO + lx] = 
 
           (regionNo < 2 ? 
 
-              diff[templateNo * (DM_SEARCH_WIDTH * DM_SEARCH_WIDTH * DM_ROTATIONS_NO) + (searchNo + targetStep * DM_TARGETS_PER_LOOP) 
+              diff[seedNo * (DM_SEARCH_WIDTH * DM_SEARCH_WIDTH * DM_ROTATIONS_NO) + (searchNo + targetStep * DM_TARGETS_PER_LOOP) 
                               * DM_ROTATIONS_NO + lx]
                 
                   : 0) + lclTrg[lx * (DM_WGX / DM_OUTPUT)];
@@ -1264,6 +1800,249 @@ kernel void diffMiddle( global   float * tmp,
 
 }
 
+//
+// The best offset and rotation of each seed of a diffMiddle launch, a group
+// per seed over its DM_SEARCH_WIDTH^2 x DM_ROTATIONS_NO distances. The second
+// best is the smallest distance outside the 3x3 offsets around the best one,
+// so the ratio tells a distinctive match from a smooth neighbourhood. Seed
+// firstSeed + group gets the target pixel, the rotation, the distance and
+// best / second best in out, MIDDLE_ARGMIN_LENGTH floats
+//
+#define WGX_REDUCE_MIDDLE 256
+#define DM_VOLUME (DM_SEARCH_WIDTH * DM_SEARCH_WIDTH * DM_ROTATIONS_NO)
+#define MIDDLE_ARGMIN_LENGTH 4
+
+kernel void reduceMiddle(global const float * diff,
+                         global const float * corrs,
+                         global       float * out,
+                         const        int     width,
+                         const        int     startRotationNo,
+                         const        int     templateNoOffset,
+                         const        int     firstSeed){
+
+    local float lclMin[WGX_REDUCE_MIDDLE];
+    local int lclArg[WGX_REDUCE_MIDDLE];
+
+    const int lid = get_local_id(0);
+    const int seedNo = get_group_id(0);
+
+    global const float * volume = diff + seedNo * DM_VOLUME;
+
+    float best = MAXFLOAT;
+    int bestNo = 0;
+
+    for(int i = lid; i < DM_VOLUME; i += WGX_REDUCE_MIDDLE){
+
+      const float value = volume[i];
+
+      if(isless(value, best)){
+        best = value;
+        bestNo = i;
+      }
+
+    }
+
+    lclMin[lid] = best;
+    lclArg[lid] = bestNo;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int s = WGX_REDUCE_MIDDLE / 2; s > 0; s >>= 1){
+
+      if(lid < s && CANDIDATE_LESS(lclMin[lid + s], lclArg[lid + s], lclMin[lid], lclArg[lid])){
+        lclMin[lid] = lclMin[lid + s];
+        lclArg[lid] = lclArg[lid + s];
+      }
+
+      barrier(CLK_LOCAL_MEM_FENCE);
+
+    }
+
+    best = lclMin[0];
+    bestNo = lclArg[0];
+
+    const int bestSearchNo = bestNo / DM_ROTATIONS_NO;
+    const int bestX = bestSearchNo % DM_SEARCH_WIDTH;
+    const int bestY = bestSearchNo / DM_SEARCH_WIDTH;
+
+    // every worker has the best before lclMin is reused
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    float second = MAXFLOAT;
+
+    for(int i = lid; i < DM_VOLUME; i += WGX_REDUCE_MIDDLE){
+
+      const int searchNo = i / DM_ROTATIONS_NO;
+
+      if(abs(searchNo % DM_SEARCH_WIDTH - bestX) > 1 || abs(searchNo / DM_SEARCH_WIDTH - bestY) > 1)
+        second = fmin(second, volume[i]);
+
+    }
+
+    lclMin[lid] = second;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int s = WGX_REDUCE_MIDDLE / 2; s > 0; s >>= 1){
+
+      if(lid < s)
+        lclMin[lid] = fmin(lclMin[lid], lclMin[lid + s]);
+
+      barrier(CLK_LOCAL_MEM_FENCE);
+
+    }
+
+    if(lid == 0){
+
+      const int templateNo = templateNoOffset + seedNo;
+
+      // the offsets of diffMiddle, centred on the seed's projection
+      const int targetPixel = (int)corrs[templateNo * 2 + 1]
+                            + ((bestY - DM_SEARCH_WIDTH / 2) * width + (bestX - DM_SEARCH_WIDTH / 2)) * DM_PIXEL_SPACING;
+
+      global float * seedOut = out + (firstSeed + seedNo) * MIDDLE_ARGMIN_LENGTH;
+
+      seedOut[0] = targetPixel;
+      seedOut[1] = (startRotationNo + bestNo % DM_ROTATIONS_NO) % ROTATIONS_NO;
+      seedOut[2] = best;
+      seedOut[3] = (lclMin[0] > 0 ? best / lclMin[0] : 1);
+
+    }
+
+}
+
+//
+// The fine layer re-searches the DF_SEARCH_WIDTH^2 offsets around each seed's
+// middle layer match, at the rotation it was found at, over whole descriptors
+// (the centre and all three rings); a group per seed and a worker per offset.
+// A parabola through the best offset and its neighbours, across and down,
+// places the match between pixels. Seed firstSeed + group reads its middle
+// match from argmin and writes x, y, distance and rotation, FINE_ARGMIN_LENGTH
+// floats, after the middle matches of all seedsNo seeds
+//
+#ifndef DF_SEARCH_WIDTH
+#define DF_SEARCH_WIDTH 8
+#endif
+#define DF_OFFSETS (DF_SEARCH_WIDTH * DF_SEARCH_WIDTH)
+#if (DF_OFFSETS & (DF_OFFSETS - 1))
+#error "DF_SEARCH_WIDTH has to be a power of two, diffFine halves its offsets to reduce them"
+#endif
+#define FINE_ARGMIN_LENGTH 4
+
+// Vertex of the parabola through (-1,left), (0,centre) and (1,right), within half a pixel
+inline float parabolaVertex(const float left, const float centre, const float right){
+
+  const float curvature = left - 2 * centre + right;
+
+  return (curvature > 0 ? clamp(0.5f * (left - right) / curvature, -0.5f, 0.5f) : 0.0f);
+
+}
+
+kernel void diffFine(global const float * tmp,
+                     global const float * trg,
+                     global const float * corrs,
+                     global       float * argmin,
+                     const        int     width,
+                     const        int     pixelsNo,
+                     const        int     seedsNo,
+                     const        int     templateNoOffset,
+                     const        int     firstSeed){
+
+    local float lclTmp[DESCRIPTOR_LENGTH];
+    local float lclCost[DF_OFFSETS];
+    local float lclMin[DF_OFFSETS];
+    local int lclArg[DF_OFFSETS];
+
+    const int lid = get_local_id(0);
+    const int seedNo = get_group_id(0);
+    const int templateNo = templateNoOffset + seedNo;
+
+    global const float * middle = argmin + (firstSeed + seedNo) * MIDDLE_ARGMIN_LENGTH;
+
+    const int middlePixel = (int)middle[0];
+    const int rotationNo = (int)middle[1];
+
+    global const float * templateDescriptor = tmp + ((int)corrs[templateNo * 2]) * DESCRIPTOR_LENGTH;
+
+    for(int i = lid; i < DESCRIPTOR_LENGTH; i += DF_OFFSETS)
+      lclTmp[i] = templateDescriptor[i];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const int offsetX = lid % DF_SEARCH_WIDTH - DF_SEARCH_WIDTH / 2;
+    const int offsetY = lid / DF_SEARCH_WIDTH - DF_SEARCH_WIDTH / 2;
+    const int pixel = middlePixel + offsetY * width + offsetX;
+    const int column = middlePixel % width + offsetX;
+
+    float cost = MAXFLOAT;
+
+    // offsets past the left or right edge would wrap onto the next row
+    if(pixel >= 0 && pixel < pixelsNo && column >= 0 && column < width){
+
+      global const float * targetDescriptor = trg + pixel * DESCRIPTOR_LENGTH + TRANSD_FAST_PETAL_PADDING * GRADIENTS_NO;
+      local const float * templatePetals = lclTmp + TRANSD_FAST_PETAL_PADDING * GRADIENTS_NO;
+
+      cost = 0.0f;
+
+      // the centre histogram only turns its gradients
+      for(int g = 0; g < GRADIENTS_NO; g++)
+        cost += fabs(templatePetals[g] - targetDescriptor[(rotationNo + g) % GRADIENTS_NO]);
+
+      for(int petalNo = 0; petalNo < SMOOTHINGS_NO * REGION_PETALS_NO; petalNo++){
+
+        const int regionNo = petalNo / REGION_PETALS_NO;
+        const int trgPetal = 1 + regionNo * REGION_PETALS_NO + (petalNo + rotationNo) % REGION_PETALS_NO;
+
+        for(int g = 0; g < GRADIENTS_NO; g++)
+          cost += fabs(templatePetals[(1 + petalNo) * GRADIENTS_NO + g] -
+                       targetDescriptor[trgPetal * GRADIENTS_NO + (rotationNo + g) % GRADIENTS_NO]);
+
+      }
+
+    }
+
+    lclCost[lid] = cost;
+    lclMin[lid] = cost;
+    lclArg[lid] = lid;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int s = DF_OFFSETS / 2; s > 0; s >>= 1){
+
+      if(lid < s && CANDIDATE_LESS(lclMin[lid + s], lclArg[lid + s], lclMin[lid], lclArg[lid])){
+        lclMin[lid] = lclMin[lid + s];
+        lclArg[lid] = lclArg[lid + s];
+      }
+
+      barrier(CLK_LOCAL_MEM_FENCE);
+
+    }
+
+    if(lid == 0){
+
+      const int best = lclArg[0];
+      const int bestX = best % DF_SEARCH_WIDTH;
+      const int bestY = best / DF_SEARCH_WIDTH;
+
+      // on the border of the window there is no neighbour to fit through
+      const float subX = (bestX > 0 && bestX < DF_SEARCH_WIDTH - 1 ?
+                          parabolaVertex(lclCost[best - 1], lclCost[best], lclCost[best + 1]) : 0.0f);
+      const float subY = (bestY > 0 && bestY < DF_SEARCH_WIDTH - 1 ?
+                          parabolaVertex(lclCost[best - DF_SEARCH_WIDTH], lclCost[best], lclCost[best + DF_SEARCH_WIDTH]) : 0.0f);
+
+      const int finePixel = middlePixel + (bestY - DF_SEARCH_WIDTH / 2) * width + (bestX - DF_SEARCH_WIDTH / 2);
+
+      global float * seedOut = argmin + seedsNo * MIDDLE_ARGMIN_LENGTH + (firstSeed + seedNo) * FINE_ARGMIN_LENGTH;
+
+      seedOut[0] = finePixel % width + subX;
+      seedOut[1] = finePixel / width + subY;
+      seedOut[2] = lclMin[0];
+      seedOut[3] = rotationNo;
+
+    }
+
+}
+
 
 
 
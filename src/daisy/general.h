@@ -12,6 +12,9 @@ typedef struct {
 #define min(a,b) (a > b ? b : a)
 #define max(a,b) (a > b ? a : b)
 
+// the global size of an NDRange with tail work groups covering n items
+#define roundUp(n,group) ((((n) + (group) - 1) / (group)) * (group))
+
 #ifndef TRANSFORM_STRUCT
 #define TRANSFORM_STRUCT
 typedef struct {
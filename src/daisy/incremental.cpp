@@ -0,0 +1,332 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: incremental.cpp
+
+*/
+
+#include "incremental.h"
+#include "general.h"
+
+int oclErrorI(const char * function, const char * functionCall, int error){
+
+  if(error){
+    fprintf(stderr, "incremental.cpp::%s %s failed: %d\n",function,functionCall,error);
+    return error;
+  }
+
+  return 0;
+
+}
+
+// Buffers of the frames and tiles of daisy's size, NULL if they cannot be created
+incremental_state * newIncrementalState(daisy_params * daisy, ocl_constructs * daisyCl, int threshold){
+
+  cl_int error;
+
+  incremental_state * state = (incremental_state*)malloc(sizeof(incremental_state));
+
+  size_t frameSize = (size_t)daisy->width * daisy->height;
+
+  state->tilesX = (daisy->width + CHANGE_TILE-1) / CHANGE_TILE;
+  state->tilesY = (daisy->height + CHANGE_TILE-1) / CHANGE_TILE;
+  state->threshold = threshold;
+  state->primed = 0;
+  state->changedTilesNo = 0;
+  state->regionsNo = 0;
+  state->pixelsExtracted = 0;
+
+  state->changed = (int*)malloc(sizeof(int) * state->tilesX * state->tilesY);
+  state->regions = (int*)malloc(sizeof(int) * state->tilesX * state->tilesY * 4);
+
+  state->reference = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE, frameSize, NULL, &error);
+  oclErrorI("newIncrementalState","clCreateBuffer (reference)",error);
+
+  state->frame = clCreateBuffer(daisyCl->context, CL_MEM_READ_ONLY, frameSize, NULL, &error);
+  oclErrorI("newIncrementalState","clCreateBuffer (frame)",error);
+
+  state->tiles = clCreateBuffer(daisyCl->context, CL_MEM_WRITE_ONLY,
+                                sizeof(int) * state->tilesX * state->tilesY, NULL, &error);
+  oclErrorI("newIncrementalState","clCreateBuffer (tiles)",error);
+
+  if(state->reference == NULL || state->frame == NULL || state->tiles == NULL){
+    freeIncrementalState(state);
+    return NULL;
+  }
+
+  return state;
+
+}
+
+void freeIncrementalState(incremental_state * state){
+
+  if(state->reference != NULL) clReleaseMemObject(state->reference);
+  if(state->frame != NULL) clReleaseMemObject(state->frame);
+  if(state->tiles != NULL) clReleaseMemObject(state->tiles);
+
+  free(state->changed);
+  free(state->regions);
+  free(state);
+
+}
+
+// Extracts the descriptors of a rectangle and copies them in place into those
+// of the whole frame in daisy->buffers[0]; oclDaisy plans and pads for the
+// rectangle, the layout of the frame is restored for the matcher afterwards
+int extractRegion(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times,
+                  int x, int y, int width, int height){
+
+  cl_int error;
+
+  int paddedWidth = daisy->paddedWidth;
+  int paddedHeight = daisy->paddedHeight;
+  memory_plan plan = daisy->plan;
+  unsigned int residentBuffers = daisy->buffersSize;
+  cl_mem orientations = daisy->orientations;
+
+  daisy->orientations = NULL;
+
+  daisy->roiX = x;
+  daisy->roiY = y;
+  daisy->roiWidth = width;
+  daisy->roiHeight = height;
+
+  error = oclDaisy(daisy, daisyCl, times);
+
+  int regionSections = daisy->plan.sectionsNo;
+  cl_mem regionOrientations = daisy->orientations;
+
+  daisy->roiX = daisy->roiY = 0;
+  daisy->roiWidth = daisy->roiHeight = 0;
+  daisy->paddedWidth = paddedWidth;
+  daisy->paddedHeight = paddedHeight;
+  daisy->plan = plan;
+  daisy->orientations = orientations;
+
+  if(error){
+    if(regionOrientations != NULL) clReleaseMemObject(regionOrientations);
+    return error;
+  }
+
+  // smaller than the frame, it only spans sections when the budget is tight
+  if(regionSections > 1){
+    if(regionOrientations != NULL) clReleaseMemObject(regionOrientations);
+    fprintf(stderr, "incremental.cpp::extractRegion %dx%d does not fit in one section\n", height, width);
+    return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+  }
+
+  size_t descriptorSize = daisy->descriptorLength * sizeof(float);
+
+  size_t srcOrigin[3] = {0, 0, 0};
+  size_t dstOrigin[3] = {x * descriptorSize, (size_t)y, 0};
+  size_t region[3] = {width * descriptorSize, (size_t)height, 1};
+
+  error = clEnqueueCopyBufferRect(daisyCl->ioqueue, daisy->buffers[residentBuffers], daisy->buffers[0],
+                                  srcOrigin, dstOrigin, region,
+                                  region[0], 0, paddedWidth * descriptorSize, 0,
+                                  0, NULL, NULL);
+
+  if(oclErrorI("extractRegion","clEnqueueCopyBufferRect (descriptors)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  // and the dominant bins of oriented descriptors, one byte each
+  if(regionOrientations != NULL){
+
+    size_t orientationsOrigin[3] = {(size_t)x, (size_t)y, 0};
+    size_t orientationsRegion[3] = {(size_t)width, (size_t)height, 1};
+
+    error = clEnqueueCopyBufferRect(daisyCl->ioqueue, regionOrientations, daisy->orientations,
+                                    srcOrigin, orientationsOrigin, orientationsRegion,
+                                    width, 0, paddedWidth, 0,
+                                    0, NULL, NULL);
+
+    if(oclErrorI("extractRegion","clEnqueueCopyBufferRect (orientations)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  }
+
+  error = clFinish(daisyCl->ioqueue);
+  if(oclErrorI("extractRegion","clFinish",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  while(daisy->buffersSize > residentBuffers)
+    clReleaseMemObject(daisy->buffers[--daisy->buffersSize]);
+
+  if(regionOrientations != NULL) clReleaseMemObject(regionOrientations);
+
+  return 0;
+
+}
+
+// Runs of changed tiles along each tile row become rectangles, a run spanning
+// the same columns as one of the row above extends that rectangle instead
+int changedRegions(incremental_state * state, int width, int height){
+
+  int regionsNo = 0;
+
+  state->changedTilesNo = 0;
+
+  for(int ty = 0; ty < state->tilesY; ty++){
+
+    int tx = 0;
+
+    while(tx < state->tilesX){
+
+      if(!state->changed[ty * state->tilesX + tx]){ tx++; continue; }
+
+      int runStart = tx;
+
+      while(tx < state->tilesX && state->changed[ty * state->tilesX + tx]) tx++;
+
+      state->changedTilesNo += tx - runStart;
+
+      int x0 = runStart * CHANGE_TILE;
+      int x1 = min(tx * CHANGE_TILE, width);
+      int y0 = ty * CHANGE_TILE;
+      int y1 = min((ty+1) * CHANGE_TILE, height);
+
+      int r;
+      for(r = 0; r < regionsNo; r++){
+
+        int * region = state->regions + r * 4;
+
+        if(region[0] == x0 && region[2] == x1 && region[3] == y0){
+          region[3] = y1;
+          break;
+        }
+
+      }
+
+      if(r == regionsNo){
+
+        int * region = state->regions + regionsNo++ * 4;
+
+        region[0] = x0;
+        region[1] = y0;
+        region[2] = x1;
+        region[3] = y1;
+
+      }
+
+    }
+
+  }
+
+  return regionsNo;
+
+}
+
+// The first frame is extracted whole, every later one is compared with the
+// reference tile by tile on the device and only the descriptors within
+// ROI_HALO of a changed tile are extracted again, in place. Tiles that change
+// by no more than the threshold keep their reference, so slow drifts add up
+// until they pass it. Needs all FIR layers, padding 1 and the descriptors of
+// a frame kept on the device in one section.
+int oclDaisyIncremental(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times,
+                        incremental_state * state, unsigned char * frame){
+
+  cl_int error;
+
+  size_t frameSize = (size_t)daisy->width * daisy->height;
+
+  daisy->array = frame;
+  daisy->roiWidth = daisy->roiHeight = 0;
+
+  if(!state->primed){
+
+    short int cascade = 1;
+    for(int i = 0; i < daisy->smoothingsNo; i++)
+      cascade = cascade && (daisy->smoothingModes[i] == SMOOTHING_FIR);
+
+    if(!cascade || daisy->padding != 1 || daisy->cpuTransfer){
+      fprintf(stderr, "incremental.cpp::oclDaisyIncremental needs all FIR layers, padding 1 and no transfers to RAM\n");
+      return CL_INVALID_VALUE;
+    }
+
+    daisyReleaseBuffers(daisy);
+
+    error = oclDaisy(daisy, daisyCl, times);
+    if(error) return error;
+
+    if(daisy->plan.sectionsNo > 1){
+      fprintf(stderr, "incremental.cpp::oclDaisyIncremental needs the descriptors of a frame in one section\n");
+      return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    error = clEnqueueWriteBuffer(daisyCl->ioqueue, state->reference, CL_TRUE, 0, frameSize, (void*)frame,
+                                 0, NULL, NULL);
+
+    if(oclErrorI("oclDaisyIncremental","clEnqueueWriteBuffer (reference)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    state->primed = 1;
+    state->changedTilesNo = state->tilesX * state->tilesY;
+    state->regionsNo = 1;
+    state->pixelsExtracted = frameSize;
+
+    return 0;
+
+  }
+
+  error = clEnqueueWriteBuffer(daisyCl->ioqueue, state->frame, CL_FALSE, 0, frameSize, (void*)frame,
+                               0, NULL, NULL);
+
+  if(oclErrorI("oclDaisyIncremental","clEnqueueWriteBuffer (frame)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  size_t tilesWorkerSize[2] = {state->tilesX * CHANGE_WG, state->tilesY * CHANGE_WG};
+  size_t tilesGroupSize[2] = {CHANGE_WG, CHANGE_WG};
+
+  clSetKernelArg(daisy->oclKernels->changedTiles, 0, sizeof(cl_mem), (void*)&state->reference);
+  clSetKernelArg(daisy->oclKernels->changedTiles, 1, sizeof(cl_mem), (void*)&state->frame);
+  clSetKernelArg(daisy->oclKernels->changedTiles, 2, sizeof(cl_mem), (void*)&state->tiles);
+  clSetKernelArg(daisy->oclKernels->changedTiles, 3, sizeof(int), (void*)&daisy->width);
+  clSetKernelArg(daisy->oclKernels->changedTiles, 4, sizeof(int), (void*)&daisy->height);
+  clSetKernelArg(daisy->oclKernels->changedTiles, 5, sizeof(int), (void*)&state->threshold);
+
+  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->changedTiles, 2, NULL,
+                                 tilesWorkerSize, tilesGroupSize, 0, NULL, NULL);
+
+  if(oclErrorI("oclDaisyIncremental","clEnqueueNDRangeKernel (changedTiles)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  error = clEnqueueReadBuffer(daisyCl->ioqueue, state->tiles, CL_TRUE, 0,
+                              sizeof(int) * state->tilesX * state->tilesY, (void*)state->changed,
+                              0, NULL, NULL);
+
+  if(oclErrorI("oclDaisyIncremental","clEnqueueReadBuffer (tiles)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  state->regionsNo = changedRegions(state, daisy->width, daisy->height);
+  state->pixelsExtracted = 0;
+
+  for(int r = 0; r < state->regionsNo; r++){
+
+    int * region = state->regions + r * 4;
+
+    // every descriptor within ROI_HALO of a changed pixel depends on it
+    int x0 = max(0, region[0] - ROI_HALO);
+    int y0 = max(0, region[1] - ROI_HALO);
+    int x1 = min(daisy->width, region[2] + ROI_HALO);
+    int y1 = min(daisy->height, region[3] + ROI_HALO);
+
+    error = extractRegion(daisy, daisyCl, times, x0, y0, x1 - x0, y1 - y0);
+    if(error) return error;
+
+    state->pixelsExtracted += (long int)(x1 - x0) * (y1 - y0);
+
+    // the changed tiles are extracted from this frame now
+    size_t origin[3] = {(size_t)region[0], (size_t)region[1], 0};
+    size_t size[3] = {(size_t)(region[2] - region[0]), (size_t)(region[3] - region[1]), 1};
+
+    error = clEnqueueCopyBufferRect(daisyCl->ioqueue, state->frame, state->reference,
+                                    origin, origin, size,
+                                    daisy->width, 0, daisy->width, 0,
+                                    0, NULL, NULL);
+
+    if(oclErrorI("oclDaisyIncremental","clEnqueueCopyBufferRect (reference)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  }
+
+  error = clFinish(daisyCl->ioqueue);
+  if(oclErrorI("oclDaisyIncremental","clFinish",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  return 0;
+
+}
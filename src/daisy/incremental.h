@@ -0,0 +1,45 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: incremental.h
+
+*/
+
+#include "oclDaisy.h"
+
+// Side of the tiles that frames are compared in, as in the changedTiles kernel
+#define CHANGE_TILE 64
+#define CHANGE_WG 16
+
+// Video frames of a fixed camera, only the tiles that changed since their
+// descriptors were extracted are extracted again
+#ifndef INCREMENTAL_STATE
+#define INCREMENTAL_STATE
+typedef struct incremental_state_tag{
+  cl_mem reference;     // 8 bit frame every tile was last extracted from
+  cl_mem frame;         // 8 bit frame being compared
+  cl_mem tiles;         // changed flag per tile
+  int * changed;        // host copy of the flags
+  int * regions;        // x0,y0,x1,y1 rectangles of changed tiles
+  int tilesX;
+  int tilesY;
+  int threshold;        // grey levels a pixel has to change by to dirty its tile
+  short int primed;     // the descriptors of a whole frame are on the device
+  int changedTilesNo;   // of the last frame
+  int regionsNo;
+  long int pixelsExtracted;
+} incremental_state;
+#endif
+
+incremental_state * newIncrementalState(daisy_params *, ocl_constructs *, int);
+
+void freeIncrementalState(incremental_state *);
+
+int extractRegion(daisy_params *, ocl_constructs *, time_params *, int, int, int, int);
+
+int changedRegions(incremental_state *, int, int);
+
+int oclDaisyIncremental(daisy_params *, ocl_constructs *, time_params *, incremental_state *, unsigned char *);
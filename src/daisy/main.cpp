@@ -10,11 +10,11 @@
 
 #include "main.h"
 #include <stdio.h>
+#include <unistd.h>
 #include <sys/time.h>
 
 using namespace kutility;
 
-double getStd(double* observations, int length);
 double timeDiff(struct timeval start, struct timeval end);
 void displayTimes(daisy_params * daisy,time_params * times);
 void writeInfofile(daisy_params * daisy, char * binaryfile);
@@ -95,15 +95,27 @@ void runMatcher(char * f1, char * f2){
   daisy_params * daisyTemplate = initDaisy(f1,0);
   daisy_params * daisyTarget = initDaisy(f2,0);
 
+  // the matcher works on padded descriptors
+  daisyTemplate->padding = ARRAY_PADDING;
+  daisyTarget->padding = ARRAY_PADDING;
+
   initOcl(daisyTemplate, daisyCl);
   initOclMatch(daisyTemplate,daisyCl);
 
   daisyTarget->oclKernels = daisyTemplate->oclKernels;
 
-  oclDaisy(daisyTemplate, daisyCl, times);
+  // the template is extracted once, later runs load what the matcher uses of it
+  if(loadTemplateCache(daisyTemplate, daisyCl)){
+    oclDaisy(daisyTemplate, daisyCl, times);
+    saveTemplateCache(daisyTemplate, daisyCl);
+  }
+  else{
+    printf("Template descriptors loaded from cache\n");
+  }
+
   oclDaisy(daisyTarget, daisyCl, times);
 
-  oclMatchDaisy(daisyTemplate, daisyTarget, daisyCl, times);
+  oclMatchDaisy(daisyTemplate, daisyTarget, daisyCl, times, NULL);
 
   daisyCleanUp(daisyTemplate,daisyCl);
   daisyCleanUp(daisyTarget,daisyCl);
@@ -112,83 +124,26 @@ void runMatcher(char * f1, char * f2){
 
 void runMatchProfile(char * csvLabel){
 
-  time_params * times = (time_params*) malloc(sizeof(time_params));
-  times->measureDeviceHostTransfers = 0;
-  times->transPinned = 0;
-  times->transRam = 0;
-  times->displayRuntimes = 1;
-  times->enabled = 1;
-
-  ocl_constructs * daisyCl = newOclConstructs(0,0,0);
+  bench_config * config = newBenchConfig();
+  config->extraction = 0;
+  config->matching = 1;
 
-  string tempName = "test-data/fifa-template.jpg";
-  string targName = "test-data/obj-frames/resized/frame-0200.png";
+  // use the recorded pair when available, synthetic targets otherwise
+  char tempName[] = "test-data/fifa-template.jpg";
+  char targName[] = "test-data/obj-frames/resized/frame-0200.png";
 
-  daisy_params * daisyTemplate = initDaisy(tempName.c_str(),0);
-  daisy_params * daisyTarget = initDaisy(targName.c_str(),0);
-
-  initOcl(daisyTemplate, daisyCl);
-  initOclMatch(daisyTemplate,daisyCl);
-
-  daisyTarget->oclKernels = daisyTemplate->oclKernels;
-
-  oclDaisy(daisyTemplate, daisyCl, times);
-  oclDaisy(daisyTarget, daisyCl, times);
+  if(access(tempName, R_OK) == 0 && access(targName, R_OK) == 0){
+    config->templateFile = tempName;
+    config->targetFile = targName;
+  }
 
-  int iterations = 10;
-
-  double t_match = 0;
-  double t_diffc = 0;
-  double t_trans = 0;
-  double t_reduce1 = 0;
-  double t_reduce2 = 0;
-  double t_diffm = 0;
-  double t_matchcpu = 0;
-  double success = 0;
-  double * matchTimes = (double*) malloc(sizeof(double) * iterations);
-  double * matchTimesCpu = (double*) malloc(sizeof(double) * iterations);
-  int n = 0;
-
-  for(int i = 0; i < iterations; i++){
-
-    times->diffCoarse = 0;
-    times->transRot = 0;
-    times->reduceMin = 0;
-    times->reduceMinAll = 0;
-
-    success += oclMatchDaisy(daisyTemplate, daisyTarget, daisyCl, times);
-
-    if(success != 0)
-      continue;
-
-    n++;
-
-    // Add up the times
-    matchTimes[i] = timeDiff(times->startMatchDaisy, times->endMatchDaisy);
-//    t_diffc += timeDiff(times->startDiffCoarse, times->endDiffCoarse);
-    t_diffc += times->diffCoarse;
-//    t_trans += timeDiff(times->startDiffTranspose, times->endDiffTranspose);
-    t_trans += times->transRot;
-//    t_reduce1 += timeDiff(times->startReduceCoarse1, times->endReduceCoarse1);
-    t_reduce1 += times->reduceMin;
-//    t_reduce2 += timeDiff(times->startReduceCoarse2, times->endReduceCoarse2);
-    t_reduce2 += times->reduceMinAll;
-    t_diffm += timeDiff(times->startDiffMiddle, times->endDiffMiddle);
-    matchTimesCpu[i] = timeDiff(times->startMatchCpu, times->endMatchCpu);
-
-    t_match += matchTimes[i];
-    t_matchcpu += matchTimesCpu[i];
+  ocl_constructs * daisyCl = newOclConstructs(0,0,0);
+  bench_results * results = newBenchResults();
 
-  }
+  int error = benchMatching(config, daisyCl, results);
 
-  t_match /= n;
-  t_diffc /= n;
-  t_trans /= n;
-  t_reduce1 /= n;
-  t_reduce2 /= n;
-  t_diffm /= n;
-  t_matchcpu /= n;
-  success /= iterations;
+  finaliseBenchResults(results);
+  displayBenchResults(results);
 
   // Append to an output file
   struct tm * sysTime = NULL;                     
@@ -198,38 +153,15 @@ void runMatchProfile(char * csvLabel){
   sysTime = localtime(&timeVal);
 
   char * csvOutName = (char*)malloc(sizeof(char) * 200);
-  char * nameTemplate = (char*)malloc(sizeof(char) * 100);
-
-  strcpy(nameTemplate,"gdaisy-match-speeds-%02d%02d-%s.csv");
 
-  sprintf(csvOutName, nameTemplate, sysTime->tm_mon+1, sysTime->tm_mday, csvLabel);//, sysTime->tm_hour, sysTime->tm_min);
+  sprintf(csvOutName, "gdaisy-match-speeds-%02d%02d-%s.csv", sysTime->tm_mon+1, sysTime->tm_mday, csvLabel);
 
-  short int newFile = (access(csvOutName, F_OK) == -1);
-
-  FILE * csvOut = fopen(csvOutName,"a+");
-
-  if(newFile)
-    fprintf(csvOut,"templateH,templateW,targetH,targetW,WGX,DM_WG_TARGETS_NO,DM_TARGETS_PER_LOOP,COARSE_TEMPLATES_NO,MIDDLE_TEMPLATES_NO,DM_SEARCH_WIDTH,DM_ROTATIONS_NO,diffCoarse,diffTrans,\
-reduceCoarse1,reduceCoarse2,diffMiddle,daisyMatch,daisyMatchStd,daisyMatchCpu,iterations,success\n");
-
-  const char * templateRow = "%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%.2f\n";
-
-  double t_matchstd = getStd(matchTimes,n);
-  double t_matchcpustd = getStd(matchTimesCpu,n);
-
-  fprintf(csvOut, templateRow,
-                  daisyTemplate->paddedHeight, daisyTemplate->paddedWidth,
-                  daisyTarget->paddedHeight, daisyTarget->paddedWidth,
-                  DM_WGX, DM_WG_TARGETS_NO, DM_TARGETS_PER_LOOP, COARSE_TEMPLATES_NO, MIDDLE_TEMPLATES_NO, DM_SEARCH_WIDTH, DM_ROTATIONS_NO, 
-                  t_diffc, t_trans, t_reduce1, t_reduce2, t_diffm, t_match, t_matchstd,
-                  t_matchcpu, t_matchcpustd,
-                  iterations, success);
-
-  // Run measurements across image size, search widths, rotations no
-
-  daisyCleanUp(daisyTemplate,daisyCl);
-  daisyCleanUp(daisyTarget,daisyCl);
+  if(!error && !writeBenchCsv(results, csvOutName))
+    printf("Match speed results appended to %s.\n", csvOutName);
 
+  freeBenchResults(results);
+  free(csvOutName);
+  free(config);
 
 }
 
@@ -261,7 +193,11 @@ void runDaisy(char * filename, short int saveBinary){
 
 void profileSpeed(short int cpuTransfer){
 
-    // initialise loop variables, input range numbers etc..
+    // standard resolution range QVGA..QXGA on the old ramp input, see gdaisy-bench for other configurations
+    bench_config * config = newBenchConfig();
+    config->cpuTransfer = cpuTransfer;
+    config->pattern = SYNTH_RAMP;
+
     struct tm * sysTime = NULL;                     
 
     time_t timeVal = 0;                            
@@ -277,145 +213,21 @@ void profileSpeed(short int cpuTransfer){
 
     sprintf(csvOutName, nameTemplate, sysTime->tm_mon+1, sysTime->tm_mday, sysTime->tm_hour, sysTime->tm_min);
 
-    FILE * csvOut = fopen(csvOutName,"w");
-
-    /* Standard ranges QVGA,VGA,SVGA,XGA,SXGA,SXGA+,UXGA,QXGA*/
-    int heights[8] = {320,640,800,1024,1280,1400,1600,2048};
-    int widths[8] = {240,480,600,768,1024,1050,1200,1536};
-    int total = 8;
-
-    /* Without transfer ranges */
-    //int heights[12] = {128,256,384,512,640,768,896,1024,1152,1280,1408,1536};
-    //int widths[12] = {128,256,384,512,640,768,896,1024,1152,1280,1408,1536};
-    //int total = 12;
-
-    //#define BLOCK_SIZE 128
-    //    int heights[8] = {BLOCK_SIZE,BLOCK_SIZE,BLOCK_SIZE,BLOCK_SIZE,BLOCK_SIZE,BLOCK_SIZE,BLOCK_SIZE,BLOCK_SIZE};
-    //    int widths[8] = {BLOCK_SIZE,BLOCK_SIZE*2,BLOCK_SIZE*3,BLOCK_SIZE*4,BLOCK_SIZE*5,BLOCK_SIZE*6,BLOCK_SIZE*7,BLOCK_SIZE*8};
-    //    int total = 8;    
-
-    /* With transfer ranges */
-    /*int heights[4] = {1152,1280,1408,1536};//{128,256,384,512};//,,1152,1280,1408,1536};
-    int widths[4] = {1152,1280,1408,1536};//,640,768,896,1024,1152,1280,1408,1536};
-    int total = 4;//12;*/
-
-    // allocate the memory
-    unsigned char * array = (unsigned char *)malloc(sizeof(unsigned char) * heights[total-1] * widths[total-1]);
-
-    // generate random value input
-    for(int i = 0; i < heights[total-1]*widths[total-1]; i++)
-      array[i] = i % 255;
-
-    fprintf(csvOut,"height,width,grad,convonly,convmiddlex,convgrad,\
-transA,transB,transBhost,transBtopinned,transBtoram,\
-whole,wholestd,dataTransfer,iterations,success\n");
-
-    const char * templateRow = "%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%d,%d\n";
-
-    int height = 0;
-    int width = 0;
-
-    // initialise daisy and opencl
-    daisy_params * daisy = newDaisyParams("", array, height, width, cpuTransfer);
     ocl_constructs * daisyCl = newOclConstructs(0,0,0);
-    ocl_daisy_kernels * daisyKernels = daisy->oclKernels;
-
-    initOcl(daisy,daisyCl);
-
-    for(int w = 0; w < total; w++){
-
-      int width = widths[w];
-      int height = heights[w];
-
-      printf("%dx%d\n",height,width);
-
-      int iterations = 10;
-      int success = 0;
-      double * wholeTimes = (double*)malloc(sizeof(double) * iterations);
-
-      time_params times;
-
-      double t_grad = 0;
-      double t_conv = 0;
-      double t_convx = 0;
-      double t_convGrad = 0;
-      double t_transA = 0;
-      double t_transB = 0;
-      double t_transBhost = 0;
-      double t_transPinned = 0;
-      double t_transRam = 0;
-      double t_whole = 0;
-
-      times.measureDeviceHostTransfers = daisy->cpuTransfer;
-
-      daisy = newDaisyParams("", array,height,width,daisy->cpuTransfer);
-      daisy->oclKernels = daisyKernels;
-
-      for(int i = 0; i < iterations; i++){
-
-        times.transPinned = 0;
-        times.transRam = 0;
-      
-        success |= oclDaisy(daisy, daisyCl, &times);
-        daisyCleanUp(daisy, daisyCl);
-
-        t_grad += timeDiff(times.startGrad, times.endGrad);
-        t_conv += timeDiff(times.startConv, times.endConv);
-        t_convx += timeDiff(times.startConvX, times.endConvX);
-        t_convGrad += timeDiff(times.startConvGrad, times.endConvGrad);
-        t_transA   += timeDiff(times.startTransGrad, times.endTransGrad);
-        if(times.measureDeviceHostTransfers)
-          t_transBhost += timeDiff(times.startTransDaisy, times.endTransDaisy);
-        else
-          t_transB += timeDiff(times.startTransDaisy, times.endTransDaisy);
-
-        t_transPinned += times.transPinned;
-        t_transRam += times.transRam;
-
-        wholeTimes[i] = timeDiff(times.startFull, times.endFull);
-        t_whole += wholeTimes[i];
-        displayTimes(daisy,&times);
-      }
-
-      t_grad /= iterations;
-      t_conv /= iterations;
-      t_convx /= iterations;
-      t_convGrad    /= iterations;
-      t_transA      /= iterations;
-      t_transBhost  /= iterations;
-      t_transB      /= iterations;
-      t_transPinned /= iterations;
-      t_transRam /= iterations;
-      t_whole       /= iterations;
-
-      double wholeStd = getStd(wholeTimes,iterations);
-
-      /*"height,width,grad,convonly,convmiddlex,convgrad,
-         transA,transB,transBhost,transBtopinned,transBtoram,
-         whole,wholestd,dataTransfer,iterations,success\n"*/
-      fprintf(csvOut, templateRow, height, width, t_grad, t_conv, t_convx, t_convGrad, 
-                  t_transA, t_transB, t_transBhost, t_transPinned, t_transRam, 
-                  t_whole, wholeStd, times.measureDeviceHostTransfers, iterations, success);
-
-    }
-    
-    // print name of output file
-    fclose(csvOut);
-    printf("Speed test results written to %s.\n", csvOutName);
-    free(array);
+    bench_results * results = newBenchResults();
 
-}
+    benchExtraction(config, daisyCl, results);
 
-double getStd(double * observations, int length){
+    finaliseBenchResults(results);
+    displayBenchResults(results);
 
-  double mean = .0f;
-  for(int i = 0; i < length; i++)
-    mean += observations[i];
-  mean /= length;
-  double stdSum = .0f;
-  for(int i = 0; i < length; i++)
-    stdSum += pow(observations[i] - mean,2);
+    // print name of output file
+    if(!writeBenchCsv(results, csvOutName))
+      printf("Speed test results written to %s.\n", csvOutName);
 
-  return sqrt(stdSum / length);
+    freeBenchResults(results);
+    free(csvOutName);
+    free(nameTemplate);
+    free(config);
 
 }
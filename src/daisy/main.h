@@ -12,4 +12,6 @@
 
 //#include "oclDaisy.h"
 #include "oclMatchDaisy.h"
+#include "templateCache.h"
+#include "bench.h"
 
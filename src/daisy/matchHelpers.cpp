@@ -156,6 +156,19 @@ void projectPoint(point p, transform t, point * to){
 
 }
 
+// Distance of targetMatch from where t projects templatePoint, over the target's diagonal
+float projectionError(point templatePoint, int targetMatch, point targetSize, transform t){
+
+  point p;
+  projectPoint(templatePoint, t, &p);
+
+  return sqrt(pow(targetMatch % static_cast<int>(targetSize.x) - p.x,2) + 
+              pow(floor(targetMatch / targetSize.x) - p.y,2)) / sqrt(pow(targetSize.x,2) + pow(targetSize.y,2));
+         //  / sqrt(pow(targetMatch % static_cast<int>(targetSize.x) - templatePoint.x,2)
+         //       + pow(floor(targetMatch / targetSize.x) - templatePoint.y,2));
+
+}
+
 transform * minimise2dProjection(point * templatePoints, int * templateMatches, int * targetMatches, int corrsNo,
                                  point targetSize, point templateSize, float * projectionErrors){
 
@@ -178,12 +191,7 @@ transform * minimise2dProjection(point * templatePoints, int * templateMatches,
       // measure errors
       float errorSum = 0;
       for(int c = 0; c < corrsNo; c++){
-        point p;
-        projectPoint(templatePoints[templateMatches[c]], trans, &p);
-        errors[c] =   sqrt(pow(targetMatches[c] % static_cast<int>(targetSize.x) - p.x,2) + 
-                           pow(floor(targetMatches[c] / targetSize.x) - p.y,2)) / sqrt(pow(targetSize.x,2) + pow(targetSize.y,2));
-                     //  / sqrt(pow(targetMatches[c] % static_cast<int>(targetSize.x) - templatePoints[templateMatches[c]].x,2)
-                     //       + pow(floor(targetMatches[c] / targetSize.x) - templatePoints[templateMatches[c]].y,2));
+        errors[c] = projectionError(templatePoints[templateMatches[c]], targetMatches[c], targetSize, trans);
         errorSum += errors[c];
       }
       
@@ -18,3 +18,5 @@ void projectTargetSeeds(point * seedTemplatePoints, point * seedTargetPoints, in
                         int * matches, int matchesNo, point coarseTargetSize, transform * t);
 
 void projectPoint(point p, transform t, point * to);
+
+float projectionError(point templatePoint, int targetMatch, point targetSize, transform t);
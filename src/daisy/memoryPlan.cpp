@@ -0,0 +1,187 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: memoryPlan.cpp
+
+*/
+
+#include "oclDaisy.h"
+#include "general.h"
+#include <limits.h>
+
+// Preferred pixels per descriptor section when the descriptors go back to RAM,
+// small enough for the transfer of one section to overlap the next one.
+// Maximum width that this TR_BLOCK_SIZE is effective on (assuming at least 
+// TR_SECTION_STEP rows should be allocated per block) is currently 16384
+#define TR_BLOCK_SIZE 512*512
+
+// transposeDaisyPairs needs sections of a multiple of 16 rows
+#define TR_SECTION_STEP 16
+
+int queryDeviceMemory(cl_device_id deviceId, device_memory * device){
+
+  cl_int error = clGetDeviceInfo(deviceId, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong),
+                                 &device->globalMemSize, NULL);
+
+  if(error){
+    fprintf(stderr, "memoryPlan.cpp::queryDeviceMemory clGetDeviceInfo (GLOBAL_MEM_SIZE) failed: %d\n", error);
+    return error;
+  }
+
+  error = clGetDeviceInfo(deviceId, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong),
+                          &device->maxAllocSize, NULL);
+
+  if(error)
+    fprintf(stderr, "memoryPlan.cpp::queryDeviceMemory clGetDeviceInfo (MAX_MEM_ALLOC_SIZE) failed: %d\n", error);
+
+  return error;
+
+}
+
+// A budget of 0 means a share of the whole device, larger budgets are capped to it
+unsigned long int memoryBudget(device_memory * device, unsigned long int budget){
+
+  if(budget == 0 || budget > device->globalMemSize)
+    budget = (unsigned long int)(device->globalMemSize * MEMORY_BUDGET_SHARE);
+
+  return budget;
+
+}
+
+// Picks the section height and the number of section buffers for an image.
+// The stages of oclDaisy peak at
+//   convolutions:        massBuffer + transBuffer
+//   gradient transpose:  massBuffer + transBuffer
+//   daisy transpose:     transBuffer + buffersNo sections
+// The cascade writes the transposed layers itself, its massBuffer only holds the
+// gradients and the input instead of a section for every layer. With halfStorage
+// the gradients and the transposed layers take half the space.
+// The layers span the padded image, the descriptors only the region of interest
+// when there is one, so sections are planned over descriptorHeight rows.
+// Without transfers to RAM the whole image is kept in one section if it fits,
+// it has the fewest launches and the matcher needs it that way. Otherwise the
+// section is TR_BLOCK_SIZE pixels, or less to fit the budget, double buffered
+// when two sections fit. Returns 1 when even the smallest plan does not fit.
+int planDaisyMemory(memory_plan * plan, device_memory * device, unsigned long int budget,
+                    int paddedHeight, int paddedWidth, int descriptorHeight, int descriptorWidth,
+                    int gradientsNo, int smoothingsNo, int descriptorLength, short int cpuTransfer,
+                    short int cascade, short int halfStorage){
+
+  unsigned long int plane = (unsigned long int)paddedWidth * paddedHeight * sizeof(cl_float);
+  unsigned long int rowSize = (unsigned long int)descriptorWidth * descriptorLength * sizeof(cl_float);
+
+  plan->budget = memoryBudget(device, budget);
+  plan->maxAllocSize = device->maxAllocSize;
+
+  unsigned long int storedPlane = (halfStorage ? plane / 2 : plane);
+
+  plan->massSize = (cascade ? storedPlane * gradientsNo + plane : plane * gradientsNo * (smoothingsNo + 1));
+  plan->transSize = storedPlane * gradientsNo * smoothingsNo;
+
+  plan->convFootprint = plan->massSize + plan->transSize;
+  plan->transFootprint = (cascade ? 0 : plan->massSize + plan->transSize);
+
+  plan->fits = (plan->convFootprint <= plan->budget &&
+                plan->massSize <= plan->maxAllocSize &&
+                plan->transSize <= plan->maxAllocSize);
+
+  unsigned long int sectionsBudget = (plan->budget > plan->transSize ? plan->budget - plan->transSize : 0);
+
+  // descriptor offsets are computed in int by the kernels
+  unsigned long int maxRows = INT_MAX / ((unsigned long int)descriptorWidth * descriptorLength);
+  maxRows = min(maxRows, plan->maxAllocSize / rowSize);
+  maxRows = min(maxRows, (unsigned long int)descriptorHeight);
+
+  int rows;
+
+  if(!cpuTransfer && maxRows == (unsigned long int)descriptorHeight && descriptorHeight * rowSize <= sectionsBudget){
+    rows = descriptorHeight;
+    plan->buffersNo = 1;
+  }
+  else{
+
+    rows = min(TR_BLOCK_SIZE / descriptorWidth, descriptorHeight);
+    rows = min((unsigned long int)rows, maxRows);
+
+    plan->buffersNo = (rows < descriptorHeight ? 2 : 1);
+
+    if(rows * rowSize * plan->buffersNo > sectionsBudget)
+      rows = sectionsBudget / (rowSize * plan->buffersNo);
+
+    // rather a single buffer than sections too short to be worth overlapping
+    if(rows < 4 * TR_SECTION_STEP && plan->buffersNo == 2){
+      plan->buffersNo = 1;
+      rows = min(min((unsigned long int)(TR_BLOCK_SIZE / descriptorWidth), maxRows), sectionsBudget / rowSize);
+    }
+
+    // a region of interest can be shorter than a step, it is then a single section
+    if(rows < descriptorHeight)
+      rows -= rows % TR_SECTION_STEP;
+
+    if(rows < TR_SECTION_STEP){
+      rows = TR_SECTION_STEP;
+      plan->fits = 0;
+    }
+
+  }
+
+  plan->sectionHeight = rows;
+  plan->sectionsNo = descriptorHeight / rows + (descriptorHeight % rows > 0);
+  plan->buffersNo = min(plan->buffersNo, plan->sectionsNo);
+  plan->sectionSize = rows * rowSize;
+
+  plan->daisyFootprint = plan->transSize + plan->sectionSize * plan->buffersNo;
+  plan->peakFootprint = max(plan->convFootprint, plan->daisyFootprint);
+
+  if(plan->peakFootprint > plan->budget) plan->fits = 0;
+
+  return !plan->fits;
+
+}
+
+// Checks that every allocation of a stage fits in one buffer and that together
+// they fit the budget, explaining which does not instead of a bare clCreateBuffer error
+int fitsDeviceMemory(device_memory * device, unsigned long int budget, const char * stage,
+                     const char ** names, unsigned long int * sizes, int allocationsNo){
+
+  budget = memoryBudget(device, budget);
+
+  unsigned long int total = 0;
+  int fits = 1;
+
+  for(int i = 0; i < allocationsNo; i++){
+
+    total += sizes[i];
+
+    if(sizes[i] > device->maxAllocSize){
+      fprintf(stderr, "%s: %s needs %.1f MB, over the %.1f MB allocation limit of the device\n",
+              stage, names[i], sizes[i] / 1048576.0, device->maxAllocSize / 1048576.0);
+      fits = 0;
+    }
+
+  }
+
+  if(total > budget){
+    fprintf(stderr, "%s: needs %.1f MB, over the %.1f MB memory budget\n",
+            stage, total / 1048576.0, budget / 1048576.0);
+    fits = 0;
+  }
+
+  return fits;
+
+}
+
+void displayMemoryPlan(memory_plan * plan, int height, int width){
+
+  printf("Memory plan %dx%d: budget %.1f MB (max alloc %.1f MB), peak %.1f MB%s\n",
+         height, width, plan->budget / 1048576.0, plan->maxAllocSize / 1048576.0,
+         plan->peakFootprint / 1048576.0, (plan->fits ? "" : " - DOES NOT FIT"));
+  printf("  conv %.1f MB, transGrad %.1f MB, transDaisy %.1f MB\n",
+         plan->convFootprint / 1048576.0, plan->transFootprint / 1048576.0, plan->daisyFootprint / 1048576.0);
+  printf("  %d section(s) of %d rows (%.1f MB), %d buffer(s)\n",
+         plan->sectionsNo, plan->sectionHeight, plan->sectionSize / 1048576.0, plan->buffersNo);
+
+}
@@ -0,0 +1,55 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: memoryPlan.h
+
+*/
+
+#include <CL/cl.h>
+
+// Share of the global memory used when no budget is given, the rest is left
+// to the driver and to other contexts
+#define MEMORY_BUDGET_SHARE 0.9
+
+#ifndef DEVICE_MEMORY
+#define DEVICE_MEMORY
+typedef struct device_memory_tag{
+  cl_ulong globalMemSize;
+  cl_ulong maxAllocSize;
+} device_memory;
+#endif
+
+// Device memory layout of one oclDaisy call, all sizes in bytes
+#ifndef MEMORY_PLAN
+#define MEMORY_PLAN
+typedef struct memory_plan_tag{
+  unsigned long int budget;
+  unsigned long int maxAllocSize;
+  unsigned long int massSize;      // input, gradients and smoothings
+  unsigned long int transSize;     // gradients transposed to SxHxWxG
+  unsigned long int sectionSize;   // descriptors of one section
+  unsigned long int convFootprint; // peak of each stage
+  unsigned long int transFootprint;
+  unsigned long int daisyFootprint;
+  unsigned long int peakFootprint;
+  int sectionHeight;               // rows of descriptors per section, multiple of 16
+  int sectionsNo;
+  int buffersNo;                   // section buffers, 2 overlaps a section with the previous one
+  short int fits;
+} memory_plan;
+#endif
+
+int queryDeviceMemory(cl_device_id, device_memory *);
+
+unsigned long int memoryBudget(device_memory *, unsigned long int);
+
+int planDaisyMemory(memory_plan *, device_memory *, unsigned long int,
+                    int, int, int, int, int, int, int, short int, short int, short int);
+
+int fitsDeviceMemory(device_memory *, unsigned long int, const char *,
+                     const char **, unsigned long int *, int);
+
+void displayMemoryPlan(memory_plan *, int, int);
@@ -26,18 +26,16 @@ long int verifyTransposeDaisyPairs(daisy_params * daisy, float * transArray, flo
 #define FETCH_RANGE_START 512
 #endif
 
-// Maximum width that this TR_BLOCK_SIZE is effective on (assuming at least 
-// TR_DATA_WIDTH rows should be allocated per block) is currently 16384
-
-// Input 2D array
-#define ARRAY_PADDING 64
-
 // Configuration & special constants for slow kernel
-#define TR_BLOCK_SIZE 512*512
+// (the size of descriptor sections is chosen by planDaisyMemory)
 #define TR_DATA_WIDTH 16
 #define TR_PAIRS_SINGLE_ONLY -999
 #define TR_PAIRS_OFFSET_WIDTH 1000
 
+// Strip width and rows per work group of the cascaded smoothing, as in the kernel
+#define CASCADE_WIDTH 32
+#define CASCADE_HEIGHT 256
+
 daisy_params * newDaisyParams(const char * filename, unsigned char* array, int height, int width,
                               short int cpuTransfer){
 
@@ -54,9 +52,25 @@ daisy_params * newDaisyParams(const char * filename, unsigned char* array, int h
   params->descriptors = NULL;
   params->descriptorLength = DESCRIPTOR_LENGTH;
   params->cpuTransfer = cpuTransfer;
+  for(int i = 0; i < SMOOTHINGS_NO; i++)
+    params->smoothingModes[i] = SMOOTHING_FIR;
+  params->memoryBudget = 0;
+  params->halfStorage = 0;
+  params->imageInput = 1;
+  params->padding = 1;
+  params->roiX = params->roiY = 0;
+  params->roiWidth = params->roiHeight = 0;
+  params->gradients = NULL;
+  params->keepGradients = 0;
+  params->orientDescriptors = 0;
+  params->orientations = NULL;
+  params->matchPointsOnly = 0;
+  params->generation = 0;
+  memset(&params->plan, 0, sizeof(memory_plan));
   params->oclKernels = (ocl_daisy_kernels*) malloc(sizeof(ocl_daisy_kernels));
-  params->oclKernels->kernelsNo = 20;
-  *(params->oclKernels) = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+  *(params->oclKernels) = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+  params->oclKernels->kernelsNo = 25;
+  params->oclKernels->matchSession = NULL;
   params->buffers = (cl_mem*) malloc(sizeof(cl_mem) * 10);
   params->buffersSize = 0;
 
@@ -65,6 +79,9 @@ daisy_params * newDaisyParams(const char * filename, unsigned char* array, int h
 
 void unpadDescriptorArray(daisy_params * daisy){
 
+  // region of interest descriptors are dense already
+  if(daisy->roiWidth) return;
+
   float * array = daisy->descriptors;
   int paddingAdded = daisy->paddedWidth - daisy->width;
   printf("PaddingAdded: %d\n",paddingAdded);
@@ -89,8 +106,7 @@ int daisyCleanUp(daisy_params * daisy, ocl_constructs * daisyCl){
 
   // do clean up
 
-  for(int i = 0, buffersNo = daisy->buffersSize; i < buffersNo; i++, daisy->buffersSize--)
-    clReleaseMemObject(daisy->buffers[i]);
+  daisyReleaseBuffers(daisy);
 
   oclCleanUp(daisy->oclKernels,daisyCl,0);
 
@@ -98,6 +114,43 @@ int daisyCleanUp(daisy_params * daisy, ocl_constructs * daisyCl){
 
 }
 
+// Release only the descriptor buffers so that oclDaisy can run again
+// with the same kernels and queues (e.g. in benchmark loops)
+void daisyReleaseBuffers(daisy_params * daisy){
+
+  for(int i = 0, buffersNo = daisy->buffersSize; i < buffersNo; i++, daisy->buffersSize--)
+    clReleaseMemObject(daisy->buffers[i]);
+
+  if(daisy->orientations != NULL){
+    clReleaseMemObject(daisy->orientations);
+    daisy->orientations = NULL;
+  }
+
+}
+
+// Adds the time since the last checkpoint to the kernel of that name,
+// the queue must have been finished before calling this
+void kernelCheckpoint(time_params * times, const char * kernelName){
+
+  gettimeofday(&times->endKernel,NULL);
+
+  int k;
+  for(k = 0; k < times->kernelsTimed; k++)
+    if(!strcmp(times->kernelNames[k], kernelName)) break;
+
+  if(k == times->kernelsTimed && k < TIMED_KERNELS_MAX){
+    times->kernelNames[k] = kernelName;
+    times->kernelTimes[k] = 0;
+    times->kernelsTimed++;
+  }
+
+  if(k < TIMED_KERNELS_MAX)
+    times->kernelTimes[k] += timeDiff(times->startKernel,times->endKernel);
+
+  times->startKernel = times->endKernel;
+
+}
+
 int oclError(const char * function, const char * functionCall, int error){
 
   if(error){
@@ -112,25 +165,30 @@ int oclError(const char * function, const char * functionCall, int error){
 int oclCleanUp(ocl_daisy_kernels * daisy, ocl_constructs * daisyCl, int error){
 
   // Release kernels
-  if(daisy->denx      != NULL) { clReleaseKernel(daisy->denx); daisy->denx = NULL; }
-  if(daisy->deny      != NULL) { clReleaseKernel(daisy->deny); daisy->deny = NULL; }
-  if(daisy->grad      != NULL) { clReleaseKernel(daisy->grad); daisy->grad = NULL; }
+  if(daisy->denGrad   != NULL) { clReleaseKernel(daisy->denGrad); daisy->denGrad = NULL; }
+  if(daisy->denGradImage != NULL) { clReleaseKernel(daisy->denGradImage); daisy->denGradImage = NULL; }
+  if(daisy->cascade   != NULL) { clReleaseKernel(daisy->cascade); daisy->cascade = NULL; }
   if(daisy->G0x       != NULL) { clReleaseKernel(daisy->G0x); daisy->G0x = NULL; }
   if(daisy->G0y       != NULL) { clReleaseKernel(daisy->G0y); daisy->G0y = NULL; }
   if(daisy->G1x       != NULL) { clReleaseKernel(daisy->G1x); daisy->G1x = NULL; }
   if(daisy->G1y       != NULL) { clReleaseKernel(daisy->G1y); daisy->G1y = NULL; }
   if(daisy->G2x       != NULL) { clReleaseKernel(daisy->G2x); daisy->G2x = NULL; }
   if(daisy->G2y       != NULL) { clReleaseKernel(daisy->G2y); daisy->G2y = NULL; }
+  if(daisy->iirx      != NULL) { clReleaseKernel(daisy->iirx); daisy->iirx = NULL; }
+  if(daisy->iiry      != NULL) { clReleaseKernel(daisy->iiry); daisy->iiry = NULL; }
   if(daisy->trans     != NULL) { clReleaseKernel(daisy->trans); daisy->trans = NULL; }
   if(daisy->transd    != NULL) { clReleaseKernel(daisy->transd); daisy->transd = NULL; }
   if(daisy->transdp   != NULL) { clReleaseKernel(daisy->transdp); daisy->transdp = NULL; }
   if(daisy->transds   != NULL) { clReleaseKernel(daisy->transds); daisy->transds = NULL; }
   if(daisy->fetchd    != NULL) { clReleaseKernel(daisy->fetchd); daisy->fetchd = NULL; }
-  if(daisy->diffCoarse != NULL) { clReleaseKernel(daisy->diffCoarse); daisy->diffCoarse = NULL; }
-  if(daisy->transposeRotations != NULL) { clReleaseKernel(daisy->transposeRotations); daisy->transposeRotations = NULL; }
-  if(daisy->reduceMin != NULL) { clReleaseKernel(daisy->reduceMin); daisy->reduceMin = NULL; }
-  if(daisy->reduceMinAll != NULL) { clReleaseKernel(daisy->reduceMinAll); daisy->reduceMinAll = NULL; }
+  if(daisy->orientd   != NULL) { clReleaseKernel(daisy->orientd); daisy->orientd = NULL; }
+  if(daisy->changedTiles != NULL) { clReleaseKernel(daisy->changedTiles); daisy->changedTiles = NULL; }
+  if(daisy->downGrad  != NULL) { clReleaseKernel(daisy->downGrad); daisy->downGrad = NULL; }
+  if(daisy->diffCoarseBatched != NULL) { clReleaseKernel(daisy->diffCoarseBatched); daisy->diffCoarseBatched = NULL; }
+  if(daisy->reduceMinPlanes != NULL) { clReleaseKernel(daisy->reduceMinPlanes); daisy->reduceMinPlanes = NULL; }
   if(daisy->diffMiddle != NULL) { clReleaseKernel(daisy->diffMiddle); daisy->diffMiddle = NULL; }
+  if(daisy->reduceMiddle != NULL) { clReleaseKernel(daisy->reduceMiddle); daisy->reduceMiddle = NULL; }
+  if(daisy->diffFine != NULL) { clReleaseKernel(daisy->diffFine); daisy->diffFine = NULL; }
 
   // Release command queues
   if(daisyCl->ioqueue != NULL) { clReleaseCommandQueue(daisyCl->ioqueue); daisyCl->ioqueue = NULL; }
@@ -172,8 +230,9 @@ int initOcl(daisy_params * daisy, ocl_constructs * daisyCl){
   // Pass preprocessor build options
 //  const char options[128] = "-cl-mad-enable -cl-fast-relaxed-math -DFSC=14";    
   char * options = (char*) malloc(sizeof(char) * 500);
-  sprintf(options, "-cl-mad-enable -cl-fast-relaxed-math -DDM_WGX=%d -DDM_WG_TARGETS_NO=%d -DDM_TARGETS_PER_LOOP=%d -DDM_SEARCH_WIDTH=%d -DDM_ROTATIONS_NO=%d", 
-                     DM_WGX, DM_WG_TARGETS_NO, DM_TARGETS_PER_LOOP, DM_SEARCH_WIDTH, DM_ROTATIONS_NO);
+  sprintf(options, "-cl-mad-enable -cl-fast-relaxed-math -DDM_WGX=%d -DDM_WG_TARGETS_NO=%d -DDM_TARGETS_PER_LOOP=%d -DDM_SEARCH_WIDTH=%d -DDM_ROTATIONS_NO=%d -DCOARSE_CANDIDATES_NO=%d -DCOARSE_SUPPRESS_RADIUS=%d -DDF_SEARCH_WIDTH=%d", 
+                     DM_WGX, DM_WG_TARGETS_NO, DM_TARGETS_PER_LOOP, DM_SEARCH_WIDTH, DM_ROTATIONS_NO, COARSE_CANDIDATES_NO,
+                     COARSE_SUPPRESS_RADIUS, DF_SEARCH_WIDTH);
 
   // Build denoising filter
   error = buildCachedProgram(daisyCl, "daisyKernels.cl", options);
@@ -184,15 +243,16 @@ int initOcl(daisy_params * daisy, ocl_constructs * daisyCl){
     return oclCleanUp(daisy->oclKernels,daisyCl,1);
   }
 
-  // Prepare the kernel
-  daisy->oclKernels->denx = clCreateKernel(daisyCl->program, "convolve_denx", &error);
-  daisy->oclKernels->deny = clCreateKernel(daisyCl->program, "convolve_deny", &error);
-  if(oclError("initOcl","clCreateKernel (den)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  // Prepare the denoising and gradient kernel
+  daisy->oclKernels->denGrad = clCreateKernel(daisyCl->program, "denoiseGradients", &error);
+  if(oclError("initOcl","clCreateKernel (denGrad)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  // Build gradient kernel
-  daisy->oclKernels->grad = clCreateKernel(daisyCl->program, "gradients", &error);
-  if(oclError("initOcl","clCreateKernel (grad)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  daisy->oclKernels->denGradImage = clCreateKernel(daisyCl->program, "denoiseGradientsImage", &error);
+  if(oclError("initOcl","clCreateKernel (denGradImage)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
   
+  daisy->oclKernels->cascade = clCreateKernel(daisyCl->program, "convolveCascade", &error);
+  if(oclError("initOcl","clCreateKernel (cascade)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
   daisy->oclKernels->G0x = clCreateKernel(daisyCl->program, "convolve_G0x", &error);
   daisy->oclKernels->G0y = clCreateKernel(daisyCl->program, "convolve_G0y", &error);
   if(oclError("initOcl","clCreateKernel (G0)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
@@ -205,6 +265,10 @@ int initOcl(daisy_params * daisy, ocl_constructs * daisyCl){
   daisy->oclKernels->G2y = clCreateKernel(daisyCl->program, "convolve_G2y", &error);
   if(oclError("initOcl","clCreateKernel(G2)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
+  daisy->oclKernels->iirx = clCreateKernel(daisyCl->program, "convolve_iirx", &error);
+  daisy->oclKernels->iiry = clCreateKernel(daisyCl->program, "convolve_iiry", &error);
+  if(oclError("initOcl","clCreateKernel (iir)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
   daisy->oclKernels->trans = clCreateKernel(daisyCl->program, "transposeGradients", &error);
   if(oclError("initOcl","clCreateKernel (trans)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
@@ -218,6 +282,15 @@ int initOcl(daisy_params * daisy, ocl_constructs * daisyCl){
   daisy->oclKernels->fetchd = clCreateKernel(daisyCl->program, "fetchDaisy", &error);
   if(oclError("initOcl","clCreateKernel (fetchd)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
+  daisy->oclKernels->orientd = clCreateKernel(daisyCl->program, "orientDescriptors", &error);
+  if(oclError("initOcl","clCreateKernel (orientd)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  daisy->oclKernels->changedTiles = clCreateKernel(daisyCl->program, "changedTiles", &error);
+  if(oclError("initOcl","clCreateKernel (changedTiles)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  daisy->oclKernels->downGrad = clCreateKernel(daisyCl->program, "downsampleGradients", &error);
+  if(oclError("initOcl","clCreateKernel (downGrad)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
   return error;
 }
 
@@ -237,8 +310,10 @@ char * writeInfofile(daisy_params * daisy, char * binaryfile){
   sprintf(infofile,strcat(binaryfile,".info"));
     
   FILE * ff = fopen(infofile,"w");
-  fprintf(ff,"Width = %d\n",daisy->width);
-  fprintf(ff,"Height = %d\n",daisy->height);
+  fprintf(ff,"Width = %d\n",(daisy->roiWidth ? daisy->roiWidth : daisy->width));
+  fprintf(ff,"Height = %d\n",(daisy->roiWidth ? daisy->roiHeight : daisy->height));
+  if(daisy->roiWidth)
+    fprintf(ff,"Offset (X,Y) = %d,%d\n",daisy->roiX,daisy->roiY);
   fprintf(ff,"Descriptor Length = %d\n",daisy->descriptorLength);
   fprintf(ff,"Datatype = %s\n","float");
   fprintf(ff,"Datastart = %d\n",4);
@@ -256,7 +331,9 @@ void saveToBinary(daisy_params * daisy){
 
   unpadDescriptorArray(daisy);
 
-  kutility::save_binary(binaryfile, daisy->descriptors, daisy->height * daisy->width, daisy->descriptorLength, 1, kutility::TYPE_FLOAT);
+  int descriptorsNo = (daisy->roiWidth ? daisy->roiHeight * daisy->roiWidth : daisy->height * daisy->width);
+
+  kutility::save_binary(binaryfile, daisy->descriptors, descriptorsNo, daisy->descriptorLength, 1, kutility::TYPE_FLOAT);
 
   char * infoFilename = writeInfofile(daisy,binaryfile);
 
@@ -264,12 +341,350 @@ void saveToBinary(daisy_params * daisy){
 
 }
 
+// Recursive Gaussian coefficients of Young & van Vliet (1995) for sigma >= 0.5,
+// stored as {B, b1/b0, b2/b0, b3/b0} for the convolve_iirx/convolve_iiry kernels
+void iirGaussianCoefficients(float sigma, cl_float4 * coefficients){
+
+  double q = (sigma >= 2.5 ? 0.98711 * sigma - 0.96330 :
+                             3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma));
+
+  double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+  double b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+  double b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+  double b3 = 0.422205 * q * q * q;
+
+  coefficients->s[0] = 1 - (b1 + b2 + b3) / b0;
+  coefficients->s[1] = b1 / b0;
+  coefficients->s[2] = b2 / b0;
+  coefficients->s[3] = b3 / b0;
+
+}
+
+// Smooths the gradient planes of one layer with the recursive Gaussian, from massBuffer
+// section srcSection through tmpSection to dstSection like the FIR kernels of that layer
+int convolveIIR(daisy_params * daisy, ocl_constructs * daisyCl, cl_mem massBuffer,
+                int layer, float sigma, int srcSection, int tmpSection, int dstSection,
+                time_params * times){
+
+  const char * kernelNames[SMOOTHINGS_NO][2] = {{"convolve_G0x_iir", "convolve_G0y_iir"},
+                                                {"convolve_G1x_iir", "convolve_G1y_iir"},
+                                                {"convolve_G2x_iir", "convolve_G2y_iir"}};
+
+  cl_int error;
+
+  cl_float4 coefficients;
+  iirGaussianCoefficients(sigma, &coefficients);
+
+  int sectionSize = daisy->paddedWidth * daisy->paddedHeight * daisy->gradientsNo;
+  int srcOffset = srcSection * sectionSize;
+  int tmpOffset = tmpSection * sectionSize;
+  int dstOffset = dstSection * sectionSize;
+
+  // convolve X - a row per work item
+  size_t iirWorkerSizeX = daisy->paddedHeight * daisy->gradientsNo;
+  size_t iirGroupSizeX = 64;
+
+  clSetKernelArg(daisy->oclKernels->iirx, 0, sizeof(massBuffer), (void*)&massBuffer);
+  clSetKernelArg(daisy->oclKernels->iirx, 1, sizeof(cl_float4), (void*)&coefficients);
+  clSetKernelArg(daisy->oclKernels->iirx, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+  clSetKernelArg(daisy->oclKernels->iirx, 3, sizeof(int), (void*)&srcOffset);
+  clSetKernelArg(daisy->oclKernels->iirx, 4, sizeof(int), (void*)&tmpOffset);
+
+  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->iirx, 1, NULL,
+                                 &iirWorkerSizeX, &iirGroupSizeX, 0,
+                                 NULL, NULL);
+
+  if(oclError("convolveIIR","clEnqueueNDRangeKernel (iirx)",error)) return error;
+
+  clFinish(daisyCl->ioqueue);
+
+  kernelCheckpoint(times,kernelNames[layer][0]);
+
+  // convolve Y - a column per work item
+  size_t iirWorkerSizeY[2] = {daisy->paddedWidth, daisy->gradientsNo};
+  size_t iirGroupSizeY[2] = {64,1};
+
+  clSetKernelArg(daisy->oclKernels->iiry, 0, sizeof(massBuffer), (void*)&massBuffer);
+  clSetKernelArg(daisy->oclKernels->iiry, 1, sizeof(cl_float4), (void*)&coefficients);
+  clSetKernelArg(daisy->oclKernels->iiry, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+  clSetKernelArg(daisy->oclKernels->iiry, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+  clSetKernelArg(daisy->oclKernels->iiry, 4, sizeof(int), (void*)&tmpOffset);
+  clSetKernelArg(daisy->oclKernels->iiry, 5, sizeof(int), (void*)&dstOffset);
+
+  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->iiry, 2, NULL,
+                                 iirWorkerSizeY, iirGroupSizeY, 0,
+                                 NULL, NULL);
+
+  if(oclError("convolveIIR","clEnqueueNDRangeKernel (iiry)",error)) return error;
+
+  clFinish(daisyCl->ioqueue);
+
+  kernelCheckpoint(times,kernelNames[layer][1]);
+
+  return CL_SUCCESS;
+
+}
+
+// Smooths the gradients of massBuffer section A layer by layer with the G0, G1 and
+// G2 kernel pairs or the recursive Gaussian, each as selected by smoothingModes
+int convolveLayers(daisy_params * daisy, ocl_constructs * daisyCl, cl_mem massBuffer, cl_mem filterBuffer,
+                   float * smoothingSigmas, time_params * times){
+
+  cl_int error;
+
+  // Smooth all to 2.5 - keep at massBuffer section A
+
+  if(daisy->smoothingModes[0] == SMOOTHING_IIR){
+
+    // recursive Gaussian - massBuffer sections: A to B to A
+    error = convolveIIR(daisy, daisyCl, massBuffer, 0, smoothingSigmas[0], 0, 1, 0, times);
+
+    if(oclError("convolveLayers","convolveIIR (G0)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  }
+  else{
+
+    // convolve X - massBuffer sections: A to B
+    size_t convWorkerSizeG0x[2] = {daisy->paddedWidth / 4, daisy->paddedHeight * daisy->gradientsNo};
+    size_t convGroupSizeG0x[2] = {16,4};
+
+    clSetKernelArg(daisy->oclKernels->G0x, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->G0x, 1, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->G0x, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->G0x, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G0x, 2, NULL,
+                                   convWorkerSizeG0x, convGroupSizeG0x, 0,
+                                   NULL, NULL);
+
+    if(oclError("convolveLayers","clEnqueueNDRangeKernel (G0x)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    clFinish(daisyCl->ioqueue);
+
+    kernelCheckpoint(times,"convolve_G0x");
+
+    // convolve Y - massBuffer sections: B to A
+    size_t convWorkerSizeG0y[2] = {daisy->paddedWidth, (daisy->paddedHeight * daisy->gradientsNo) / 8};
+    size_t convGroupSizeG0y[2] = {16,8};
+
+    clSetKernelArg(daisy->oclKernels->G0y, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->G0y, 1, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->G0y, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->G0y, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G0y, 2, NULL,
+                                   convWorkerSizeG0y, convGroupSizeG0y, 0,
+                                   NULL, NULL);
+
+    if(oclError("convolveLayers","clEnqueueNDRangeKernel (G0y)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    clFinish(daisyCl->ioqueue);
+
+    kernelCheckpoint(times,"convolve_G0y");
+
+  }
+
+  // smooth all with size 23 - keep
+
+  gettimeofday(&times->startConvX,NULL);
+
+  if(daisy->smoothingModes[1] == SMOOTHING_IIR){
+
+    // recursive Gaussian - massBuffer sections: A to C to B
+    error = convolveIIR(daisy, daisyCl, massBuffer, 1, smoothingSigmas[1], 0, 2, 1, times);
+
+    if(oclError("convolveLayers","convolveIIR (G1)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    gettimeofday(&times->endConvX,NULL);
+
+  }
+  else{
+
+    // convolve X - massBuffer sections: A to C
+    size_t convWorkerSizeG1x[2] = {daisy->paddedWidth / 4, daisy->paddedHeight * daisy->gradientsNo};
+    size_t convGroupSizeG1x[2] = {16,4};
+
+    clSetKernelArg(daisy->oclKernels->G1x, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->G1x, 1, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->G1x, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->G1x, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G1x, 2, NULL,
+                                   convWorkerSizeG1x, convGroupSizeG1x, 0,
+                                   NULL, NULL);
+
+    if(oclError("convolveLayers","clEnqueueNDRangeKernel (G1x)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    clFinish(daisyCl->ioqueue);
+
+    kernelCheckpoint(times,"convolve_G1x");
+
+    gettimeofday(&times->endConvX,NULL);
+
+    // convolve Y - massBuffer sections: C to B
+    size_t convWorkerSizeG1y[2] = {daisy->paddedWidth, (daisy->paddedHeight * daisy->gradientsNo) / 4};
+    size_t convGroupSizeG1y[2]  = {16, 16};
+
+    clSetKernelArg(daisy->oclKernels->G1y, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->G1y, 1, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->G1y, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->G1y, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G1y, 2,
+                                   NULL, convWorkerSizeG1y, convGroupSizeG1y,
+                                   0, NULL, NULL);
+
+    if(oclError("convolveLayers","clEnqueueNDRangeKernel (G1y)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    clFinish(daisyCl->ioqueue);
+
+    kernelCheckpoint(times,"convolve_G1y");
+
+  }
+
+  // smooth all with size 29 - keep
+  
+  if(daisy->smoothingModes[2] == SMOOTHING_IIR){
+
+    // recursive Gaussian - massBuffer sections: B to D to C
+    error = convolveIIR(daisy, daisyCl, massBuffer, 2, smoothingSigmas[2], 1, 3, 2, times);
+
+    if(oclError("convolveLayers","convolveIIR (G2)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  }
+  else{
+
+    // convolve X - massBuffer sections: B to D
+    size_t convWorkerSizeG2x[2] = {daisy->paddedWidth / 4, (daisy->paddedHeight * daisy->gradientsNo)};
+    size_t convGroupSizeG2x[2]  = {16, 4};
+
+    clSetKernelArg(daisy->oclKernels->G2x, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->G2x, 1, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->G2x, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->G2x, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G2x, 2,
+                                   NULL, convWorkerSizeG2x, convGroupSizeG2x,
+                                   0, NULL, NULL);
+
+    if(oclError("convolveLayers","clEnqueueNDRangeKernel (G2x)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    clFinish(daisyCl->ioqueue);
+
+    kernelCheckpoint(times,"convolve_G2x");
+
+    // convolve Y - massBuffer sections: D to C
+    size_t convWorkerSizeG2y[2] = {daisy->paddedWidth, (daisy->paddedHeight * daisy->gradientsNo) / 4};
+    size_t convGroupSizeG2y[2]  = {16, 16};
+
+    clSetKernelArg(daisy->oclKernels->G2y, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->G2y, 1, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->G2y, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->G2y, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G2y, 2,
+                                   NULL, convWorkerSizeG2y, convGroupSizeG2y,
+                                   0, NULL, NULL);
+
+    if(oclError("convolveLayers","clEnqueueNDRangeKernel (G2y)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    clFinish(daisyCl->ioqueue);
+
+    kernelCheckpoint(times,"convolve_G2y");
+
+  }
+
+  return CL_SUCCESS;
+
+}
+
+// Whether the device can read the input as an 8 bit single channel image of this size
+short int inputImageSupported(ocl_constructs * daisyCl, int height, int width){
+
+  cl_bool imageSupport = CL_FALSE;
+  size_t maxWidth = 0;
+  size_t maxHeight = 0;
+
+  clGetDeviceInfo(daisyCl->deviceId, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &imageSupport, NULL);
+
+  if(!imageSupport) return 0;
+
+  clGetDeviceInfo(daisyCl->deviceId, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t), &maxWidth, NULL);
+  clGetDeviceInfo(daisyCl->deviceId, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t), &maxHeight, NULL);
+
+  if((size_t)width > maxWidth || (size_t)height > maxHeight) return 0;
+
+  cl_uint formatsNo = 0;
+
+  if(clGetSupportedImageFormats(daisyCl->context, CL_MEM_READ_ONLY, CL_MEM_OBJECT_IMAGE2D,
+                                0, NULL, &formatsNo) != CL_SUCCESS) return 0;
+
+  cl_image_format * formats = (cl_image_format*)malloc(sizeof(cl_image_format) * formatsNo);
+
+  clGetSupportedImageFormats(daisyCl->context, CL_MEM_READ_ONLY, CL_MEM_OBJECT_IMAGE2D,
+                             formatsNo, formats, NULL);
+
+  short int supported = 0;
+
+  for(cl_uint i = 0; i < formatsNo; i++)
+    supported = supported || (formats[i].image_channel_order == CL_R &&
+                              formats[i].image_channel_data_type == CL_UNSIGNED_INT8);
+
+  free(formats);
+
+  return supported;
+
+}
+
 int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times){
 
   cl_int error;
 
-  daisy->paddedWidth = daisy->width + (ARRAY_PADDING - daisy->width % ARRAY_PADDING) % ARRAY_PADDING;
-  daisy->paddedHeight = daisy->height + (ARRAY_PADDING - daisy->height % ARRAY_PADDING) % ARRAY_PADDING;
+  // with every layer FIR the cascade smooths all layers in one pass and writes them
+  // transposed, otherwise the layers are smoothed one by one in massBuffer sections
+  short int cascade = 1;
+  for(int i = 0; i < daisy->smoothingsNo; i++)
+    cascade = cascade && (daisy->smoothingModes[i] == SMOOTHING_FIR);
+
+  // the cascade kernels check their bounds and work on the image as it is, unless
+  // the caller asks for padding; the tiles of the per-layer kernels need ARRAY_PADDING
+  int padding = (cascade ? max(daisy->padding, 1) : max(daisy->padding, ARRAY_PADDING));
+
+  // match sessions gather the template rings again when this changes
+  daisy->generation++;
+
+  // with a region of interest only it and its halo are smoothed, the layers then
+  // span the crop and the descriptors the region, placed at roiPlaneX/Y in the crop
+  short int roi = (daisy->roiWidth > 0 && daisy->roiHeight > 0);
+
+  if(roi && (daisy->roiX < 0 || daisy->roiY < 0 ||
+             daisy->roiX + daisy->roiWidth > daisy->width || daisy->roiY + daisy->roiHeight > daisy->height)){
+    fprintf(stderr, "oclDaisy.cpp::oclDaisy region %dx%d at (%d,%d) is outside the %dx%d image\n",
+                    daisy->roiHeight, daisy->roiWidth, daisy->roiY, daisy->roiX, daisy->height, daisy->width);
+    return CL_INVALID_VALUE;
+  }
+
+  int cropX = (roi ? max(0, daisy->roiX - ROI_HALO) : 0);
+  int cropY = (roi ? max(0, daisy->roiY - ROI_HALO) : 0);
+  int cropWidth  = (roi ? min(daisy->width, daisy->roiX + daisy->roiWidth + ROI_HALO) - cropX : daisy->width);
+  int cropHeight = (roi ? min(daisy->height, daisy->roiY + daisy->roiHeight + ROI_HALO) - cropY : daisy->height);
+
+  daisy->paddedWidth = roundUp(cropWidth, padding);
+  daisy->paddedHeight = roundUp(cropHeight, padding);
+
+  int roiPlaneX = (roi ? daisy->roiX - cropX : 0);
+  int roiPlaneY = (roi ? daisy->roiY - cropY : 0);
+  int descriptorsWidth  = (roi ? daisy->roiWidth : daisy->paddedWidth);
+  int descriptorsHeight = (roi ? daisy->roiHeight : daisy->paddedHeight);
+
+  // gradient planes handed over by the caller (an octave of a pyramid) replace the
+  // input, they are laid out as the cascade's massBuffer section A for this size
+  short int givenGradients = (daisy->gradients != NULL);
+
+  if(givenGradients && (!cascade || roi)){
+    fprintf(stderr, "oclDaisy.cpp::oclDaisy takes given gradients with all FIR layers and no region only\n");
+    return CL_INVALID_VALUE;
+  }
 
   float * inputArray = (float*)malloc(sizeof(float) * daisy->paddedWidth * daisy->paddedHeight * 8);
 
@@ -312,16 +727,36 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
   // Preparation for daisy transposition parameters and enqueue the time-consuming memory mapping
   //
 
-  int daisyBlockWidth = daisy->paddedWidth;
-  int daisyBlockHeight = min(TR_BLOCK_SIZE, daisy->paddedWidth * daisy->paddedHeight) / daisyBlockWidth;
-  //printf("DaisyBlockHeight = %d\n",daisyBlockHeight);
+  device_memory device;
 
-  int totalSections = daisy->paddedHeight / daisyBlockHeight;
+  error = queryDeviceMemory(daisyCl->deviceId, &device);
+  if(oclError("oclDaisy","queryDeviceMemory",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  // only the cascade's planes can be stored as half, the per-layer kernels stay in float
+  int halfStorage = (cascade && daisy->halfStorage);
+
+  if(planDaisyMemory(&daisy->plan, &device, daisy->memoryBudget,
+                     daisy->paddedHeight, daisy->paddedWidth, descriptorsHeight, descriptorsWidth,
+                     daisy->gradientsNo, daisy->smoothingsNo, daisy->descriptorLength, daisy->cpuTransfer,
+                     cascade, halfStorage)){
+
+    displayMemoryPlan(&daisy->plan, daisy->height, daisy->width);
+    fprintf(stderr, "oclDaisy.cpp::oclDaisy %dx%d does not fit in the device memory budget\n",
+                    daisy->height, daisy->width);
+    return oclCleanUp(daisy->oclKernels,daisyCl,CL_MEM_OBJECT_ALLOCATION_FAILURE);
+
+  }
+
+  if(times->displayRuntimes)
+    displayMemoryPlan(&daisy->plan, daisy->height, daisy->width);
+
+  int daisyBlockWidth = descriptorsWidth;
+  int daisyBlockHeight = daisy->plan.sectionHeight;
 
   // the height of the final block is taken care of just before the computation later on
-  if(totalSections * daisyBlockHeight < daisy->paddedHeight) totalSections++;
+  int totalSections = daisy->plan.sectionsNo;
 
-  unsigned long int daisySectionSize = daisyBlockWidth * daisyBlockHeight * daisy->descriptorLength * sizeof(float);
+  unsigned long int daisySectionSize = daisy->plan.sectionSize;
 
   //
   // End of parameter preparation
@@ -353,7 +788,7 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
     }
     else{
     
-      unsigned long int daisyDescriptorSize = daisy->paddedWidth * daisy->paddedHeight * 
+      unsigned long int daisyDescriptorSize = (unsigned long int)descriptorsWidth * descriptorsHeight * 
                         daisy->descriptorLength * sizeof(float);
 
       if(daisy->descriptors == NULL){
@@ -379,38 +814,49 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
   int paddedWidth  = daisy->paddedWidth;
   int paddedHeight = daisy->paddedHeight;
 
-  long int memorySize = daisy->gradientsNo * (daisy->smoothingsNo+1) * 
-                        paddedWidth * paddedHeight * sizeof(cl_float);
+  long int memorySize = daisy->plan.massSize;
+
+  cl_mem massBuffer = daisy->gradients;
+
+  if(!givenGradients){
 
-  cl_mem massBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
-                                     memorySize, (void*)NULL, &error);
+    massBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                memorySize, (void*)NULL, &error);
 
-  if(oclError("oclDaisy","clCreateBuffer (mass)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+    if(oclError("oclDaisy","clCreateBuffer (mass)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  }
 
   //printf("massBuffer size = %ld (%ldMB)\n", memorySize, memorySize / (1024 * 1024));
   //printf("paddedWidth = %d, paddedHeight = %d\n", paddedWidth, paddedHeight);
 
+  // sigmas of the layer smoothings, each applied on top of the previous layer
+  float smoothingSigmas[SMOOTHINGS_NO] = {sqrt(SIGMA_A * SIGMA_A - SIGMA_DEN * SIGMA_DEN),
+                                          sqrt(SIGMA_B * SIGMA_B - SIGMA_A * SIGMA_A),
+                                          sqrt(SIGMA_C * SIGMA_C - SIGMA_B * SIGMA_B)};
+
   int filterDenSize = 5;
   float * filterDen = (float*)malloc(sizeof(float)*filterDenSize);
   kutility::gaussian_1d(filterDen,filterDenSize,SIGMA_DEN,0);
 
   int filterG0Size = 11;
   float * filterG0 = (float*)malloc(sizeof(float)*filterG0Size);
-  kutility::gaussian_1d(filterG0,filterG0Size,sqrt(SIGMA_A * SIGMA_A - SIGMA_DEN * SIGMA_DEN),0);
+  kutility::gaussian_1d(filterG0,filterG0Size,smoothingSigmas[0],0);
 
   int filterG1Size = 23;
   float * filterG1 = (float*)malloc(sizeof(float)*filterG1Size);
-  kutility::gaussian_1d(filterG1,filterG1Size,sqrt(SIGMA_B * SIGMA_B - SIGMA_A * SIGMA_A),0);
+  kutility::gaussian_1d(filterG1,filterG1Size,smoothingSigmas[1],0);
 
-  int filterG2Size = 29;
+  // the G2 kernels reach 13 pixels either side of the centre
+  int filterG2Size = 27;
   float * filterG2 = (float*)malloc(sizeof(float)*filterG2Size);
-  kutility::gaussian_1d(filterG2,filterG2Size,sqrt(SIGMA_C * SIGMA_C - SIGMA_B * SIGMA_B),0);
+  kutility::gaussian_1d(filterG2,filterG2Size,smoothingSigmas[2],0);
 
-  const int filterOffsets[4] = {0, filterDenSize, filterDenSize + filterG0Size,
-                                   filterDenSize + filterG0Size + filterG1Size};
+  // the kernels expect the G0 filter 7 floats in
+  const int filterOffsets[4] = {0, 7, 7 + filterG0Size, 7 + filterG0Size + filterG1Size};
 
   cl_mem filterBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_ONLY,
-                                       (filterDenSize + filterG0Size + filterG1Size + filterG2Size) * sizeof(float),
+                                       (filterOffsets[3] + filterG2Size) * sizeof(float),
                                        (void*)NULL, &error);
 
   clEnqueueWriteBuffer(daisyCl->ioqueue, filterBuffer, CL_FALSE,
@@ -428,234 +874,182 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
 
   if(oclError("oclDaisy","clEnqueueWriteBuffer (filters)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-//FIX: put pad in another function
-  // Pad edges of input array for i) to fit the workgroup size ii) convolution halo - resample nearest pixel
-  int i;
-  for(i = 0; i < daisy->height; i++){
-    int j;
-    for(j = 0; j < daisy->width; j++)
-      inputArray[i * paddedWidth + j] = daisy->array[i * daisy->width + j];
-    for(j = daisy->width; j < paddedWidth; j++)
-      inputArray[i * paddedWidth + j] = daisy->array[i * daisy->width + daisy->width-1];
-  }
-  for(i = daisy->height; i < paddedHeight; i++){
-    int j;
-    for(j = 0; j < paddedWidth; j++)
-      inputArray[i * paddedWidth + j] = daisy->array[(daisy->height-1) * daisy->width + j];
-  }
+  // the gradients always go to section A; the cascade only needs the input right after
+  // them (half a section on with half planes), otherwise it waits in section D, which
+  // is not needed again before G2
+  int sectionSize = daisy->gradientsNo * paddedWidth * paddedHeight;
+  int inputOffset = (cascade ? (halfStorage ? sectionSize / 2 : sectionSize) : 3 * sectionSize);
+  int gradientsOffset = 0;
 
-  error = clEnqueueWriteBuffer(daisyCl->ioqueue, massBuffer, CL_TRUE,
-                               0, paddedWidth * paddedHeight * sizeof(float),
-                               (void*)inputArray,
-                               0, NULL, NULL);
+  // an image takes the 8 bit input as it is, the sampler replicates its borders;
+  // otherwise it is padded on the host and written to massBuffer as floats
+  short int imageInput = (!givenGradients && daisy->imageInput && inputImageSupported(daisyCl, daisy->height, daisy->width));
 
-  if(oclError("oclDaisy","clEnqueueWriteBuffer (inputArray)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  cl_mem inputImage = NULL;
 
-  gettimeofday(&times->startConvGrad,NULL);
+  if(imageInput){
 
-  // smooth with kernel size 7 (achieve sigma 1.6 from 0.5)
-  size_t convWorkerSizeDenx[2] = {daisy->paddedWidth / 4, daisy->paddedHeight};
-  size_t convGroupSizeDenx[2] = {16,8};
+    cl_image_format inputFormat = {CL_R, CL_UNSIGNED_INT8};
 
-  // convolve X - A.0 to A.1
-  clSetKernelArg(daisy->oclKernels->denx, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->denx, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->denx, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->denx, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+    inputImage = clCreateImage2D(daisyCl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &inputFormat,
+                                 cropWidth, cropHeight, daisy->width * sizeof(unsigned char),
+                                 (void*)(daisy->array + cropY * daisy->width + cropX), &error);
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->denx, 2, NULL, 
-                                 convWorkerSizeDenx, convGroupSizeDenx, 0, 
-                                 NULL, NULL);
-
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (denx)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
-
-  error = clFinish(daisyCl->ioqueue);
+    if(oclError("oclDaisy","clCreateImage2D (input)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  // convolve Y - A.1 to B.0
-  size_t convWorkerSizeDeny[2] = {daisy->paddedWidth,daisy->paddedHeight / 4};
-  size_t convGroupSizeDeny[2] = {16,8};
+  }
+  else if(!givenGradients){
 
-  clSetKernelArg(daisy->oclKernels->deny, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->deny, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->deny, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->deny, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+//FIX: put pad in another function
+    // Pad edges of input array for i) to fit the workgroup size ii) convolution halo - resample nearest pixel
+    int i;
+    for(i = 0; i < paddedHeight; i++){
+      unsigned char * row = daisy->array + (cropY + min(i, cropHeight-1)) * daisy->width + cropX;
+      int j;
+      for(j = 0; j < cropWidth; j++)
+        inputArray[i * paddedWidth + j] = row[j];
+      for(j = cropWidth; j < paddedWidth; j++)
+        inputArray[i * paddedWidth + j] = row[cropWidth-1];
+    }
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->deny, 2, 
-                                 NULL, convWorkerSizeDeny, convGroupSizeDeny, 
+    error = clEnqueueWriteBuffer(daisyCl->ioqueue, massBuffer, CL_TRUE,
+                                 inputOffset * sizeof(float), paddedWidth * paddedHeight * sizeof(float),
+                                 (void*)inputArray,
                                  0, NULL, NULL);
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (deny)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
-
-  error = clFinish(daisyCl->ioqueue);
-
-  // Gradients
-  size_t gradWorkerSize = daisy->paddedWidth * daisy->paddedHeight;
-  size_t gradGroupSize = 64;
-
-  gettimeofday(&times->startGrad,NULL);
+    if(oclError("oclDaisy","clEnqueueWriteBuffer (inputArray)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  // gradient X,Y,all - B.0 to A.0-7
-  clSetKernelArg(daisy->oclKernels->grad, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->grad, 1, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->grad, 2, sizeof(int), (void*)&(daisy->paddedHeight));
-
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->grad, 1, NULL, 
-                                 &gradWorkerSize, &gradGroupSize, 0, 
-                                 NULL, NULL);
+  }
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (grad)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  gettimeofday(&times->startConvGrad,NULL);
 
-  clFinish(daisyCl->ioqueue);
+  times->kernelsTimed = 0;
+  times->startKernel = times->startConvGrad;
 
-  gettimeofday(&times->endGrad,NULL);
-    
-  // Smooth all to 2.5 - keep at massBuffer section A
-  
-  gettimeofday(&times->startConv,NULL);
+  gettimeofday(&times->startGrad,NULL);
 
-  // convolve X - massBuffer sections: A to B
-  size_t convWorkerSizeG0x[2] = {daisy->paddedWidth / 4, daisy->paddedHeight * daisy->gradientsNo};
-  size_t convGroupSizeG0x[2] = {16,4};
+  // denoise (sigma 0.5) and gradient X,Y,all in one pass - input image, B.0 or D.0 to A.0-7
+  size_t denGradWorkerSize[2] = {roundUp(daisy->paddedWidth, 16), roundUp(daisy->paddedHeight, 16)};
+  size_t denGradGroupSize[2] = {16,16};
 
-  clSetKernelArg(daisy->oclKernels->G0x, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->G0x, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->G0x, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->G0x, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+  if(imageInput){
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G0x, 2, NULL, 
-                                 convWorkerSizeG0x, convGroupSizeG0x, 0, 
-                                 NULL, NULL);
+    clSetKernelArg(daisy->oclKernels->denGradImage, 0, sizeof(inputImage), (void*)&inputImage);
+    clSetKernelArg(daisy->oclKernels->denGradImage, 1, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->denGradImage, 2, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->denGradImage, 3, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->denGradImage, 4, sizeof(int), (void*)&(daisy->paddedHeight));
+    clSetKernelArg(daisy->oclKernels->denGradImage, 5, sizeof(int), (void*)&gradientsOffset);
+    clSetKernelArg(daisy->oclKernels->denGradImage, 6, sizeof(int), (void*)&halfStorage);
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (G0x)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->denGradImage, 2, NULL,
+                                   denGradWorkerSize, denGradGroupSize, 0,
+                                   NULL, NULL);
 
-  clFinish(daisyCl->ioqueue);
+  }
+  else if(!givenGradients){
 
-  // convolve Y - massBuffer sections: B to A
-  size_t convWorkerSizeG0y[2] = {daisy->paddedWidth, (daisy->paddedHeight * daisy->gradientsNo) / 8};
-  size_t convGroupSizeG0y[2] = {16,8};
+    clSetKernelArg(daisy->oclKernels->denGrad, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->denGrad, 1, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->denGrad, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->denGrad, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+    clSetKernelArg(daisy->oclKernels->denGrad, 4, sizeof(int), (void*)&inputOffset);
+    clSetKernelArg(daisy->oclKernels->denGrad, 5, sizeof(int), (void*)&gradientsOffset);
+    clSetKernelArg(daisy->oclKernels->denGrad, 6, sizeof(int), (void*)&halfStorage);
 
-  clSetKernelArg(daisy->oclKernels->G0y, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->G0y, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->G0y, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->G0y, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->denGrad, 2, NULL,
+                                   denGradWorkerSize, denGradGroupSize, 0,
+                                   NULL, NULL);
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G0y, 2, NULL, 
-                                 convWorkerSizeG0y, convGroupSizeG0y, 0, 
-                                 NULL, NULL);
+  }
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (G0y)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  if(oclError("oclDaisy","clEnqueueNDRangeKernel (denGrad)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
   clFinish(daisyCl->ioqueue);
 
-  // smooth all with size 23 - keep
-
-  gettimeofday(&times->startConvX,NULL);
-
-  // convolve X - massBuffer sections: A to C
-  size_t convWorkerSizeG1x[2] = {daisy->paddedWidth / 4, daisy->paddedHeight * daisy->gradientsNo};
-  size_t convGroupSizeG1x[2] = {16,4};
+  if(inputImage != NULL) clReleaseMemObject(inputImage);
 
-  clSetKernelArg(daisy->oclKernels->G1x, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->G1x, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->G1x, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->G1x, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+  kernelCheckpoint(times,"denoiseGradients");
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G1x, 2, NULL, 
-                                 convWorkerSizeG1x, convGroupSizeG1x, 0, 
-                                 NULL, NULL);
-
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (G1x)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
-
-  clFinish(daisyCl->ioqueue);
-
-  gettimeofday(&times->endConvX,NULL);
+  gettimeofday(&times->endGrad,NULL);
+    
+  gettimeofday(&times->startConv,NULL);
 
-  // convolve Y - massBuffer sections: C to B
-  size_t convWorkerSizeG1y[2] = {daisy->paddedWidth, (daisy->paddedHeight * daisy->gradientsNo) / 4};
-  size_t convGroupSizeG1y[2]  = {16, 16};
+  memorySize = daisy->plan.transSize;
 
-  clSetKernelArg(daisy->oclKernels->G1y, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->G1y, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->G1y, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->G1y, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+  cl_mem transBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                      memorySize, (void*)NULL, &error);
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G1y, 2, 
-                                 NULL, convWorkerSizeG1y, convGroupSizeG1y,
-                                 0, NULL, NULL);
+  if(oclError("oclDaisy","clCreateBuffer (trans)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (G1y)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  if(cascade){
 
-  clFinish(daisyCl->ioqueue);
+    // all three layers in one pass - massBuffer section A to transBuffer, transposed and normalised
+    size_t cascadeWorkerSize[2] = {roundUp(daisy->paddedWidth, CASCADE_WIDTH),
+                                   (daisy->paddedHeight + CASCADE_HEIGHT-1) / CASCADE_HEIGHT * daisy->gradientsNo};
+    size_t cascadeGroupSize[2] = {CASCADE_WIDTH,daisy->gradientsNo};
 
-  // smooth all with size 29 - keep
-  
-  // convolve X - massBuffer sections: B to D
-  size_t convWorkerSizeG2x[2] = {daisy->paddedWidth / 4, (daisy->paddedHeight * daisy->gradientsNo)};
-  size_t convGroupSizeG2x[2]  = {16, 4};
+    clSetKernelArg(daisy->oclKernels->cascade, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->cascade, 1, sizeof(transBuffer), (void*)&transBuffer);
+    clSetKernelArg(daisy->oclKernels->cascade, 2, sizeof(filterBuffer), (void*)&filterBuffer);
+    clSetKernelArg(daisy->oclKernels->cascade, 3, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->cascade, 4, sizeof(int), (void*)&(daisy->paddedHeight));
+    clSetKernelArg(daisy->oclKernels->cascade, 5, sizeof(int), (void*)&halfStorage);
 
-  clSetKernelArg(daisy->oclKernels->G2x, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->G2x, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->G2x, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->G2x, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->cascade, 2, NULL,
+                                   cascadeWorkerSize, cascadeGroupSize, 0,
+                                   NULL, NULL);
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G2x, 2, 
-                                 NULL, convWorkerSizeG2x, convGroupSizeG2x, 
-                                 0, NULL, NULL);
+    if(oclError("oclDaisy","clEnqueueNDRangeKernel (cascade)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (G2x)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+    clFinish(daisyCl->ioqueue);
 
-  clFinish(daisyCl->ioqueue);
-  
-  // convolve Y - massBuffer sections: D to C
-  size_t convWorkerSizeG2y[2] = {daisy->paddedWidth, (daisy->paddedHeight * daisy->gradientsNo) / 4};
-  size_t convGroupSizeG2y[2]  = {16, 16};
+    kernelCheckpoint(times,"convolveCascade");
 
-  clSetKernelArg(daisy->oclKernels->G2y, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->G2y, 1, sizeof(filterBuffer), (void*)&filterBuffer);
-  clSetKernelArg(daisy->oclKernels->G2y, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->G2y, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+  }
+  else{
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->G2y, 2, 
-                                 NULL, convWorkerSizeG2y, convGroupSizeG2y, 
-                                 0, NULL, NULL);
+    error = convolveLayers(daisy, daisyCl, massBuffer, filterBuffer, smoothingSigmas, times);
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (G2y)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+    if(error) return error;
 
-  clFinish(daisyCl->ioqueue);
+  }
 
   gettimeofday(&times->endConvGrad,NULL);
 
   gettimeofday(&times->endConv,NULL);
 
-  // A) transpose SxGxHxW to SxHxWxG first
+  // A) transpose SxGxHxW to SxHxWxG first, the cascade has already written it that way
 
   gettimeofday(&times->startTransGrad,NULL);
 
-  memorySize = daisy->gradientsNo * daisy->smoothingsNo * 
-               paddedWidth * paddedHeight * sizeof(cl_float);
+  if(!cascade){
 
-  cl_mem transBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
-                                      memorySize, (void*)NULL, &error);
+    size_t transWorkerSize[2] = {daisy->paddedWidth,daisy->paddedHeight * daisy->smoothingsNo * daisy->gradientsNo};
+    size_t transGroupSize[2] = {32,8};
 
-  if(oclError("oclDaisy","clCreateBuffer (trans)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
-  
-  size_t transWorkerSize[2] = {daisy->paddedWidth,daisy->paddedHeight * daisy->smoothingsNo * daisy->gradientsNo};
-  size_t transGroupSize[2] = {32,8};
+    clSetKernelArg(daisy->oclKernels->trans, 0, sizeof(massBuffer), (void*)&massBuffer);
+    clSetKernelArg(daisy->oclKernels->trans, 1, sizeof(transBuffer), (void*)&transBuffer);
+    clSetKernelArg(daisy->oclKernels->trans, 2, sizeof(int), (void*)&(daisy->paddedWidth));
+    clSetKernelArg(daisy->oclKernels->trans, 3, sizeof(int), (void*)&(daisy->paddedHeight));
 
-  clSetKernelArg(daisy->oclKernels->trans, 0, sizeof(massBuffer), (void*)&massBuffer);
-  clSetKernelArg(daisy->oclKernels->trans, 1, sizeof(transBuffer), (void*)&transBuffer);
-  clSetKernelArg(daisy->oclKernels->trans, 2, sizeof(int), (void*)&(daisy->paddedWidth));
-  clSetKernelArg(daisy->oclKernels->trans, 3, sizeof(int), (void*)&(daisy->paddedHeight));
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->trans, 2, 
+                                   NULL, transWorkerSize, transGroupSize,
+                                   0, NULL, NULL);
 
-  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisy->oclKernels->trans, 2, 
-                                 NULL, transWorkerSize, transGroupSize,
-                                 0, NULL, NULL);
+    if(oclError("oclDaisy","clEnqueueNDRangeKernel (trans)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  if(oclError("oclDaisy","clEnqueueNDRangeKernel (trans)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+    clFinish(daisyCl->ioqueue);
 
-  clFinish(daisyCl->ioqueue);
+    kernelCheckpoint(times,"transposeGradients");
 
-  clReleaseMemObject(massBuffer);
+  }
+
+  // the gradients are kept for the next octave of a pyramid, given ones belong to the caller
+  if(daisy->keepGradients)
+    daisy->gradients = massBuffer;
+  else if(!givenGradients)
+    clReleaseMemObject(massBuffer);
 
   gettimeofday(&times->endTransGrad,NULL);
 
@@ -668,12 +1062,26 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
 
   if(oclError("oclDaisy","clCreateBuffer (daisyBufferA)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  if(totalSections > 1)
+  daisy->matchPointsOnly = 0;
+
+  if(daisy->plan.buffersNo > 1)
     daisy->buffers[daisy->buffersSize++] = clCreateBuffer(daisyCl->context, CL_MEM_WRITE_ONLY,
                                                           daisySectionSize,(void*)NULL, &error);
 
   if(oclError("oclDaisy","clCreateBuffer (daisyBufferB)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
+  // one byte per descriptor, too little to plan for
+  if(daisy->orientDescriptors){
+
+    if(daisy->orientations != NULL) clReleaseMemObject(daisy->orientations);
+
+    daisy->orientations = clCreateBuffer(daisyCl->context, CL_MEM_WRITE_ONLY,
+                                         (size_t)descriptorsWidth * descriptorsHeight, (void*)NULL, &error);
+
+    if(oclError("oclDaisy","clCreateBuffer (orientations)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  }
+
 // daisy->buffers[0] is daisyBufferA, daisy->buffers[1] is daisyBufferB
 //  cl_mem daisyBufferA, daisyBufferB;
 
@@ -684,7 +1092,7 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
   if(oclError("oclDaisy","clFinish (pre transdp)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
   char * str = (char*)malloc(sizeof(char) * 200);
-  int kernelsPerSection = (daisy->totalPetalsNo / 2 + 1);
+  int kernelsPerSection = (daisy->totalPetalsNo / 2 + 1) + (daisy->orientDescriptors ? 1 : 0);
 
   // For each 512x512 section
     // For each petal pair
@@ -695,26 +1103,33 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
 
     int sectionWidth = daisyBlockWidth;
     int sectionHeight = (sectionNo < totalSections-1 ? daisyBlockHeight : 
-                        (daisy->paddedHeight % daisyBlockHeight ? daisy->paddedHeight % daisyBlockHeight : daisyBlockHeight));
+                        (descriptorsHeight % daisyBlockHeight ? descriptorsHeight % daisyBlockHeight : daisyBlockHeight));
     int sectionSize = sectionWidth * sectionHeight * daisy->descriptorLength * sizeof(float);
 
-    // undefined behaviour when sectionHeight is not a multiple of 16!!
+    // a group covers 32 pixels of one row, the tail group of a row checks its bounds
     int TRANSD_FAST_STEPS = 4;
-    size_t daisyWorkerSize[2] = {(sectionWidth * daisy->gradientsNo * 2) / TRANSD_FAST_STEPS, sectionHeight};
+    size_t daisyWorkerSize[2] = {roundUp((sectionWidth * daisy->gradientsNo * 2) / TRANSD_FAST_STEPS, 128), sectionHeight};
     size_t daisyGroupSize[2] = {128,1};
       
-    short int resourceContext = sectionNo%2;
+    // sections take turns on the planned buffers, a buffer is reused
+    // once the section written to it before has been consumed
+    short int resourceContext = sectionNo % daisy->plan.buffersNo;
+    short int reusedBuffer = (sectionNo >= daisy->plan.buffersNo);
 
     cl_event * prevMemoryEvents = NULL;
     cl_event * currMemoryEvents = &memoryEvents[sectionNo];
     cl_event * prevKernelEvents = NULL;
     cl_event * currKernelEvents = &kernelEvents[sectionNo * kernelsPerSection];
 
-    if(resourceContext != sectionNo){
-      prevMemoryEvents = &memoryEvents[sectionNo-2];
-      prevKernelEvents = &kernelEvents[(sectionNo-2) * kernelsPerSection];
+    if(reusedBuffer){
+      prevMemoryEvents = &memoryEvents[sectionNo - daisy->plan.buffersNo];
+      prevKernelEvents = &kernelEvents[(sectionNo - daisy->plan.buffersNo) * kernelsPerSection];
     }
 
+    // without transfers every kernel of that section has to be done, not just the last
+    cl_event * waitEvents = (daisy->cpuTransfer ? prevMemoryEvents : prevKernelEvents);
+    cl_uint waitEventsNo = (reusedBuffer ? (daisy->cpuTransfer ? 1 : kernelsPerSection) : 0);
+
     gettimeofday(&times->startTransPinned,NULL);
 
     cl_mem * daisyBufferPtr = (!resourceContext ? &daisy->buffers[0] : &daisy->buffers[1]);
@@ -747,10 +1162,14 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
       int petalOutOffset = (-petalOneY * daisy->paddedWidth - petalOneX) * daisy->totalPetalsNo;
       petalOutOffset += (petalOutOffset < 0 ? -petalNo : petalNo);
 
-      size_t daisyWorkerOffsets[2] = {max(0, sectionX * daisyBlockWidth + petalOneX), 
+      // groups start at the source of the first descriptor of the window, xStart is
+      // negative or past the plane on the borders and the kernel reads zeros there
+      int xStart = roiPlaneX + sectionX * daisyBlockWidth - (petalOutOffset / daisy->totalPetalsNo) % daisy->paddedWidth;
+
+      size_t daisyWorkerOffsets[2] = {0, 
                                       petalRegion * daisy->paddedHeight + 
-                                      max(0, sectionY * daisyBlockHeight + // this will cover the block borders
-                                                               petalOneY)};
+                                      max(0, roiPlaneY + sectionY * daisyBlockHeight + // this will cover the block borders
+                                                                         petalOneY)};
       
       //printf("SectionNo=%d :: PetalRegion=%d :: PetalOneY=%d :: PetalOutOffset=%d :: WorkerOffsetY=%d :: daisyBlockHeight=%d\n",sectionNo,petalRegion,petalOneY,petalOutOffset,daisyWorkerOffsets[1],daisyBlockHeight);
 
@@ -762,32 +1181,64 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
       clSetKernelArg(daisy->oclKernels->transdp, 5, sizeof(int), (void*)&petalTwoOffY);
       clSetKernelArg(daisy->oclKernels->transdp, 6, sizeof(int), (void*)&petalTwoOffX);
       clSetKernelArg(daisy->oclKernels->transdp, 7, sizeof(int), (void*)&petalOutOffset);
+      clSetKernelArg(daisy->oclKernels->transdp, 8, sizeof(int), (void*)&daisyBlockHeight);
+      clSetKernelArg(daisy->oclKernels->transdp, 9, sizeof(int), (void*)&halfStorage);
+      clSetKernelArg(daisy->oclKernels->transdp, 10, sizeof(int), (void*)&roiPlaneX);
+      clSetKernelArg(daisy->oclKernels->transdp, 11, sizeof(int), (void*)&roiPlaneY);
+      clSetKernelArg(daisy->oclKernels->transdp, 12, sizeof(int), (void*)&daisyBlockWidth);
+      clSetKernelArg(daisy->oclKernels->transdp, 13, sizeof(int), (void*)&xStart);
 
       error = clEnqueueNDRangeKernel(daisyCl->ooqueue, daisy->oclKernels->transdp, 2,
                                      daisyWorkerOffsets, daisyWorkerSize, daisyGroupSize,
-                                     (resourceContext!=sectionNo), 
-                                     prevMemoryEvents,
+                                     waitEventsNo, 
+                                     waitEvents,
                                      &currKernelEvents[kernelNo++]);
 
       if(oclError("oclDaisy","clEnqueueNDRangeKernel (block pair)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 	
     }
 
-    size_t daisyWorkerSizeSingles[2] = {daisyBlockWidth * daisy->gradientsNo, sectionHeight};
-    size_t daisyWorkerOffsetsSingles[2] = {sectionX * daisyBlockWidth, sectionY * daisyBlockHeight};
+    size_t daisyWorkerSizeSingles[2] = {roundUp(daisyBlockWidth * daisy->gradientsNo, 128), sectionHeight};
+    size_t daisyWorkerOffsetsSingles[2] = {sectionX * daisyBlockWidth, roiPlaneY + sectionY * daisyBlockHeight};
     size_t daisyGroupSizeSingles[2] = {128, 1};
 
     clSetKernelArg(daisy->oclKernels->transds, 0, sizeof(cl_mem), (void*)&transBuffer);
     clSetKernelArg(daisy->oclKernels->transds, 1, sizeof(cl_mem), (void*)daisyBufferPtr);
     clSetKernelArg(daisy->oclKernels->transds, 2, sizeof(int), (void*)&daisyBlockHeight);
+    clSetKernelArg(daisy->oclKernels->transds, 3, sizeof(int), (void*)&halfStorage);
+    clSetKernelArg(daisy->oclKernels->transds, 4, sizeof(int), (void*)&paddedWidth);
+    clSetKernelArg(daisy->oclKernels->transds, 5, sizeof(int), (void*)&roiPlaneX);
+    clSetKernelArg(daisy->oclKernels->transds, 6, sizeof(int), (void*)&roiPlaneY);
+    clSetKernelArg(daisy->oclKernels->transds, 7, sizeof(int), (void*)&daisyBlockWidth);
 
     error = clEnqueueNDRangeKernel(daisyCl->ooqueue, daisy->oclKernels->transds, 2,
                                    daisyWorkerOffsetsSingles, daisyWorkerSizeSingles, daisyGroupSizeSingles,
-                                   (resourceContext!=sectionNo), prevMemoryEvents, &currKernelEvents[kernelNo++]);
+                                   waitEventsNo, waitEvents, &currKernelEvents[kernelNo++]);
 
       
     if(oclError("oclDaisy","clEnqueueNDRangeKernel (block single)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
+    // the section is complete once the pairs and the singles are done
+    if(daisy->orientDescriptors){
+
+      int orientationsOffset = sectionY * daisyBlockHeight * daisyBlockWidth;
+
+      size_t orientWorkerSize = (size_t)sectionWidth * sectionHeight * 64;
+      size_t orientGroupSize = 64;
+
+      clSetKernelArg(daisy->oclKernels->orientd, 0, sizeof(cl_mem), (void*)daisyBufferPtr);
+      clSetKernelArg(daisy->oclKernels->orientd, 1, sizeof(cl_mem), (void*)&daisy->orientations);
+      clSetKernelArg(daisy->oclKernels->orientd, 2, sizeof(int), (void*)&orientationsOffset);
+
+      error = clEnqueueNDRangeKernel(daisyCl->ooqueue, daisy->oclKernels->orientd, 1,
+                                     NULL, &orientWorkerSize, &orientGroupSize,
+                                     kernelNo, currKernelEvents, &currKernelEvents[kernelNo]);
+      kernelNo++;
+
+      if(oclError("oclDaisy","clEnqueueNDRangeKernel (orientDescriptors)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+    }
+
     //
     // GPU->CPU transfer
     //
@@ -902,6 +1353,9 @@ int oclDaisy(daisy_params * daisy, ocl_constructs * daisyCl, time_params * times
 
   gettimeofday(&times->endTransDaisy,NULL);
 
+  times->startKernel = times->startTransDaisy;
+  kernelCheckpoint(times,"transposeDaisy");
+
   times->transPinned += timeDiff(times->startTransDaisy,times->endTransDaisy) - times->transRam;
 
   gettimeofday(&times->endFull,NULL);
@@ -16,6 +16,8 @@
 #include "ocl/cachedProgram.h"
 #include "ocl/cachedConstructs.h"
 
+#include "memoryPlan.h"
+
 #include "kutility/general.h"
 #include "kutility/math.h"
 #include "kutility/image.h"
@@ -38,40 +40,91 @@ using kutility::save_binary;
 //#define TEST_FETCHDAISY
 //#define CPU_VERIFICATION
 
+// Middle layer matching configuration, normally passed with -D at compile time
+#ifndef DM_WGX
+#define DM_WGX 128
+#endif
+#ifndef DM_WG_TARGETS_NO
+#define DM_WG_TARGETS_NO 64
+#endif
+#ifndef DM_TARGETS_PER_LOOP
+#define DM_TARGETS_PER_LOOP 8
+#endif
+#ifndef DM_SEARCH_WIDTH
+#define DM_SEARCH_WIDTH 32
+#endif
+#ifndef DM_ROTATIONS_NO
+#define DM_ROTATIONS_NO 4
+#endif
+#ifndef COARSE_TEMPLATES_NO
+#define COARSE_TEMPLATES_NO 16
+#endif
+#ifndef COARSE_CANDIDATES_NO
+#define COARSE_CANDIDATES_NO 4
+#endif
+// coarse pixels around a candidate that no worse candidate may take
+#ifndef COARSE_SUPPRESS_RADIUS
+#define COARSE_SUPPRESS_RADIUS 2
+#endif
+#ifndef MIDDLE_TEMPLATES_NO
+#define MIDDLE_TEMPLATES_NO 512
+#endif
+// a power of two, the fine layer reduces its window by halving it
+#ifndef DF_SEARCH_WIDTH
+#define DF_SEARCH_WIDTH 8
+#endif
+
 #ifndef OCL_DAISY_KERNELS
 #define OCL_DAISY_KERNELS
 typedef struct ocl_daisy_kernels_tag{
-  cl_kernel denx;
-  cl_kernel deny;
-  cl_kernel grad;
+  cl_kernel denGrad;
+  cl_kernel denGradImage;
+  cl_kernel cascade;
   cl_kernel G0x;
   cl_kernel G0y;
   cl_kernel G1x;
   cl_kernel G1y;
   cl_kernel G2x;
   cl_kernel G2y;
+  cl_kernel iirx;
+  cl_kernel iiry;
   cl_kernel trans;
   cl_kernel transd;
   cl_kernel transdp;
   cl_kernel transds;
   cl_kernel fetchd;
-  cl_kernel diffCoarse;
-  cl_kernel transposeRotations;
-  cl_kernel reduceMin;
-  cl_kernel reduceMinAll;
+  cl_kernel orientd;
+  cl_kernel changedTiles;
+  cl_kernel downGrad;
+  cl_kernel diffCoarseBatched;
+  cl_kernel reduceMinPlanes;
   cl_kernel normaliseRotation;
   cl_kernel diffMiddle;
+  cl_kernel reduceMiddle;
+  cl_kernel diffFine;
   unsigned int kernelsNo;
+  void * matchSession;   // match_session the matcher kernels hold the arguments of
 } ocl_daisy_kernels;
 #endif
 
 #define SUBSAMPLE_RATE 2
+// Dimensions are rounded up to a multiple of this for the per-layer kernels and the matcher
+#define ARRAY_PADDING 64
+
+// Pixels around a region of interest that its descriptors depend on: denoise 2,
+// gradient 1, the G0/G1/G2 kernels 5/11/13 and the outer petals 2*SIGMA_C = 15
+#define ROI_HALO 47
+
 #define SMOOTHINGS_NO 3
 #define SIGMA_DEN 0.5f
 #define SIGMA_A 2.5f
 #define SIGMA_B 5.0f
 #define SIGMA_C 7.5f
 #define GRADIENTS_NO 8
+
+// Smoothing of each layer, direct separable convolution or recursive Gaussian
+#define SMOOTHING_FIR 0
+#define SMOOTHING_IIR 1
 #define REGION_PETALS_NO 8
 #define TOTAL_PETALS_NO (SMOOTHINGS_NO * REGION_PETALS_NO + 1)
 
@@ -82,6 +135,9 @@ typedef struct ocl_daisy_kernels_tag{
 
 #define DESCRIPTOR_LENGTH (TOTAL_PETALS_NO + TRANSD_FAST_PETAL_PADDING) * GRADIENTS_NO
 
+// Maximum number of distinct kernels timed by kernelCheckpoint
+#define TIMED_KERNELS_MAX 32
+
 #ifndef DAISY_PARAMS
 #define DAISY_PARAMS
 typedef struct daisy_params_tag{
@@ -101,9 +157,27 @@ typedef struct daisy_params_tag{
   cl_mem * buffers;
   unsigned int buffersSize;
   short int cpuTransfer;
+  short int smoothingModes[SMOOTHINGS_NO]; // SMOOTHING_FIR or SMOOTHING_IIR per layer
+  unsigned long int memoryBudget; // bytes of device memory to plan in, 0 for most of the device
+  short int halfStorage;          // gradients and transposed layers as half floats (all FIR layers only)
+  short int imageInput;           // read the input through an image when the device supports it
+  int padding;                    // paddedWidth/Height are multiples of it, 1 for the exact image
+  int roiX;                       // descriptors of this rectangle only, roiWidth 0 for the whole image;
+  int roiY;                       // they are then roiHeight x roiWidth, descriptor (0,0) at (roiY,roiX)
+  int roiWidth;
+  int roiHeight;
+  cl_mem gradients;               // gradient planes to start from instead of the input, see pyramid.h
+  short int keepGradients;        // leave the gradients of this call in gradients for the caller to release
+  short int orientDescriptors;    // rotate every descriptor to its dominant G0 bin, see orientDescriptors
+  cl_mem orientations;            // that bin per descriptor (uchar), on the device while buffers are
+  short int matchPointsOnly;      // buffers[0] holds the matcher's coarse then seed points only, see templateCache.h
+  unsigned int generation;        // counts the times buffers were extracted or loaded, 0 before the first
+  memory_plan plan;               // plan of the last oclDaisy call
 } daisy_params;
 #endif
 
+#ifndef TIME_PARAMS
+#define TIME_PARAMS
 typedef struct time_params_tag{
 
   // Time structures - measure down to microseconds
@@ -142,7 +216,15 @@ typedef struct time_params_tag{
 
   struct timeval startMatchCpu, endMatchCpu;
 
-  double diffCoarse, transRot, reduceMin, reduceMinAll;
+  struct timeval startKernel, endKernel; // measure single kernels, accumulated by name with kernelCheckpoint
+
+  const char * kernelNames[TIMED_KERNELS_MAX];
+
+  double kernelTimes[TIMED_KERNELS_MAX];
+
+  int kernelsTimed;
+
+  double diffCoarse, reduceMin;
 
   double transPinned, transRam;
 
@@ -155,6 +237,7 @@ typedef struct time_params_tag{
   short int enabled;
 
 } time_params;
+#endif
 
 daisy_params * newDaisyParams(const char *, unsigned char *, int, int, short int);
 
@@ -162,6 +245,8 @@ daisy_params * initDaisy(const char *, short int);
 
 int initOcl(daisy_params *, ocl_constructs *);
 
+short int inputImageSupported(ocl_constructs *, int, int);
+
 int oclDaisy(daisy_params *, ocl_constructs *, time_params *);
 
 void unpadDescriptorArray(daisy_params *);
@@ -170,6 +255,12 @@ int oclCleanUp(ocl_daisy_kernels *, ocl_constructs *, int);
 
 int daisyCleanUp(daisy_params *, ocl_constructs *);
 
+void daisyReleaseBuffers(daisy_params *);
+
+void kernelCheckpoint(time_params *, const char *);
+
+void iirGaussianCoefficients(float, cl_float4 *);
+
 void displayTimes(daisy_params *, time_params *);
 
 void saveToBinary(daisy_params *);
@@ -2,10 +2,6 @@
 
 #define VERBOSE 0
 
-long int verifyDiffCoarse(daisy_params * daisyTarget, float * petalArray, 
-                          float * targetArray, float * diffArray);
-long int verifyReduceMinAll(daisy_params * daisyTarget, float * diffTransArray, float * diffArray, int templatePointsNo);
-long int verifyTransposeRotations(daisy_params * daisyTarget, float * diffArray, float * diffTransArray);
 long int verifyDiffMiddle(daisy_params * daisyTarget, daisy_params * daisyTemplate, float * targetArray, 
                           float * templateArray, float * diffArray, int searchWidth, float * corrs, int votedRotation,
                           int templatesNo, int rotationsNoMiddle);
@@ -53,17 +49,11 @@ int initOclMatch(daisy_params * daisy, ocl_constructs * daisyCl){
   }
   
   // Prepare the kernel  
-  daisy->oclKernels->diffCoarse = clCreateKernel(daisyCl->program, "diffCoarse", &error);
-  if(oclErrorM("initOclMatch","clCreateKernel (diffCoarse)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  daisy->oclKernels->diffCoarseBatched = clCreateKernel(daisyCl->program, "diffCoarseBatched", &error);
+  if(oclErrorM("initOclMatch","clCreateKernel (diffCoarseBatched)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
-  daisy->oclKernels->transposeRotations = clCreateKernel(daisyCl->program, "transposeRotations", &error);
-  if(oclErrorM("initOclMatch","clCreateKernel (transposeRotations)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
-
-  daisy->oclKernels->reduceMin = clCreateKernel(daisyCl->program, "reduceMin", &error);
-  if(oclErrorM("initOclMatch","clCreateKernel (reduceMin)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
-
-  daisy->oclKernels->reduceMinAll = clCreateKernel(daisyCl->program, "reduceMinAll", &error);
-  if(oclErrorM("initOclMatch","clCreateKernel (reduceMinAll)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+  daisy->oclKernels->reduceMinPlanes = clCreateKernel(daisyCl->program, "reduceMinPlanes", &error);
+  if(oclErrorM("initOclMatch","clCreateKernel (reduceMinPlanes)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
   daisy->oclKernels->normaliseRotation = clCreateKernel(daisyCl->program, "normaliseRotation", &error);
   if(oclErrorM("initOclMatch","clCreateKernel (normaliseRotation)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
@@ -71,6 +61,12 @@ int initOclMatch(daisy_params * daisy, ocl_constructs * daisyCl){
   daisy->oclKernels->diffMiddle = clCreateKernel(daisyCl->program, "diffMiddle", &error);
   if(oclErrorM("initOclMatch","clCreateKernel (diffMiddle)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
 
+  daisy->oclKernels->reduceMiddle = clCreateKernel(daisyCl->program, "reduceMiddle", &error);
+  if(oclErrorM("initOclMatch","clCreateKernel (reduceMiddle)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
+  daisy->oclKernels->diffFine = clCreateKernel(daisyCl->program, "diffFine", &error);
+  if(oclErrorM("initOclMatch","clCreateKernel (diffFine)",error)) return oclCleanUp(daisy->oclKernels,daisyCl,error);
+
   return error;
 
 }
@@ -87,7 +83,8 @@ point * generateTemplatePoints(daisy_params * daisy, int templatePointsNo, int x
 
   float step = sqrtf((yRange * xRange) / templatePointsNo);
 
-  printf("Seed Grid Spacing = %.2f\n", step);
+  if(VERBOSE)
+    printf("Seed Grid Spacing = %.2f\n", step);
 
   float x = boundaryOffset;
   float y = boundaryOffset;
@@ -132,265 +129,528 @@ int checkpoint(ocl_constructs * daisyCl, struct timeval * s, short int finishQue
 
 }
 
-int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
-                  ocl_constructs * daisyCl, time_params * times){
+void freeMatchResult(match_result * result){
 
-  cl_int error = 0;
+  free(result->templatePoints);
+  free(result->targetPoints);
+  free(result->ratios);
+
+  result->templatePoints = NULL;
+  result->targetPoints = NULL;
+  result->ratios = NULL;
+  result->pointsNo = 0;
+
+}
+
+// Work sizes of the coarse kernels, as in diffCoarseBatched and reduceMinPlanes
+#define COARSE_WORKERS_PER_PIXEL 4
+#define WGS_REDUCE_PLANES 256
+
+// Work group size of reduceMiddle, a group per seed
+#define WGS_REDUCE_MIDDLE 256
+
+// Work group size of diffFine, a worker per offset of a seed's window
+#define WGS_DIFF_FINE (DF_SEARCH_WIDTH * DF_SEARCH_WIDTH)
+
+// Floats of the three rings of a template point that the coarse layer compares
+#define COARSE_RINGS_LENGTH (SMOOTHINGS_NO * REGION_PETALS_NO * GRADIENTS_NO)
+
+// Index in the padded target of a pixel of the coarse plane
+int upsampleCoarsePixel(int pixel, point coarseTargetSize, int gridSpacing, point targetSize){
+
+  return (floor(pixel / coarseTargetSize.x) * gridSpacing * targetSize.x)
+       + (pixel % (int)coarseTargetSize.x) * gridSpacing;
+
+}
+
+void bindMatchSession(match_session * session){
+
+  ocl_daisy_kernels * kernels = session->templates[0]->oclKernels;
+
+  clSetKernelArg(kernels->diffCoarseBatched, 0, sizeof(cl_mem), (void*)&session->templatePetals);
+  clSetKernelArg(kernels->diffCoarseBatched, 2, sizeof(cl_mem), (void*)&session->coarseMinima);
+  clSetKernelArg(kernels->diffCoarseBatched, 3, sizeof(cl_mem), (void*)&session->coarseArgmin);
+  clSetKernelArg(kernels->diffCoarseBatched, 4, sizeof(int), (void*)&session->targetWidth);
+
+  clSetKernelArg(kernels->reduceMinPlanes, 0, sizeof(cl_mem), (void*)&session->coarseMinima);
+  clSetKernelArg(kernels->reduceMinPlanes, 1, sizeof(cl_mem), (void*)&session->coarseArgmin);
+  clSetKernelArg(kernels->reduceMinPlanes, 2, sizeof(cl_mem), (void*)&session->argminBuffer);
+  clSetKernelArg(kernels->reduceMinPlanes, 6, sizeof(int), (void*)&session->coarsePointsNo);
+  clSetKernelArg(kernels->reduceMinPlanes, 7, sizeof(int), (void*)&session->coarseWidth);
+
+  clSetKernelArg(kernels->diffMiddle, 2, sizeof(cl_mem), (void*)&session->diffBuffer);
+  clSetKernelArg(kernels->diffMiddle, 3, sizeof(cl_mem), (void*)&session->corrsBuffer);
+  clSetKernelArg(kernels->diffMiddle, 4, sizeof(int), (void*)&session->targetWidth);
 
-  int templatePointsNo = COARSE_TEMPLATES_NO; // default is 16
-  point * templatePoints = generateTemplatePoints(daisyTemplate, templatePointsNo, 0, 0);
+  clSetKernelArg(kernels->reduceMiddle, 0, sizeof(cl_mem), (void*)&session->diffBuffer);
+  clSetKernelArg(kernels->reduceMiddle, 1, sizeof(cl_mem), (void*)&session->corrsBuffer);
+  clSetKernelArg(kernels->reduceMiddle, 2, sizeof(cl_mem), (void*)&session->middleArgminBuffer);
+  clSetKernelArg(kernels->reduceMiddle, 3, sizeof(int), (void*)&session->targetWidth);
 
+  int targetPixelsNo = session->targetWidth * session->targetHeight;
+
+  clSetKernelArg(kernels->diffFine, 2, sizeof(cl_mem), (void*)&session->corrsBuffer);
+  clSetKernelArg(kernels->diffFine, 3, sizeof(cl_mem), (void*)&session->middleArgminBuffer);
+  clSetKernelArg(kernels->diffFine, 4, sizeof(int), (void*)&session->targetWidth);
+  clSetKernelArg(kernels->diffFine, 5, sizeof(int), (void*)&targetPixelsNo);
+  clSetKernelArg(kernels->diffFine, 6, sizeof(int), (void*)&session->seedTemplatePointsNo);
+
+  // the descriptors are bound again by the next match
+  session->middleTemplateBuffer = NULL;
+  session->targetBuffer = NULL;
+
+  kernels->matchSession = (void*)session;
+
+}
+
+// Copies the rings of a template's coarse points next to those of the
+// templates before it, once per template buffer
+int gatherTemplatePetals(match_session * session, int templateNo, ocl_constructs * daisyCl){
+
+  cl_int error = 0;
+
+  daisy_params * daisyTemplate = session->templates[templateNo];
   cl_mem templateBuffer = daisyTemplate->buffers[0];
-  cl_mem targetBuffer = daisyTarget->buffers[0];
 
-  int gridSpacing = pow(SUBSAMPLE_RATE,2);
-  int coarseWidth  = daisyTarget->paddedWidth  / gridSpacing;
-  int coarseHeight = daisyTarget->paddedHeight / gridSpacing;
+  for(int i = templateNo * session->templatePointsNo; i < (templateNo + 1) * session->templatePointsNo && !error; i++){
 
-  point coarseTargetSize = { (float)coarseWidth, (float)coarseHeight };
+    point p = session->templatePoints[i];
 
-  int rotationsNo = ROTATIONS_NO;
-  int templatePetalsPerRun = 8;
+    // cached templates hold the coarse points first, see templateCache.h
+    size_t descriptorNo = (daisyTemplate->matchPointsOnly ? (size_t)(i - templateNo * session->templatePointsNo) :
+                                                            (size_t)p.y * daisyTemplate->paddedWidth + p.x);
 
-  int rotationsNoMiddle = DM_ROTATIONS_NO; // default is 4
-  int rotationsNoFine = 1;
-  int searchWidthMiddle = DM_SEARCH_WIDTH; // default is 32
-  int searchWidthFine = 8;
-  int seedTemplatePointsNo = MIDDLE_TEMPLATES_NO; // default is 512
+    error = clEnqueueCopyBuffer(daisyCl->ioqueue, templateBuffer, session->templatePetals,
+                                (descriptorNo * DESCRIPTOR_LENGTH + (TRANSD_FAST_PETAL_PADDING + 1) * GRADIENTS_NO) * sizeof(float),
+                                i * COARSE_RINGS_LENGTH * sizeof(float), COARSE_RINGS_LENGTH * sizeof(float),
+                                0, NULL, NULL);
 
-  // (pre) 5. Generate seed descriptors (512 of them)
-  point * seedTemplatePoints = generateTemplatePoints(daisyTemplate, seedTemplatePointsNo, 0, 0);  
+  }
 
-  // 5. Project them with the overall projection, then find 2 closest target descriptors
-  point * seedTargetPoints = (point*)malloc(sizeof(point) * seedTemplatePointsNo);
+  if(oclErrorM("gatherTemplatePetals","clEnqueueCopyBuffer (templatePetals)",error)) return error;
 
-  int diffBufferSize1 = (coarseWidth * coarseHeight * rotationsNo);
-  int diffBufferSize2 = (seedTemplatePointsNo * rotationsNoMiddle * (searchWidthMiddle * searchWidthMiddle));
+  return 0;
 
-  printf("\nA) CoarseLayer [%dx%d] - Search Resolution %d - Seeds %d\n",
-         coarseHeight,coarseWidth,(int)pow(SUBSAMPLE_RATE,2),templatePointsNo);
+}
 
-  int argminBufferLength = templatePointsNo * rotationsNo * 2;
+// A catalogue of one template
+match_session * newMatchSession(daisy_params * daisyTemplate, daisy_params * daisyTarget, ocl_constructs * daisyCl){
 
-  cl_mem diffBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
-                                       max(diffBufferSize1, diffBufferSize2) * sizeof(float),
-                                       (void*)NULL, &error);
+  return newMatchCatalogue(&daisyTemplate, 1, daisyTarget, daisyCl);
 
-  cl_mem diffBufferTrans = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
-                                          (coarseWidth * coarseHeight * rotationsNo) * sizeof(float),
-                                          (void*)NULL, &error);
+}
 
-  cl_mem argminBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
-                                       argminBufferLength * sizeof(float),
-                                       (void*)NULL, &error);
+// Sized for targets of daisyTarget's padded size, NULL if the descriptors
+// cannot be matched or the buffers do not fit in the device. The kernels of
+// the first template are the ones the whole catalogue is matched with
+match_session * newMatchCatalogue(daisy_params ** templates, int templatesNo, daisy_params * daisyTarget, ocl_constructs * daisyCl){
 
-  cl_mem corrsBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
-                                       (seedTemplatePointsNo * 2) * sizeof(float),
-                                       (void*)NULL, &error);
+  cl_int error = 0;
 
-  cl_mem pinnedArgminBuffer = clCreateBuffer(daisyCl->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, 
-                                             argminBufferLength * sizeof(float), NULL, &error);
+  // the coarse search grids and their work groups assume padded descriptors
+  short int padded = !(daisyTarget->paddedWidth % ARRAY_PADDING || daisyTarget->paddedHeight % ARRAY_PADDING);
+  short int whole = !daisyTarget->roiWidth;
 
-  if(oclErrorM("oclDaisy","clCreateBuffer (pinnedArgmin)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  for(int n = 0; n < templatesNo; n++){
+    padded = padded && !(templates[n]->paddedWidth % ARRAY_PADDING || templates[n]->paddedHeight % ARRAY_PADDING);
+    whole = whole && !templates[n]->roiWidth;
+  }
 
-  float * argmin = (float*) clEnqueueMapBuffer(daisyCl->ioqueue, pinnedArgminBuffer, 1,
-                                              CL_MAP_WRITE, 0, argminBufferLength * sizeof(float),
-                                              0, NULL, NULL, &error);
+  if(!padded){
+    fprintf(stderr, "oclMatchDaisy.cpp::newMatchCatalogue needs descriptors extracted with padding = ARRAY_PADDING\n");
+    return NULL;
+  }
 
-  if(oclErrorM("oclDaisy","clEnqueueMapBuffer (pinnedArgmin)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  // and descriptors of the whole images
+  if(!whole){
+    fprintf(stderr, "oclMatchDaisy.cpp::newMatchCatalogue needs descriptors of the whole images, not of a region\n");
+    return NULL;
+  }
 
-  // Setup diffCoarse kernel
-  int workersPerPixel = 4;
-  const size_t wgsDiffCoarse[2] = {64, 1};
-  const size_t wsDiffCoarse[2] = {coarseWidth * workersPerPixel, coarseHeight};
+  struct timeval start, end;
+  gettimeofday(&start,NULL);
 
-  clSetKernelArg(daisyTemplate->oclKernels->diffCoarse, 0, sizeof(templateBuffer), (void*)&templateBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->diffCoarse, 1, sizeof(targetBuffer), (void*)&targetBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->diffCoarse, 2, sizeof(diffBuffer), (void*)&diffBuffer);
+  match_session * session = (match_session*)malloc(sizeof(match_session));
 
-  // Setup transposeRotations kernel
-  const size_t wgsTransposeRotations[2] = {128, 1};
-  const size_t wsTransposeRotations[2] = {coarseWidth * rotationsNo, coarseHeight};
+  session->templatesNo = templatesNo;
+  session->templates = (daisy_params**)malloc(sizeof(daisy_params*) * templatesNo);
+  memcpy(session->templates, templates, sizeof(daisy_params*) * templatesNo);
 
-  clSetKernelArg(daisyTemplate->oclKernels->transposeRotations, 0, sizeof(diffBuffer), (void*)&diffBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->transposeRotations, 1, sizeof(diffBufferTrans), (void*)&diffBufferTrans);
-  clSetKernelArg(daisyTemplate->oclKernels->transposeRotations, 2, sizeof(int), (void*)&coarseHeight);
-  clSetKernelArg(daisyTemplate->oclKernels->transposeRotations, 3, sizeof(int), (void*)&coarseWidth);
+  session->targetWidth = daisyTarget->paddedWidth;
+  session->targetHeight = daisyTarget->paddedHeight;
 
-  // Setup reduceMin kernel
-  int diffBufferSize = coarseHeight * coarseWidth; // reduce per rotation
+  int gridSpacing = pow(SUBSAMPLE_RATE,2);
+  session->coarseWidth  = session->targetWidth  / gridSpacing;
+  session->coarseHeight = session->targetHeight / gridSpacing;
 
-  const size_t wgsReduceMin = 256;
-  const size_t wsReduceMin = diffBufferSize;
+  session->templatePointsNo = COARSE_TEMPLATES_NO; // default is 16
+  session->coarsePointsNo = templatesNo * session->templatePointsNo;
+  session->templatePoints = (point*)malloc(sizeof(point) * session->coarsePointsNo);
 
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMin, 0, sizeof(diffBufferTrans), (void*)&diffBufferTrans);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMin, 1, sizeof(diffBuffer), (void*)&diffBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMin, 2, sizeof(int), (void*)&diffBufferSize);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMin, 3, sizeof(float) * wgsReduceMin, (void*)NULL);
+  // (pre) 5. Generate seed descriptors (512 of them)
+  session->seedTemplatePointsNo = MIDDLE_TEMPLATES_NO;
+  session->seedTemplatePoints = (point*)malloc(sizeof(point) * templatesNo * session->seedTemplatePointsNo);
 
-  const size_t minimaPerRot =  (coarseHeight * coarseWidth) / wgsReduceMin;
-  const size_t wgsReduceMinAll = max(minimaPerRot, 64);
-  const size_t wsReduceMinAll = wgsReduceMinAll * rotationsNo;
+  unsigned long int templatesSize = 0;
 
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMinAll, 0, sizeof(diffBufferTrans), (void*)&diffBufferTrans);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMinAll, 1, sizeof(diffBuffer), (void*)&diffBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMinAll, 2, sizeof(argminBuffer), (void*)&argminBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMinAll, 3, sizeof(int), (void*)&minimaPerRot);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMinAll, 4, sizeof(float) * wgsReduceMinAll, (void*)NULL);
-  clSetKernelArg(daisyTemplate->oclKernels->reduceMinAll, 5, sizeof(int), (void*)&templatePointsNo);
+  for(int n = 0; n < templatesNo; n++){
 
-  unsigned int offsetToFine = (TRANSD_FAST_PETAL_PADDING + 1) * GRADIENTS_NO;
-  unsigned int offsetToDescriptor = (templatePoints[0].y  * daisyTemplate->paddedWidth + 
-                                     templatePoints[0].x) * DESCRIPTOR_LENGTH;
+    point * grid = generateTemplatePoints(templates[n], session->templatePointsNo, 0, 0);
+    memcpy(session->templatePoints + n * session->templatePointsNo, grid, sizeof(point) * session->templatePointsNo);
+    free(grid);
 
-  const size_t wgsDiffMiddle[2] = { DM_WGX, 1 };
-  int targetPixelsPerWorkgroup = DM_WG_TARGETS_NO;
-  int workersPerTargetPixel = wgsDiffMiddle[0] / targetPixelsPerWorkgroup;
+    grid = generateTemplatePoints(templates[n], session->seedTemplatePointsNo, 0, 0);
+    memcpy(session->seedTemplatePoints + n * session->seedTemplatePointsNo, grid, sizeof(point) * session->seedTemplatePointsNo);
+    free(grid);
 
-  int seedTemplatesPerRun = seedTemplatePointsNo; // multi-block processing causes errors - keep this until fixed
-  const size_t wsDiffMiddle[2] = { (searchWidthMiddle * searchWidthMiddle * wgsDiffMiddle[0]) / targetPixelsPerWorkgroup, seedTemplatesPerRun };
-//  const size_t wsDiffMiddle[2] = { searchWidthFine * searchWidthFine * workersPerTargetPixel, seedTemplatesPerRun };
+    templatesSize += templates[n]->plan.sectionSize * templates[n]->plan.buffersNo;
 
-  clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 0, sizeof(templateBuffer), (void*)&templateBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 1, sizeof(targetBuffer), (void*)&targetBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 2, sizeof(diffBuffer), (void*)&diffBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 3, sizeof(corrsBuffer), (void*)&corrsBuffer);
-  clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 4, sizeof(int), (void*)&daisyTarget->paddedWidth);
+  }
 
-  cl_event lastReduction;
+  session->corrs = (float*)malloc(sizeof(float) * session->seedTemplatePointsNo * 2);
+
+  // none of the rings have been gathered yet
+  session->templateGenerations = (unsigned int*)calloc(templatesNo, sizeof(unsigned int));
+
+  session->diffBuffer = session->argminBuffer = NULL;
+  session->coarseMinima = session->coarseArgmin = NULL;
+  session->templatePetals = NULL;
+  session->corrsBuffer = session->pinnedArgminBuffer = NULL;
+  session->middleArgminBuffer = session->pinnedMiddleArgminBuffer = NULL;
+  session->argmin = session->middleArgmin = NULL;
+  session->middleTemplateBuffer = session->targetBuffer = NULL;
+  session->difft = 0;
+
+  session->tracking.enabled = 0;
+  session->tracking.radius = 0;
+  session->tracking.minVotes = TRACK_MIN_VOTES;
+  session->tracking.transforms = (transform*)malloc(sizeof(transform) * templatesNo);
+  session->tracking.tracked = (short int*)calloc(templatesNo, sizeof(short int));
+  session->tracking.path = MATCH_PATH_FULL;
+  session->tracking.windowX = session->tracking.windowY = 0;
+  session->tracking.windowWidth = session->coarseWidth;
+  session->tracking.windowHeight = session->coarseHeight;
+
+  int coarseWidth = session->coarseWidth;
+  int coarseHeight = session->coarseHeight;
+  int rotationsNo = ROTATIONS_NO;
+  int rotationsNoMiddle = DM_ROTATIONS_NO; // default is 4
+  int searchWidthMiddle = DM_SEARCH_WIDTH; // default is 32
+  int seedTemplatePointsNo = session->seedTemplatePointsNo;
 
-  checkpoint(daisyCl, &times->startMatchDaisy, 1);
+  // distances of one seed at every offset and rotation of its search window
+  unsigned long int seedVolumeSize = (unsigned long int)rotationsNoMiddle * searchWidthMiddle * searchWidthMiddle * sizeof(float);
 
-  for(int templatePointNo = 0; templatePointNo < templatePointsNo; templatePointNo++){
+  session->argminBufferLength = session->coarsePointsNo * rotationsNo * COARSE_CANDIDATES_NO * 2;
 
-    checkpoint(daisyCl, &times->startDiffCoarse, times->enabled);
+  // the descriptors of both images stay resident while matching
+  device_memory device;
 
-    point p = templatePoints[templatePointNo];
+  error = queryDeviceMemory(daisyCl->deviceId, &device);
+  if(oclErrorM("newMatchCatalogue","queryDeviceMemory",error)){
+    freeMatchSession(session, daisyCl);
+    return NULL;
+  }
 
-    int templateNo = (p.y * daisyTemplate->paddedWidth + p.x);
+  const char * allocationNames[10] = {"template descriptors", "target descriptors", "diffBuffer",
+                                      "templatePetals", "argminBuffer", "corrsBuffer", "pinnedArgminBuffer",
+                                      "middleArgminBuffer", "pinnedMiddleArgminBuffer", "coarse partial minima"};
+  unsigned long int middleArgminSize = (unsigned long int)seedTemplatePointsNo * (MIDDLE_ARGMIN_LENGTH + FINE_ARGMIN_LENGTH) * sizeof(float);
 
-    for(int regionNo = 2; regionNo > -1; regionNo--){
+  unsigned long int allocationSizes[10] = {templatesSize,
+                                          daisyTarget->plan.sectionSize * daisyTarget->plan.buffersNo,
+                                          0,
+                                          session->coarsePointsNo * COARSE_RINGS_LENGTH * sizeof(float),
+                                          session->argminBufferLength * sizeof(float),
+                                          0,
+                                          session->argminBufferLength * sizeof(float),
+                                          middleArgminSize,
+                                          middleArgminSize,
+                                          0};
 
-      clSetKernelArg(daisyTemplate->oclKernels->diffCoarse, 3, sizeof(int), (void*)&templateNo);
-      clSetKernelArg(daisyTemplate->oclKernels->diffCoarse, 4, sizeof(int), (void*)&(daisyTarget->paddedWidth));
-      clSetKernelArg(daisyTemplate->oclKernels->diffCoarse, 5, sizeof(int), (void*)&regionNo);
+  unsigned long int budget = memoryBudget(&device, daisyTarget->memoryBudget);
+  unsigned long int allocated = 0;
 
-      // Compute diffCoarse
-      error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisyTemplate->oclKernels->diffCoarse, 2, 
-                                     NULL, wsDiffCoarse, wgsDiffCoarse, 
-                                     0, NULL, NULL);
+  for(int i = 0; i < 9; i++)
+    allocated += allocationSizes[i];
 
-      if(oclErrorM("oclDaisy","clEnqueueNDRangeKernel (diffCoarse)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  unsigned long int available = (budget > allocated ? min(budget - allocated, (unsigned long int)device.maxAllocSize) : 0);
 
-    }
+  // the middle layer goes through the seeds in chunks as large as what is left
+  // lets their distances be, with two chunks of correspondences on the device
+  session->seedChunkNo = max(1, min(seedTemplatePointsNo, (int)(available / (seedVolumeSize + 4 * sizeof(float)))));
 
-    checkpoint(daisyCl, &times->endDiffCoarse, times->enabled);
-    times->diffCoarse += timeDiff(times->startDiffCoarse, times->endDiffCoarse);
+  allocationSizes[2] = session->seedChunkNo * seedVolumeSize;
+  allocationSizes[5] = session->seedChunkNo * 4 * sizeof(float);
+  allocated += allocationSizes[2] + allocationSizes[5];
 
-    checkpoint(daisyCl, &times->startDiffTranspose, times->enabled);
+  available = (budget > allocated ? min(budget - allocated, (unsigned long int)device.maxAllocSize) : 0);
 
-    // Transpose rotations from HxWxR to RxHxW
-    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisyTemplate->oclKernels->transposeRotations, 2,
-                                   NULL, wsTransposeRotations, wgsTransposeRotations,
-                                   0, NULL, NULL);
+  // as many template points as their partial minima fit in what is left go in one launch,
+  // one minimum and its pixel per rotation and group of 16 target pixels
+  session->coarseGroupsNo = (coarseWidth / 16) * coarseHeight;
+  unsigned long int coarseVolumeSize = (unsigned long int)session->coarseGroupsNo * rotationsNo * (sizeof(float) + sizeof(int));
 
-    if(oclErrorM("oclDaisy","clEnqueueNDRangeKernel (transposeRotations)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  session->coarseBatchNo = max(1, min(session->coarsePointsNo, (int)(available / coarseVolumeSize)));
 
-    checkpoint(daisyCl, &times->endDiffTranspose, times->enabled);
-    times->transRot += timeDiff(times->startDiffTranspose, times->endDiffTranspose);
+  allocationSizes[9] = session->coarseBatchNo * coarseVolumeSize;
 
-#ifdef STOREOUTPUT
+  if(!fitsDeviceMemory(&device, daisyTarget->memoryBudget, "newMatchCatalogue", allocationNames, allocationSizes, 10)){
+    freeMatchSession(session, daisyCl);
+    return NULL;
+  }
 
-    clFinish(daisyCl->ioqueue);
+  session->diffBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                       allocationSizes[2], (void*)NULL, &error);
 
-    float * diffArray = (float*)malloc(sizeof(float) * coarseWidth * coarseHeight * rotationsNo);
+  if(!error)
+    session->coarseMinima = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                           session->coarseBatchNo * session->coarseGroupsNo * rotationsNo * sizeof(float),
+                                           (void*)NULL, &error);
 
-    error = clEnqueueReadBuffer(daisyCl->ioqueue, diffBufferTrans, CL_TRUE,
-                                0, coarseWidth * coarseHeight * rotationsNo * sizeof(float),
-                                diffArray, 0, NULL, NULL);
+  if(!error)
+    session->coarseArgmin = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                           session->coarseBatchNo * session->coarseGroupsNo * rotationsNo * sizeof(int),
+                                           (void*)NULL, &error);
 
-    if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (diffBufferTrans)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  if(!error)
+    session->templatePetals = clCreateBuffer(daisyCl->context, CL_MEM_READ_ONLY,
+                                             allocationSizes[3], (void*)NULL, &error);
 
-    clFinish(daisyCl->ioqueue);
+  if(!error)
+    session->argminBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                           session->argminBufferLength * sizeof(float),
+                                           (void*)NULL, &error);
 
-    char * fn = (char*) malloc(sizeof(char) * 200);
-    sprintf(fn, "%s-diff%02d.bin", daisyTarget->filename, templatePointNo);
+  if(!error)
+    session->corrsBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_ONLY,
+                                          allocationSizes[5], (void*)NULL, &error);
 
-    saveBinary(diffArray,coarseWidth*coarseHeight*rotationsNo,fn);
+  if(!error)
+    session->pinnedArgminBuffer = clCreateBuffer(daisyCl->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, 
+                                                 session->argminBufferLength * sizeof(float), NULL, &error);
 
-    free(diffArray);
+  if(!error)
+    session->middleArgminBuffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                                 middleArgminSize, (void*)NULL, &error);
 
-#endif
+  if(!error)
+    session->pinnedMiddleArgminBuffer = clCreateBuffer(daisyCl->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                                       middleArgminSize, NULL, &error);
 
+  if(oclErrorM("newMatchCatalogue","clCreateBuffer",error)){
+    freeMatchSession(session, daisyCl);
+    return NULL;
+  }
 
-    checkpoint(daisyCl, &times->startReduceCoarse1, times->enabled);
+  session->argmin = (float*) clEnqueueMapBuffer(daisyCl->ioqueue, session->pinnedArgminBuffer, 1,
+                                                CL_MAP_WRITE, 0, session->argminBufferLength * sizeof(float),
+                                                0, NULL, NULL, &error);
 
-    for(int rotation = 0; rotation < rotationsNo; rotation++){
+  if(oclErrorM("newMatchCatalogue","clEnqueueMapBuffer (pinnedArgmin)",error)){
+    session->argmin = NULL;
+    freeMatchSession(session, daisyCl);
+    return NULL;
+  }
 
-      const size_t wsoReduceMin = rotation * wsReduceMin;
+  session->middleArgmin = (float*) clEnqueueMapBuffer(daisyCl->ioqueue, session->pinnedMiddleArgminBuffer, 1,
+                                                      CL_MAP_WRITE, 0, middleArgminSize,
+                                                      0, NULL, NULL, &error);
 
-      // Find maximum for HxW of each rotation
-      error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisyTemplate->oclKernels->reduceMin, 1, 
-                                     &wsoReduceMin, &wsReduceMin, &wgsReduceMin,
-                                     0, NULL, NULL);
+  if(oclErrorM("newMatchCatalogue","clEnqueueMapBuffer (pinnedMiddleArgmin)",error)){
+    session->middleArgmin = NULL;
+    freeMatchSession(session, daisyCl);
+    return NULL;
+  }
 
-    }
+  bindMatchSession(session);
 
-    checkpoint(daisyCl, &times->endReduceCoarse1, times->enabled);
-    times->reduceMin += timeDiff(times->startReduceCoarse1, times->endReduceCoarse1);
+  gettimeofday(&end,NULL);
 
-    const size_t wsoReduceMinAll = templatePointNo;
+  session->difft = timeDiff(start,end);
 
-    // Find minima for each rotation
+  return session;
 
-    checkpoint(daisyCl, &times->startReduceCoarse2, times->enabled);
+}
 
-    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisyTemplate->oclKernels->reduceMinAll, 1, 
-                                   &wsoReduceMinAll, &wsReduceMinAll, &wgsReduceMinAll,
-                                   0, NULL, (templatePointNo == templatePointsNo-1 ? &lastReduction : NULL));
+void freeMatchSession(match_session * session, ocl_constructs * daisyCl){
 
-    checkpoint(daisyCl, &times->endReduceCoarse2, times->enabled);
-    times->reduceMinAll += timeDiff(times->startReduceCoarse2, times->endReduceCoarse2);
+  if(session->argmin != NULL){
+    clEnqueueUnmapMemObject(daisyCl->ioqueue, session->pinnedArgminBuffer, (void*)session->argmin, 0, NULL, NULL);
+    clFinish(daisyCl->ioqueue);
+  }
 
+  if(session->middleArgmin != NULL){
+    clEnqueueUnmapMemObject(daisyCl->ioqueue, session->pinnedMiddleArgminBuffer, (void*)session->middleArgmin, 0, NULL, NULL);
+    clFinish(daisyCl->ioqueue);
   }
 
-  error = clEnqueueReadBuffer(daisyCl->ioqueue, argminBuffer, CL_TRUE,
-                              0, argminBufferLength * sizeof(float), argmin,
-                              1, &lastReduction, NULL);
+  if(session->pinnedArgminBuffer != NULL) clReleaseMemObject(session->pinnedArgminBuffer);
+  if(session->argminBuffer != NULL) clReleaseMemObject(session->argminBuffer);
+  if(session->diffBuffer != NULL) clReleaseMemObject(session->diffBuffer);
+  if(session->corrsBuffer != NULL) clReleaseMemObject(session->corrsBuffer);
+  if(session->middleArgminBuffer != NULL) clReleaseMemObject(session->middleArgminBuffer);
+  if(session->pinnedMiddleArgminBuffer != NULL) clReleaseMemObject(session->pinnedMiddleArgminBuffer);
+  if(session->coarseMinima != NULL) clReleaseMemObject(session->coarseMinima);
+  if(session->coarseArgmin != NULL) clReleaseMemObject(session->coarseArgmin);
+  if(session->templatePetals != NULL) clReleaseMemObject(session->templatePetals);
+
+  if(session->templates[0]->oclKernels->matchSession == (void*)session)
+    session->templates[0]->oclKernels->matchSession = NULL;
+
+  free(session->templates);
+  free(session->templateGenerations);
+  free(session->tracking.transforms);
+  free(session->tracking.tracked);
+  free(session->templatePoints);
+  free(session->seedTemplatePoints);
+  free(session->corrs);
+  free(session);
 
-  //
-  // Process correspondences
-  //
+}
+
+// Makes the coarse layer of the next matches search only around where the
+// last ones found the templates, radius target pixels further in any
+// direction; until every template has been found with minVotes votes, and
+// whenever one gets fewer in its window, the whole target is searched.
+// A negative radius turns tracking off
+void trackMatchSession(match_session * session, float radius, int minVotes){
+
+  session->tracking.enabled = (radius >= 0);
+  session->tracking.radius = radius;
+  session->tracking.minVotes = minVotes;
+
+  for(int n = 0; n < session->templatesNo; n++)
+    session->tracking.tracked[n] = 0;
+
+}
+
+// One shot match, the session lives for this call only
+int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
+                  ocl_constructs * daisyCl, time_params * times, match_result * result){
+
+  match_session * session = newMatchSession(daisyTemplate, daisyTarget, daisyCl);
+
+  if(session == NULL) return CL_INVALID_VALUE;
+
+  int error = oclMatchDaisySession(session, daisyTarget, daisyCl, times, result);
+
+  freeMatchSession(session, daisyCl);
+
+  return error;
+
+}
+
+// candidate c of rotation r of template point i, best first
+#define CANDIDATE_PIXEL(r,c,i) argmin[((r) * candidatesNo + (c)) * argminStride + (i)]
+#define CANDIDATE_DIFF(r,c,i) argmin[(((r) + rotationsNo) * candidatesNo + (c)) * argminStride + (i)]
+
+// Mode of the rotations of the best candidates of a template's points, a
+// point whose best pixel is hardly better than its runner up weighs less
+// (reduceMinPlanes keeps no candidate near a better one, so the runner up
+// is the best minimum elsewhere);
+// rotationVotesArg gets the points that voted for each rotation
+int voteRotation(float * argmin, int argminStride, int templatePointsNo, int coarseRotationsNo,
+                 int * rotationVotes, int * rotationVotesArg){
+
+  const int rotationsNo = ROTATIONS_NO;
+  const int candidatesNo = COARSE_CANDIDATES_NO;
 
-  // 1. Get mode of rot of min(minima) of all template points
   int votedRotation = -1;
-  int rotationVotes[ROTATIONS_NO+2];
-  int rotationVotesArg[ROTATIONS_NO * templatePointsNo];
-  for(int i = 0; i < rotationsNo; i++)
+  float rotationWeights[ROTATIONS_NO];
+  for(int i = 0; i < rotationsNo; i++){
     rotationVotes[i] = 0;
+    rotationWeights[i] = 0;
+  }
 
   for(int i = 0; i < templatePointsNo; i++){
 
     int argrot = -1;
     float mind = 9999;
-    for(int r = 0; r < rotationsNo; r++){
-      if(argmin[(r+rotationsNo) * templatePointsNo + i] < mind){
-        mind = argmin[(r+rotationsNo) * templatePointsNo + i];
+    for(int r = 0; r < coarseRotationsNo; r++){
+      if(CANDIDATE_DIFF(r,0,i) < mind){
+        mind = CANDIDATE_DIFF(r,0,i);
         argrot = r;
       }
     }
     rotationVotesArg[argrot * templatePointsNo + rotationVotes[argrot]] = i;
     rotationVotes[argrot] += 1;
+    rotationWeights[argrot] += (candidatesNo > 1 && CANDIDATE_DIFF(argrot,1,i) > 0 ?
+                                1 - mind / CANDIDATE_DIFF(argrot,1,i) : 1);
 
   }
   rotationVotes[rotationsNo] = 0;
+  float votedWeight = -1;
   for(int r = 0; r < rotationsNo; r++){
-    if(rotationVotes[r] > rotationVotes[rotationsNo]){
+    if(rotationVotes[r] > 0 && rotationWeights[r] > votedWeight){
+      votedWeight = rotationWeights[r];
       rotationVotes[rotationsNo] = rotationVotes[r];
       votedRotation = r;
     }
   }
 
+  return votedRotation;
+
+}
+
+// Votes, projects and searches the middle layer for template templateNo of
+// the session, whose coarse candidates are already in session->argmin
+int matchSeeds(match_session * session, int templateNo, daisy_params * daisyTarget,
+               ocl_constructs * daisyCl, time_params * times, int coarseRotationsNo, match_result * result){
+
+  cl_int error = 0;
+
+  daisy_params * daisyTemplate = session->templates[templateNo];
+  ocl_daisy_kernels * kernels = session->templates[0]->oclKernels;
+
+  int templatePointsNo = session->templatePointsNo;
+  point * templatePoints = session->templatePoints + templateNo * templatePointsNo;
+
+  int seedTemplatePointsNo = session->seedTemplatePointsNo;
+  point * seedTemplatePoints = session->seedTemplatePoints + templateNo * seedTemplatePointsNo;
+
+  // the template's columns of the argmin buffer
+  float * argmin = session->argmin + templateNo * templatePointsNo;
+  int argminStride = session->coarsePointsNo;
+
+  int gridSpacing = pow(SUBSAMPLE_RATE,2);
+  point coarseTargetSize = { (float)session->coarseWidth, (float)session->coarseHeight };
+
+  int rotationsNoMiddle = DM_ROTATIONS_NO; // default is 4
+  int searchWidthMiddle = DM_SEARCH_WIDTH; // default is 32
+
+  cl_mem corrsBuffer = session->corrsBuffer;
+  cl_mem templateBuffer = session->templates[templateNo]->buffers[0];
+
+  if(templateBuffer != session->middleTemplateBuffer){
+    clSetKernelArg(kernels->diffMiddle, 0, sizeof(cl_mem), (void*)&templateBuffer);
+    clSetKernelArg(kernels->diffFine, 0, sizeof(cl_mem), (void*)&templateBuffer);
+    session->middleTemplateBuffer = templateBuffer;
+  }
+
+  const size_t wgsDiffMiddle[2] = { DM_WGX, 1 };
+  int targetPixelsPerWorkgroup = DM_WG_TARGETS_NO;
+  int workersPerTargetPixel = wgsDiffMiddle[0] / targetPixelsPerWorkgroup;
+
+  int seedChunkNo = session->seedChunkNo;
+  size_t wsDiffMiddle[2] = { (searchWidthMiddle * searchWidthMiddle * wgsDiffMiddle[0]) / targetPixelsPerWorkgroup, seedChunkNo };
+
+  // 5. Project them with the overall projection, then find 2 closest target descriptors
+  point * seedTargetPoints = (point*)malloc(sizeof(point) * seedTemplatePointsNo);
+
+  //
+  // Process correspondences
+  //
+
+  const int rotationsNo = ROTATIONS_NO;
+  const int candidatesNo = COARSE_CANDIDATES_NO;
+
+  // 1. Get mode of rot of min(minima) of all template points
+  int rotationVotes[ROTATIONS_NO+2];
+  int rotationVotesArg[ROTATIONS_NO * templatePointsNo];
+  int votedRotation = voteRotation(argmin, argminStride, templatePointsNo, coarseRotationsNo,
+                                   rotationVotes, rotationVotesArg);
+
   printf("| VotedRotation %d || Votes %d |\n",votedRotation,rotationVotes[votedRotation]);
 
   point targetSize = { (float)daisyTarget->paddedWidth, (float)daisyTarget->paddedHeight };
@@ -403,17 +663,15 @@ int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
   for(int i = 0; i < corrsNo; i++){
 
     if(VERBOSE)
-      printf("VotedRotation %d, templateMatch %d, PinnedArgmin %f\n",votedRotation,templateMatches[i],argmin[votedRotation * templatePointsNo + templateMatches[i]]);
+      printf("VotedRotation %d, templateMatch %d, PinnedArgmin %f\n",votedRotation,templateMatches[i],CANDIDATE_PIXEL(votedRotation,0,templateMatches[i]));
 
-    targetMatches[i] = (int)argmin[votedRotation * templatePointsNo + templateMatches[i]];
+    targetMatches[i] = upsampleCoarsePixel((int)CANDIDATE_PIXEL(votedRotation,0,templateMatches[i]),
+                                           coarseTargetSize, gridSpacing, targetSize);
 
   }
 
   // 3. Estimate object projection
   for(int i = 0; i < corrsNo; i++){
-    // upsample target points
-    targetMatches[i] = (floor(targetMatches[i] / coarseTargetSize.x) * gridSpacing * targetSize.x)
-                     + (targetMatches[i] % (int)coarseTargetSize.x) * gridSpacing;
 
     if(VERBOSE){
         printf("TargetMatch [%d,%d,%d]\n",targetMatches[i],
@@ -429,6 +687,24 @@ int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
 
   // Filter out some of the correspondences with the projection errors
   float PROJERROR_THRESH = 0.45;
+
+  // a point whose best pixel is off the projection takes its first runner up that is on it
+  for(int i = 0; i < corrsNo; i++){
+    for(int c = 1; c < candidatesNo && projectionErrors[i] >= PROJERROR_THRESH &&
+                   CANDIDATE_DIFF(votedRotation,c,templateMatches[i]) < CL_FLT_MAX; c++){
+
+      int candidate = upsampleCoarsePixel((int)CANDIDATE_PIXEL(votedRotation,c,templateMatches[i]),
+                                          coarseTargetSize, gridSpacing, targetSize);
+      float candidateError = projectionError(templatePoints[templateMatches[i]], candidate, targetSize, *t);
+
+      if(candidateError < PROJERROR_THRESH){
+        targetMatches[i] = candidate;
+        projectionErrors[i] = candidateError;
+      }
+
+    }
+  }
+
   int * filteredTemplateMatches = (int*)malloc(sizeof(int) * corrsNo);
   int * filteredMatches = (int*)malloc(sizeof(int) * corrsNo);
   int matchesNo = 0;
@@ -467,7 +743,7 @@ int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
                      filteredMatches, matchesNo, targetSize, t);
 
   // 6. Fill up the corrs buffer with template to target correspondences
-  float * corrs = (float*)malloc(sizeof(float) * seedTemplatePointsNo * 2);
+  float * corrs = session->corrs;
 
   for(int i = 0; i < seedTemplatePointsNo; i++){
 
@@ -483,7 +759,9 @@ int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
       bottomRight = { max(seedTargetPoints[i].x, bottomRight.x),
                       max(seedTargetPoints[i].y, bottomRight.y)};*/
 
-    corrs[i * 2] = floor(seedTemplatePoints[i].y) * daisyTemplate->paddedWidth + floor(seedTemplatePoints[i].x);
+    // cached templates hold the seed points after the coarse ones
+    corrs[i * 2] = (daisyTemplate->matchPointsOnly ? templatePointsNo + i :
+                    floor(seedTemplatePoints[i].y) * daisyTemplate->paddedWidth + floor(seedTemplatePoints[i].x));
     corrs[i * 2 + 1] = floor(seedTargetPoints[i].y) * daisyTarget->paddedWidth + floor(seedTargetPoints[i].x);
 
   }
@@ -513,69 +791,180 @@ int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
          spacingMiddle,
          seedTemplatePointsNo, rotationsNoMiddle);
 
-  int templateRuns = ceil(seedTemplatePointsNo / seedTemplatesPerRun);
+  // the fine layer runs on each chunk right after it, at the rotation of each seed's middle match
+  printf("C) FineLayer [%dx%d] - Search Resolution = 1 - Seeds = %d - Rotations = 1 - Sub-pixel\n",
+         DF_SEARCH_WIDTH, DF_SEARCH_WIDTH, seedTemplatePointsNo);
 
-  printf("\nWorkerSize = [%d,%d], WorkersPerPixel = %d, WorkgroupSize = [%d,%d]\n",
+  int chunksNo = (seedTemplatePointsNo + seedChunkNo - 1) / seedChunkNo;
+
+  printf("\nWorkerSize = [%d,%d], WorkersPerPixel = %d, WorkgroupSize = [%d,%d], Chunks = %d\n",
                       (int)wsDiffMiddle[0], (int)wsDiffMiddle[1],
-                      (int)workersPerTargetPixel, (int)wgsDiffMiddle[0], (int)wgsDiffMiddle[1]);
+                      (int)workersPerTargetPixel, (int)wgsDiffMiddle[0], (int)wgsDiffMiddle[1], chunksNo);
+
+#if defined(STOREOUTPUT) || defined(CPU_VERIFICATION)
+  int diffMiddleSize = seedTemplatePointsNo * searchWidthMiddle * searchWidthMiddle * rotationsNoMiddle;
 
-  for(int run = 0; run < templateRuns; run++){
+  // the chunks share diffBuffer, each is read back before the next overwrites it
+  float * diffMiddle = (float*) malloc(sizeof(float) * diffMiddleSize);
+#endif
 
-    cl_event corrTransfer;
+  cl_event * corrTransfers = (cl_event*)malloc(sizeof(cl_event) * chunksNo);
+  cl_event * chunkKernels = (cl_event*)malloc(sizeof(cl_event) * chunksNo);
 
-    clEnqueueWriteBuffer(daisyCl->ioqueue, corrsBuffer, CL_TRUE,
-                         0, seedTemplatesPerRun * 2 * sizeof(float), (void*) (corrs + seedTemplatesPerRun * 2 * run),
-                         0, NULL, &corrTransfer);
+  checkpoint(daisyCl, &times->startDiffMiddle, 1);
 
-    checkpoint(daisyCl, &times->startDiffMiddle, 1);
+  // reduceMiddle and diffFine, a group per seed of a chunk
+  const size_t wgsReduceMiddle = WGS_REDUCE_MIDDLE;
+  const size_t wgsDiffFine = WGS_DIFF_FINE;
 
-    for(int petalRegionNo = 2; petalRegionNo > -1; petalRegionNo--){
+  // oriented descriptors vote 0, the window still absorbs a dominant bin misjudged by one or two
+  int rotationNo = ((votedRotation-2) + ROTATIONS_NO) % ROTATIONS_NO;
+
+  clSetKernelArg(kernels->reduceMiddle, 4, sizeof(int), (void*)&rotationNo);
+
+  // the correspondences of a chunk go up through the out of order queue into
+  // the half of corrsBuffer the chunk before last was done with, so the upload
+  // overlaps the previous chunk's kernels on the in order one
+  for(int chunk = 0; chunk < chunksNo && !error; chunk++){
+
+    int firstSeed = chunk * seedChunkNo;
+    int chunkSeedsNo = min(seedChunkNo, seedTemplatePointsNo - firstSeed);
+    int templateNoOffset = (chunk % 2) * seedChunkNo;
+
+    error = clEnqueueWriteBuffer(daisyCl->ooqueue, corrsBuffer, CL_FALSE,
+                                 templateNoOffset * 2 * sizeof(float), chunkSeedsNo * 2 * sizeof(float),
+                                 (void*)(corrs + firstSeed * 2),
+                                 (chunk > 1 ? 1 : 0), (chunk > 1 ? &chunkKernels[chunk-2] : NULL),
+                                 &corrTransfers[chunk]);
+
+    // neither event of this chunk exists, only the chunks before it are released
+    if(oclErrorM("oclMatchDaisy","clEnqueueWriteBuffer (corrsBuffer)",error)){
+      chunksNo = chunk;
+      break;
+    }
+
+    clFlush(daisyCl->ooqueue);
+
+    wsDiffMiddle[1] = chunkSeedsNo;
+
+    for(int petalRegionNo = 2; petalRegionNo > -1 && !error; petalRegionNo--){
 
-      int rotationNo = ((votedRotation-2) + ROTATIONS_NO) % ROTATIONS_NO;
       int regionNo = petalRegionNo;
-      int templateNoOffset = seedTemplatesPerRun * run;
 
       int pixelSpacing = (regionNo == 2 ? 2 : 1);
 
-      clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 5, sizeof(float) * (DM_TARGETS_PER_LOOP / pixelSpacing) * (64 + 2), (void*) NULL);
-      clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 6, sizeof(int), (void*)&regionNo);
-      clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 7, sizeof(int), (void*)&rotationNo);
-      clSetKernelArg(daisyTemplate->oclKernels->diffMiddle, 8, sizeof(int), (void*)&templateNoOffset);
+      clSetKernelArg(kernels->diffMiddle, 5, sizeof(float) * (DM_TARGETS_PER_LOOP / pixelSpacing) * (64 + 2), (void*) NULL);
+      clSetKernelArg(kernels->diffMiddle, 6, sizeof(int), (void*)&regionNo);
+      clSetKernelArg(kernels->diffMiddle, 7, sizeof(int), (void*)&rotationNo);
+      clSetKernelArg(kernels->diffMiddle, 8, sizeof(int), (void*)&templateNoOffset);
+
+      // Compute diffMiddle, the first region of a chunk waits for its correspondences
+      error = clEnqueueNDRangeKernel(daisyCl->ioqueue, kernels->diffMiddle, 2,
+                                     NULL, wsDiffMiddle, wgsDiffMiddle,
+                                     (regionNo == 2 ? 1 : 0), (regionNo == 2 ? &corrTransfers[chunk] : NULL),
+                                     NULL);
 
-      //const size_t wsoDiffMiddle[2] = { 0, seedTemplatesPerRun * run };
+      if(oclErrorM("oclMatchDaisy","clEnqueueNDRangeKernel (diffMiddle)",error)) break;
 
-      // Compute diffMiddle
-      error = clEnqueueNDRangeKernel(daisyCl->ioqueue, daisyTemplate->oclKernels->diffMiddle, 2, 
-                                     NULL, wsDiffMiddle, wgsDiffMiddle, 
-                                     1, &corrTransfer, NULL);
+    }
+
+    // the best offset and rotation of each seed
+    if(!error){
+
+      const size_t wsReduceMiddle = chunkSeedsNo * wgsReduceMiddle;
+
+      clSetKernelArg(kernels->reduceMiddle, 5, sizeof(int), (void*)&templateNoOffset);
+      clSetKernelArg(kernels->reduceMiddle, 6, sizeof(int), (void*)&firstSeed);
+
+      error = clEnqueueNDRangeKernel(daisyCl->ioqueue, kernels->reduceMiddle, 1,
+                                     NULL, &wsReduceMiddle, &wgsReduceMiddle,
+                                     0, NULL, NULL);
+
+      oclErrorM("oclMatchDaisy","clEnqueueNDRangeKernel (reduceMiddle)",error);
+
+    }
+
+    // the fine layer around those, the last reader of the chunk's half of corrsBuffer
+    if(!error){
+
+      const size_t wsDiffFine = chunkSeedsNo * wgsDiffFine;
+
+      clSetKernelArg(kernels->diffFine, 7, sizeof(int), (void*)&templateNoOffset);
+      clSetKernelArg(kernels->diffFine, 8, sizeof(int), (void*)&firstSeed);
+
+      error = clEnqueueNDRangeKernel(daisyCl->ioqueue, kernels->diffFine, 1,
+                                     NULL, &wsDiffFine, &wgsDiffFine,
+                                     0, NULL, &chunkKernels[chunk]);
+
+      oclErrorM("oclMatchDaisy","clEnqueueNDRangeKernel (diffFine)",error);
 
     }
 
-    checkpoint(daisyCl, &times->endDiffMiddle, 1);
+    if(error){
+      clReleaseEvent(corrTransfers[chunk]);
+      chunksNo = chunk;
+      break;
+    }
+
+#if defined(STOREOUTPUT) || defined(CPU_VERIFICATION)
+
+    error = clEnqueueReadBuffer(daisyCl->ioqueue, session->diffBuffer, CL_TRUE,
+                                0, chunkSeedsNo * searchWidthMiddle * searchWidthMiddle * rotationsNoMiddle * sizeof(float),
+                                diffMiddle + firstSeed * searchWidthMiddle * searchWidthMiddle * rotationsNoMiddle,
+                                0, NULL, NULL);
+
+    if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (diffBuffer)",error)){
+      chunksNo = chunk + 1;
+      break;
+    }
+
+#endif
 
   }
-//  printf("Transform = [%.2f, %.2f, %.2f, %.2f]\n", t->th, t->s, t->tx, t->ty);
-  error = checkpoint(daisyCl, &times->endMatchDaisy, 1);
-  if(oclErrorM("oclMatchDaisy","clFinish(end)",error)) printf("oclMatchDaisy.cpp::clFinish(end) failed %d\n",error);//return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
-//  clFinish(daisyCl->ioqueue);
-  times->difft = timeDiff(times->startMatchDaisy,times->endMatchDaisy);
 
-  printf("Match: %.2f ms\n",times->difft);
+  // only the compact correspondences come back, never the distances
+  if(!error){
 
-#ifdef STOREOUTPUT
+    error = clEnqueueReadBuffer(daisyCl->ioqueue, session->middleArgminBuffer, CL_TRUE,
+                                0, seedTemplatePointsNo * (MIDDLE_ARGMIN_LENGTH + FINE_ARGMIN_LENGTH) * sizeof(float),
+                                session->middleArgmin,
+                                0, NULL, NULL);
 
-  int diffMiddleSize = seedTemplatePointsNo * searchWidthMiddle * searchWidthMiddle * rotationsNoMiddle;
+    oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (middleArgminBuffer)",error);
 
-  float * diffMiddle = (float*) malloc(sizeof(float) * diffMiddleSize);
+  }
+
+  // corrs is the next template's once the uploads are done
+  clFinish(daisyCl->ooqueue);
+  checkpoint(daisyCl, &times->endDiffMiddle, 1);
+
+  for(int chunk = 0; chunk < chunksNo; chunk++){
+    clReleaseEvent(corrTransfers[chunk]);
+    clReleaseEvent(chunkKernels[chunk]);
+  }
 
-  error = clEnqueueReadBuffer(daisyCl->ioqueue, diffBuffer, CL_TRUE,
-                              0, diffMiddleSize * sizeof(float), 
-                              diffMiddle, 0, NULL, NULL);
+  free(corrTransfers);
+  free(chunkKernels);
+
+  if(error){
+#if defined(STOREOUTPUT) || defined(CPU_VERIFICATION)
+    free(diffMiddle);
+#endif
+    free(seedTargetPoints);
+    free(targetMatches);
+    free(projectionErrors);
+    free(filteredTemplateMatches);
+    free(filteredMatches);
+    free(t);
+    return oclCleanUp(kernels,daisyCl,error);
+  }
+
+#ifdef STOREOUTPUT
 
   string fn = daisyTarget->filename;
   string sfx = "-coarseArgmin.bin";
 
-  saveBinary(argmin, argminBufferLength, fn+sfx);
+  saveBinary(session->argmin, session->argminBufferLength, fn+sfx);
 
   sfx = "-templatePoints.bin";
 
@@ -590,6 +979,10 @@ int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
 
   saveBinary(diffMiddle, diffMiddleSize, fn+sfx);
 
+  sfx = "-middleArgmin.bin";
+
+  saveBinary(session->middleArgmin, seedTemplatePointsNo * (MIDDLE_ARGMIN_LENGTH + FINE_ARGMIN_LENGTH), fn+sfx);
+
 #endif
 
 #ifdef CPU_VERIFICATION
@@ -597,243 +990,374 @@ int oclMatchDaisy(daisy_params * daisyTemplate, daisy_params * daisyTarget,
 // VERIFICATION CODE
 //
 
-  float * argminArray = (float*)malloc(sizeof(float) * templatePointsNo * rotationsNo);
-  float * diffArray = (float*)malloc(sizeof(float) * seedTemplatePointsNo * searchWidthMiddle * searchWidthMiddle * rotationsNoMiddle);
-  float * diffTransArray = (float*)malloc(sizeof(float) * coarseWidth * coarseHeight * rotationsNo);
-  float * petalArray = (float*)malloc(sizeof(float) * 3 * REGION_PETALS_NO * GRADIENTS_NO);
-  float * targetArray = (float*)malloc(sizeof(float) * (daisyTarget->paddedWidth * daisyTarget->paddedHeight * DESCRIPTOR_LENGTH));
-  float * templateArray = (float*)malloc(sizeof(float) * (daisyTarget->paddedWidth * daisyTarget->paddedHeight * DESCRIPTOR_LENGTH));
-
-  error = clEnqueueReadBuffer(daisyCl->ioqueue, diffBuffer, CL_TRUE,
-                              0, seedTemplatePointsNo * searchWidthMiddle * searchWidthMiddle * rotationsNoMiddle * sizeof(float), 
-                              diffArray, 0, NULL, NULL);
+  // the coarse distances never leave the work groups, only the middle layer is verified
+  cl_mem targetBuffer = session->targetBuffer;
 
-  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (diffBuffer)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
-
-  error = clEnqueueReadBuffer(daisyCl->ioqueue, diffBufferTrans, CL_TRUE,
-                              0, coarseWidth * coarseHeight * rotationsNo * sizeof(float), 
-                              diffTransArray, 0, NULL, NULL);
-
-  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (diffBufferTrans)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  float * targetArray = (float*)malloc(sizeof(float) * (daisyTarget->paddedWidth * daisyTarget->paddedHeight * DESCRIPTOR_LENGTH));
+  float * templateArray = (float*)malloc(sizeof(float) * (daisyTemplate->paddedWidth * daisyTemplate->paddedHeight * DESCRIPTOR_LENGTH));
 
   error = clEnqueueReadBuffer(daisyCl->ioqueue, targetBuffer, CL_TRUE,
                               0, (daisyTarget->paddedWidth * daisyTarget->paddedHeight * DESCRIPTOR_LENGTH) * sizeof(float), 
                               targetArray, 0, NULL, NULL);
 
-  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (targetBuffer)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (targetBuffer)",error)) return oclCleanUp(kernels,daisyCl,error);
  
   error = clEnqueueReadBuffer(daisyCl->ioqueue, templateBuffer, CL_TRUE,
                               0, (daisyTemplate->paddedWidth * daisyTemplate->paddedHeight * DESCRIPTOR_LENGTH) * sizeof(float), 
                               templateArray, 0, NULL, NULL);
 
-  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (templateBuffer)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (templateBuffer)",error)) return oclCleanUp(kernels,daisyCl,error);
 
-  error = clEnqueueReadBuffer(daisyCl->ioqueue, petalBuffer, CL_TRUE,
-                              0, 3 * REGION_PETALS_NO * GRADIENTS_NO * sizeof(float), 
-                              petalArray, 0, NULL, NULL);
+  gettimeofday(&times->startMatchCpu, NULL);
 
-  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (petalBuffer)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  long int issues = verifyDiffMiddle(daisyTarget, daisyTemplate, targetArray, templateArray, diffMiddle, 
+                                     searchWidthMiddle, corrs, votedRotation, seedTemplatePointsNo, rotationsNoMiddle);
+  printf("diffMiddle verification: %ld issues\n",issues);
 
-  error = clEnqueueReadBuffer(daisyCl->ioqueue, argminBuffer, CL_TRUE,
-                              0, templatePointsNo * rotationsNo * sizeof(float), 
-                              argminArray, 0, NULL, NULL);
+  gettimeofday(&times->endMatchCpu, NULL);
 
-  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (argminBuffer)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
+  free(targetArray);
+  free(templateArray);
 
-  gettimeofday(&times->startMatchCpu, NULL);
+#endif
 
-  long int issues;
-  for(int k = 0; k < templatePointsNo; k++){
-    issues = verifyDiffCoarse(daisyTarget, petalArray, targetArray, diffArray);
-    printf("diffCoarse verification: %ld issues (ignore if =512 and running reduceMin)\n",issues);
-  }
+#if defined(STOREOUTPUT) || defined(CPU_VERIFICATION)
+  free(diffMiddle);
+#endif
 
-  issues = verifyTransposeRotations(daisyTarget, diffArray, diffTransArray);
-  printf("transposeRotations verification: %ld issues (ignore if =512 and running reduceMin)\n",issues);
+  // a match with enough votes predicts where the template is in the next target
+  session->tracking.transforms[templateNo] = *t;
+  session->tracking.tracked[templateNo] = (rotationVotes[votedRotation] >= session->tracking.minVotes);
 
-  issues = verifyReduceMinAll(daisyTarget, diffTransArray, argminArray, templatePointsNo);
-  printf("reduceMin verification: %ld issues\n",issues);
+  if(result != NULL){
 
-  issues = verifyDiffMiddle(daisyTarget, daisyTemplate, targetArray, templateArray, diffArray, 
-                            searchWidthMiddle, corrs, votedRotation, seedTemplatePointsNo, rotationsNoMiddle);
-  printf("diffMiddle verification: %ld issues\n",issues);
+    // the caller owns the seed correspondences from here on, the grid stays with the session
+    result->t = *t;
+    result->votedRotation = votedRotation;
+    result->votes = rotationVotes[votedRotation];
+    result->matchesNo = matchesNo;
+    result->templatePoints = (point*)malloc(sizeof(point) * seedTemplatePointsNo);
+    memcpy(result->templatePoints, seedTemplatePoints, sizeof(point) * seedTemplatePointsNo);
+    result->targetPoints = seedTargetPoints;
+    result->ratios = (float*)malloc(sizeof(float) * seedTemplatePointsNo);
+    result->pointsNo = seedTemplatePointsNo;
 
-  gettimeofday(&times->endMatchCpu, NULL);
+    // the seeds move from their projections to where the fine layer put them
+    float * fineArgmin = session->middleArgmin + seedTemplatePointsNo * MIDDLE_ARGMIN_LENGTH;
 
-  free(diffArray);
-  free(petalArray);
-  free(targetArray);
+    for(int i = 0; i < seedTemplatePointsNo; i++){
 
-#endif
+      seedTargetPoints[i].x = fineArgmin[i * FINE_ARGMIN_LENGTH];
+      seedTargetPoints[i].y = fineArgmin[i * FINE_ARGMIN_LENGTH + 1];
+      result->ratios[i] = session->middleArgmin[i * MIDDLE_ARGMIN_LENGTH + 3];
+
+    }
 
-  // Uncomment when calling oclDaisy multiple times
-  error = clEnqueueUnmapMemObject(daisyCl->ioqueue, pinnedArgminBuffer, (void*)argmin, 0, NULL, NULL);
-  if(oclErrorM("oclDaisy","clEnqueueUnmapMemObject (pinned daisy)",error)) return oclCleanUp(daisyTemplate->oclKernels,daisyCl,error);
-//  free(argmin);
+    result->path = session->tracking.path;
 
-  clReleaseMemObject(pinnedArgminBuffer);
-  clReleaseMemObject(argminBuffer);
-  clReleaseMemObject(diffBuffer);
-  clReleaseMemObject(corrsBuffer);
-  clReleaseMemObject(diffBufferTrans);
+  }
+  else{
+    free(seedTargetPoints);
+  }
+
+  free(targetMatches);
+  free(projectionErrors);
+  free(filteredTemplateMatches);
+  free(filteredMatches);
+  free(t);
 
   return error;
 
 }
 
-long int verifyDiffCoarse(daisy_params * daisyTarget, float * petalArray, 
-                          float * targetArray, float * diffArray){
+// The coarse layer over the windowWidth x windowHeight coarse pixels at
+// (windowX,windowY) of the target, windowX and windowWidth multiples of 16;
+// leaves the candidates of every template point in session->argmin
+int matchCoarse(match_session * session, daisy_params * daisyTarget, ocl_constructs * daisyCl, time_params * times,
+                int coarseRotationsNo, int windowX, int windowY, int windowWidth, int windowHeight){
 
-  long int shown = 0;
-  long int issues = 0;
-  int rotationsNo = 8;
-  int subsample = 4;
-  int coarseWidth = daisyTarget->paddedWidth / subsample;
+  cl_int error = 0;
 
-  // thread vars
-  int targetY, targetX, rotation, p, g;
-  long int offsetToDescriptor, offsetToCoarseRegion;
-  int targetPetalNo, targetGradientNo;
-  float diff;
-  float gpudiff = -1;
-  float * targetDescriptor;
-  float * targetPetal;
-  float * targetPetalMiddle;
-  float * targetPetalFine;
+  ocl_daisy_kernels * kernels = session->templates[0]->oclKernels;
 
-  //#pragma omp parallel for private(targetY,targetX,rotation,p,g,offsetToDescriptor,offsetToCoarseRegion,targetPetalNo,targetGradientNo,diff,gpudiff,targetDescriptor,targetPetal,targetPetalMiddle,targetPetalFine)
-  for(targetY = subsample / 2 -1; targetY < daisyTarget->paddedHeight; targetY+=subsample){
+  int coarsePointsNo = session->coarsePointsNo;
 
-    for(targetX = subsample / 2 -1; targetX < daisyTarget->paddedWidth; targetX+=subsample){
-      
-      offsetToDescriptor = (targetY * daisyTarget->paddedWidth + targetX) * DESCRIPTOR_LENGTH;
-      offsetToCoarseRegion = (TOTAL_PETALS_NO - REGION_PETALS_NO) * GRADIENTS_NO;
-      targetDescriptor = targetArray + offsetToDescriptor;
-      targetPetal = targetDescriptor + offsetToCoarseRegion;
-      targetPetalMiddle = targetDescriptor + offsetToCoarseRegion - REGION_PETALS_NO * GRADIENTS_NO;
-      targetPetalFine = targetDescriptor + 1 * GRADIENTS_NO;
+  // diffCoarseBatched, a group per 16 target pixels of a row of the window, each
+  // leaves the minimum of its pixels for every rotation of every template point
+  const size_t wgsDiffCoarse[2] = {64, 1};
+  const size_t wsDiffCoarse[2] = {windowWidth * COARSE_WORKERS_PER_PIXEL, windowHeight};
+  const size_t wsoDiffCoarse[2] = {windowX * COARSE_WORKERS_PER_PIXEL, windowY};
 
-      for(rotation = 0; rotation < rotationsNo; rotation++){
+  // the partial minima are numbered from the window's first group
+  int windowGroupsNo = (windowWidth / 16) * windowHeight;
 
-        diff = 0.0;
+  // reduceMinPlanes, a group per rotation of each template point over the partial minima
+  const size_t wgsReduceMin = WGS_REDUCE_PLANES;
 
-        targetPetalNo = rotation;
-        targetGradientNo = rotation;
+  clSetKernelArg(kernels->reduceMinPlanes, 3, sizeof(int), (void*)&windowGroupsNo);
 
-        for(p = 0; p < REGION_PETALS_NO; p++){
+  cl_event lastReduction;
 
-          for(g = 0; g < GRADIENTS_NO; g++){
+  // the points of every template of a batch against the whole target in one
+  // launch, so the target is read once per batch however many templates there
+  // are; the batches are as large as the memory budget lets the partial minima be
+  for(int templateOffset = 0; templateOffset < coarsePointsNo; templateOffset += session->coarseBatchNo){
 
-            diff += fabs(petalArray[(p + 16) * GRADIENTS_NO + g] - 
+    int batchNo = min(session->coarseBatchNo, coarsePointsNo - templateOffset);
 
-                         targetPetal[((targetPetalNo + p) % REGION_PETALS_NO) * GRADIENTS_NO + 
-                                      (targetGradientNo + g) % GRADIENTS_NO]);
+    checkpoint(daisyCl, &times->startDiffCoarse, times->enabled);
 
-            diff += fabs(petalArray[(p + 8) * GRADIENTS_NO + g] - 
+    clSetKernelArg(kernels->diffCoarseBatched, 5, sizeof(int), (void*)&batchNo);
+    clSetKernelArg(kernels->diffCoarseBatched, 6, sizeof(int), (void*)&coarseRotationsNo);
+    clSetKernelArg(kernels->diffCoarseBatched, 7, sizeof(int), (void*)&templateOffset);
 
-                         targetPetalMiddle[((targetPetalNo + p) % REGION_PETALS_NO) * GRADIENTS_NO + 
-                                           (targetGradientNo + g) % GRADIENTS_NO]);
-   
-            diff += fabs(petalArray[p * GRADIENTS_NO + g] - 
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, kernels->diffCoarseBatched, 2,
+                                   wsoDiffCoarse, wsDiffCoarse, wgsDiffCoarse,
+                                   0, NULL, NULL);
 
-                           targetPetalFine[((targetPetalNo + p) % REGION_PETALS_NO) * GRADIENTS_NO + 
-                                           (targetGradientNo + g) % GRADIENTS_NO]);
+    if(oclErrorM("oclMatchDaisy","clEnqueueNDRangeKernel (diffCoarseBatched)",error)) return oclCleanUp(kernels,daisyCl,error);
 
-          }
+    checkpoint(daisyCl, &times->endDiffCoarse, times->enabled);
+    times->diffCoarse += timeDiff(times->startDiffCoarse, times->endDiffCoarse);
 
-        }
-        diffArray[((targetY / subsample) * coarseWidth + targetX / subsample) * rotationsNo + rotation] += diff;
-        if(fabs(gpudiff - diff) > 0.0001){
-          issues++;
-//          if(shown++ < 100){
-//            printf("X,Y,R = %d,%d,%d | CPU = %.3f and GPU = %.3f\n",targetX / subsample,targetY/subsample,rotation,diff,gpudiff);
-//          }
-        }
-        else if(0 && shown++ < 200)
-          printf("X,Y,R = %d,%d,%d | CPU = %.3f and GPU = %.3f\n",targetX / subsample,targetY/subsample,rotation,diff,gpudiff);
+#ifdef STOREOUTPUT
 
-      }
+    clFinish(daisyCl->ioqueue);
+
+    int partialsNo = windowGroupsNo * coarseRotationsNo;
+    float * minimaArray = (float*)malloc(sizeof(float) * partialsNo);
+
+    for(int t = 0; t < batchNo; t++){
+
+      error = clEnqueueReadBuffer(daisyCl->ioqueue, session->coarseMinima, CL_TRUE,
+                                  t * partialsNo * sizeof(float), partialsNo * sizeof(float),
+                                  minimaArray, 0, NULL, NULL);
+
+      if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (coarseMinima)",error)) return oclCleanUp(kernels,daisyCl,error);
+
+      char * fn = (char*) malloc(sizeof(char) * 200);
+      sprintf(fn, "%s-minima%02d.bin", daisyTarget->filename, templateOffset + t);
+
+      saveBinary(minimaArray,partialsNo,fn);
+
+      free(fn);
 
     }
 
+    free(minimaArray);
+
+#endif
+
+    // Find the minimum of each rotation of each template point
+    checkpoint(daisyCl, &times->startReduceCoarse1, times->enabled);
+
+    const size_t wsReduceMin = batchNo * coarseRotationsNo * wgsReduceMin;
+
+    clSetKernelArg(kernels->reduceMinPlanes, 4, sizeof(int), (void*)&coarseRotationsNo);
+    clSetKernelArg(kernels->reduceMinPlanes, 5, sizeof(int), (void*)&templateOffset);
+
+    error = clEnqueueNDRangeKernel(daisyCl->ioqueue, kernels->reduceMinPlanes, 1,
+                                   NULL, &wsReduceMin, &wgsReduceMin,
+                                   0, NULL, (templateOffset + batchNo == coarsePointsNo ? &lastReduction : NULL));
+
+    if(oclErrorM("oclMatchDaisy","clEnqueueNDRangeKernel (reduceMinPlanes)",error)) return oclCleanUp(kernels,daisyCl,error);
+
+    checkpoint(daisyCl, &times->endReduceCoarse1, times->enabled);
+    times->reduceMin += timeDiff(times->startReduceCoarse1, times->endReduceCoarse1);
+
   }
 
-  return issues;
+  error = clEnqueueReadBuffer(daisyCl->ioqueue, session->argminBuffer, CL_TRUE,
+                              0, session->argminBufferLength * sizeof(float), session->argmin,
+                              1, &lastReduction, NULL);
+
+  clReleaseEvent(lastReduction);
+
+  if(oclErrorM("oclMatchDaisy","clEnqueueReadBuffer (argminBuffer)",error)) return oclCleanUp(kernels,daisyCl,error);
+
+  return 0;
 
 }
 
-long int verifyTransposeRotations(daisy_params * daisyTarget, float * diffArray, float * diffTransArray){
+// Bounding box in coarse pixels of where the templates' last matches put them
+// in the next target, grown by the tracking radius; 0 when any template is
+// not tracked or the box is empty, the whole target is searched then
+short int predictCoarseWindow(match_session * session, int * windowX, int * windowY, int * windowWidth, int * windowHeight){
 
-  long int issues = 0;
+  match_tracking * tracking = &session->tracking;
 
-  int rotationsNo = ROTATIONS_NO;
-  int subsample = 4;
-  int coarseHeight = daisyTarget->paddedHeight / subsample;
-  int coarseWidth = daisyTarget->paddedWidth / subsample;
+  if(!tracking->enabled) return 0;
 
-  int rotation, targetY, targetX;
-  float cpuTrans, gpuTrans;
+  int gridSpacing = pow(SUBSAMPLE_RATE,2);
 
-  //#pragma omp parallel for private(rotation,targetY,targetX,cpuTrans,gpuTrans)
-  for(rotation = 0; rotation < rotationsNo; rotation++){
+  float x0 = session->targetWidth, y0 = session->targetHeight, x1 = 0, y1 = 0;
 
-    for(targetY = 0; targetY < coarseHeight; targetY++){
+  for(int n = 0; n < session->templatesNo; n++){
 
-      for(targetX = 0; targetX < coarseWidth; targetX++){
+    if(!tracking->tracked[n]) return 0;
 
-          cpuTrans = diffArray[(targetY * coarseWidth + targetX) * rotationsNo + rotation];
-          gpuTrans = diffTransArray[rotation * coarseHeight * coarseWidth + targetY * coarseWidth + targetX];
+    daisy_params * daisyTemplate = session->templates[n];
 
-          // imitate a memory store
-          diffTransArray[rotation * coarseHeight * coarseWidth + targetY * coarseWidth + targetX] = cpuTrans;
+    point corners[4] = {{0, 0}, {(float)daisyTemplate->width, 0},
+                        {(float)daisyTemplate->width, (float)daisyTemplate->height}, {0, (float)daisyTemplate->height}};
 
-          if(fabs(cpuTrans - gpuTrans) > 0.001){
-            issues++;
-            //if(issues < 100)
-            //  printf("R,Y,X = %d,%d,%d | CPU TRANS = %f | GPU TRANS = %f\n", rotation,targetY,targetX,cpuTrans,gpuTrans);
-          }
+    for(int c = 0; c < 4; c++){
 
-      }
+      point p;
+      projectPoint(corners[c], tracking->transforms[n], &p);
+
+      x0 = min(x0, p.x); y0 = min(y0, p.y);
+      x1 = max(x1, p.x); y1 = max(y1, p.y);
 
     }
 
   }
 
-  return issues;
+  // whole groups of 16 coarse pixels across, as diffCoarseBatched works in
+  int cx0 = max(0, (int)floor((x0 - tracking->radius) / gridSpacing));
+  int cy0 = max(0, (int)floor((y0 - tracking->radius) / gridSpacing));
+  int cx1 = min(session->coarseWidth, (int)ceil((x1 + tracking->radius) / gridSpacing) + 1);
+  int cy1 = min(session->coarseHeight, (int)ceil((y1 + tracking->radius) / gridSpacing) + 1);
+
+  cx0 = (cx0 / 16) * 16;
+  cx1 = min(session->coarseWidth, roundUp(cx1, 16));
+
+  if(cx1 <= cx0 || cy1 <= cy0) return 0;
+
+  *windowX = cx0;
+  *windowY = cy0;
+  *windowWidth = cx1 - cx0;
+  *windowHeight = cy1 - cy0;
+
+  return 1;
 
 }
 
-long int verifyReduceMinAll(daisy_params * daisyTarget, float * diffArray, float * minArray, int templatePointsNo){
+// Matches every template of the session against daisyTarget, results (if
+// not NULL) holds one match_result per template in the session's order
+int oclMatchDaisySession(match_session * session, daisy_params * daisyTarget,
+                         ocl_constructs * daisyCl, time_params * times, match_result * results){
+
+  cl_int error = 0;
+
+  ocl_daisy_kernels * kernels = session->templates[0]->oclKernels;
+
+  if(daisyTarget->paddedWidth != session->targetWidth || daisyTarget->paddedHeight != session->targetHeight ||
+     daisyTarget->roiWidth){
+    fprintf(stderr, "oclMatchDaisy.cpp::oclMatchDaisySession needs whole %dx%d targets, as the session was made for\n",
+                    session->targetHeight, session->targetWidth);
+    return CL_INVALID_VALUE;
+  }
+
+  // another session may have left its arguments in the kernels
+  if(kernels->matchSession != (void*)session)
+    bindMatchSession(session);
+
+  // oclDaisy and loadTemplateCache count every extraction, a released buffer's
+  // handle may come back for the next one so it cannot tell them apart
+  for(int n = 0; n < session->templatesNo; n++){
+
+    if(session->templates[n]->generation != session->templateGenerations[n]){
+
+      error = gatherTemplatePetals(session, n, daisyCl);
+      if(error) return oclCleanUp(kernels,daisyCl,error);
+
+      session->templateGenerations[n] = session->templates[n]->generation;
+
+    }
+
+  }
+
+  cl_mem targetBuffer = daisyTarget->buffers[0];
+
+  if(targetBuffer != session->targetBuffer){
+    clSetKernelArg(kernels->diffCoarseBatched, 1, sizeof(cl_mem), (void*)&targetBuffer);
+    clSetKernelArg(kernels->diffMiddle, 1, sizeof(cl_mem), (void*)&targetBuffer);
+    clSetKernelArg(kernels->diffFine, 1, sizeof(cl_mem), (void*)&targetBuffer);
+    session->targetBuffer = targetBuffer;
+  }
 
-  long int issues = 0;
   int rotationsNo = ROTATIONS_NO;
-  int subsample = 4;
-  int diffArrayLengthPerRotation = (daisyTarget->paddedWidth / subsample) * (daisyTarget->paddedHeight / subsample);
 
-  int rotation, i;
-  float min, gpumin;
-  float argmin = -1;
-  //#pragma omp parallel for private(rotation,min,argmin,gpumin,i)
-  for(rotation = 0; rotation < rotationsNo; rotation++){
+  // descriptors normalised to their dominant orientation match at rotation 0,
+  // the coarse layer then compares and reduces that rotation only
+  short int oriented = daisyTarget->orientDescriptors;
 
-    min = 999;
+  for(int n = 0; n < session->templatesNo; n++)
+    oriented = oriented && session->templates[n]->orientDescriptors;
+
+  int coarseRotationsNo = (oriented ? 1 : rotationsNo);
+
+  match_tracking * tracking = &session->tracking;
+
+  int windowX = 0, windowY = 0;
+  int windowWidth = session->coarseWidth, windowHeight = session->coarseHeight;
+
+  tracking->path = (predictCoarseWindow(session, &windowX, &windowY, &windowWidth, &windowHeight) ?
+                    MATCH_PATH_WINDOW : MATCH_PATH_FULL);
+
+  printf("\nA) CoarseLayer [%dx%d] - Search Resolution %d - Seeds %d - Templates %d - Rotations %d%s\n",
+         windowHeight,windowWidth,(int)pow(SUBSAMPLE_RATE,2),session->coarsePointsNo,session->templatesNo,coarseRotationsNo,
+         (tracking->path == MATCH_PATH_WINDOW ? " - Tracking window" : ""));
+
+  checkpoint(daisyCl, &times->startMatchDaisy, 1);
+
+  error = matchCoarse(session, daisyTarget, daisyCl, times, coarseRotationsNo, windowX, windowY, windowWidth, windowHeight);
+  if(error) return error;
+
+  // a template that got too few votes in its window may have moved further, search the whole target
+  if(tracking->path == MATCH_PATH_WINDOW){
+
+    short int lost = 0;
+
+    for(int n = 0; n < session->templatesNo && !lost; n++){
+
+      int rotationVotes[ROTATIONS_NO+2];
+      int rotationVotesArg[ROTATIONS_NO * session->templatePointsNo];
+
+      int votedRotation = voteRotation(session->argmin + n * session->templatePointsNo, session->coarsePointsNo,
+                                       session->templatePointsNo, coarseRotationsNo, rotationVotes, rotationVotesArg);
+
+      lost = (rotationVotes[votedRotation] < tracking->minVotes);
 
-    for(i = 0; i < diffArrayLengthPerRotation; i++){
-      if(diffArray[rotation * diffArrayLengthPerRotation + i] < min){
-        min = diffArray[rotation * diffArrayLengthPerRotation + i];
-        argmin = i;
-      }
     }
 
-    // verify min
-    gpumin = minArray[rotation*templatePointsNo+templatePointsNo-1];
-      printf("(%s) RotationNo = %d | CPU argmin = %f (%f)| GPU argmin = %f (%f)\n",(argmin==gpumin?"PASS":"FAIL"),
-                      rotation,argmin,min,gpumin,diffArray[rotation*diffArrayLengthPerRotation+(int)gpumin]);
-    if(argmin!=gpumin) issues++;
+    if(lost){
+
+      printf("| Tracking lost, searching the whole target |\n");
+
+      tracking->path = MATCH_PATH_FALLBACK;
+      windowX = windowY = 0;
+      windowWidth = session->coarseWidth;
+      windowHeight = session->coarseHeight;
+
+      error = matchCoarse(session, daisyTarget, daisyCl, times, coarseRotationsNo, windowX, windowY, windowWidth, windowHeight);
+      if(error) return error;
+
+    }
 
   }
 
-  return issues; 
+  tracking->windowX = windowX;
+  tracking->windowY = windowY;
+  tracking->windowWidth = windowWidth;
+  tracking->windowHeight = windowHeight;
+
+  // the rest goes through the templates one at a time, sharing the middle layer's buffers
+  for(int n = 0; n < session->templatesNo && !error; n++)
+    error = matchSeeds(session, n, daisyTarget, daisyCl, times, coarseRotationsNo, (results != NULL ? results + n : NULL));
+
+  if(error) return error;
+
+//  printf("Transform = [%.2f, %.2f, %.2f, %.2f]\n", t->th, t->s, t->tx, t->ty);
+  error = checkpoint(daisyCl, &times->endMatchDaisy, 1);
+  if(oclErrorM("oclMatchDaisy","clFinish(end)",error)) printf("oclMatchDaisy.cpp::clFinish(end) failed %d\n",error);//return oclCleanUp(kernels,daisyCl,error);
+//  clFinish(daisyCl->ioqueue);
+  times->difft = timeDiff(times->startMatchDaisy,times->endMatchDaisy);
+
+  printf("Match: %.2f ms\n",times->difft);
+
+  return error;
 
 }
 
@@ -4,6 +4,105 @@
 #define ROTATIONS_NO 8
 //#define CPU_VERIFICATION
 
+// How the coarse layer searched the target
+#define MATCH_PATH_FULL 0      // the whole target
+#define MATCH_PATH_WINDOW 1    // the window the previous matches predict
+#define MATCH_PATH_FALLBACK 2  // the window first, then the whole target as it got too few votes
+
+// Floats per seed reduceMiddle leaves in middleArgmin, and diffFine after all of those
+#define MIDDLE_ARGMIN_LENGTH 4
+#define FINE_ARGMIN_LENGTH 4
+
+// Votes a tracked template needs in its window before the whole target is searched again
+#ifndef TRACK_MIN_VOTES
+#define TRACK_MIN_VOTES 6
+#endif
+
+// What the matcher found, in unpadded pixel coordinates of template and target
+#ifndef MATCH_RESULT
+#define MATCH_RESULT
+typedef struct match_result_tag{
+  transform t;            // template to target similarity of the coarse layer
+  int votedRotation;
+  int votes;
+  int matchesNo;          // coarse correspondences kept after projection filtering
+  point * templatePoints; // seeds of the middle layer
+  point * targetPoints;   // where the fine layer found each of them, between pixels
+  float * ratios;         // best over second best middle layer distance, lower is more distinctive
+  int pointsNo;
+  int path;               // MATCH_PATH_* the coarse layer took
+} match_result;
+#endif
+
+// Tracking state of a session, see trackMatchSession. Each template's last
+// transform predicts where it is in the next target, the coarse layer then
+// only searches the bounding box of those predictions grown by radius
+#ifndef MATCH_TRACKING
+#define MATCH_TRACKING
+typedef struct match_tracking_tag{
+  short int enabled;
+  float radius;           // target pixels a template may move beyond its prediction
+  int minVotes;           // fewer votes for any template in the window search the whole target again
+  transform * transforms; // last match of each template
+  short int * tracked;    // that match had minVotes votes, so transforms predicts it
+  int path;               // MATCH_PATH_* of the last match
+  int windowX;            // coarse pixels the last match searched, multiples of 16 across
+  int windowY;
+  int windowWidth;
+  int windowHeight;
+} match_tracking;
+#endif
+
+// Buffers, pinned argmin and template grids of a catalogue of templates
+// matched against targets of one padded size; created once, every match then
+// only uploads its correspondences and rebinds the descriptor buffers that
+// changed. The coarse points of all templates are compared in the same
+// launches, so each target is read once for the whole catalogue
+#ifndef MATCH_SESSION
+#define MATCH_SESSION
+typedef struct match_session_tag{
+  daisy_params ** templates;
+  int templatesNo;
+  int targetWidth;             // padded size of the targets the buffers are sized for
+  int targetHeight;
+  int coarseWidth;
+  int coarseHeight;
+  point * templatePoints;      // coarse grids, templatePointsNo per template back to back
+  int templatePointsNo;
+  int coarsePointsNo;          // of the whole catalogue
+  point * seedTemplatePoints;  // middle layer grids, likewise
+  int seedTemplatePointsNo;
+  cl_mem diffBuffer;           // middle layer distances of a chunk of seeds
+  int seedChunkNo;             // seeds per middle layer chunk
+  cl_mem coarseMinima;         // of a batch, template x rotation x group of 16 target pixels
+  cl_mem coarseArgmin;         // coarse pixel of each of those minima
+  int coarseGroupsNo;          // groups of 16 target pixels in the coarse plane
+  cl_mem templatePetals;       // rings of the coarse points of every template, gathered
+  int coarseBatchNo;           // template points per coarse launch
+  cl_mem argminBuffer;
+  cl_mem corrsBuffer;          // two chunks of correspondences, uploaded in turns
+  cl_mem pinnedArgminBuffer;
+  float * argmin;              // pinnedArgminBuffer mapped
+  int argminBufferLength;
+  float * corrs;
+  cl_mem middleArgminBuffer;   // target pixel, rotation, distance and ratio of each seed, then its fine match
+  cl_mem pinnedMiddleArgminBuffer;
+  float * middleArgmin;        // pinnedMiddleArgminBuffer mapped
+  unsigned int * templateGenerations; // daisy_params.generation each template's rings were gathered from
+  cl_mem middleTemplateBuffer; // descriptors the kernels were last given
+  cl_mem targetBuffer;
+  match_tracking tracking;
+  double difft;                // ms to set the session up
+} match_session;
+#endif
+
 int initOclMatch(daisy_params *, ocl_constructs *);
-int oclMatchDaisy(daisy_params *, daisy_params *, ocl_constructs *, time_params *);
+match_session * newMatchSession(daisy_params *, daisy_params *, ocl_constructs *);
+match_session * newMatchCatalogue(daisy_params **, int, daisy_params *, ocl_constructs *);
+void freeMatchSession(match_session *, ocl_constructs *);
+void trackMatchSession(match_session *, float, int);
+int oclMatchDaisySession(match_session *, daisy_params *, ocl_constructs *, time_params *, match_result *);
+int oclMatchDaisy(daisy_params *, daisy_params *, ocl_constructs *, time_params *, match_result *);
+void freeMatchResult(match_result *);
+point * generateTemplatePoints(daisy_params *, int, int, int);
 
@@ -0,0 +1,204 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: pyramid.cpp
+
+*/
+
+#include "pyramid.h"
+#include "general.h"
+
+int oclErrorP(const char * function, const char * functionCall, int error){
+
+  if(error){
+    fprintf(stderr, "pyramid.cpp::%s %s failed: %d\n",function,functionCall,error);
+    return error;
+  }
+
+  return 0;
+
+}
+
+// Up to octavesNo octaves of base, fewer when they would get smaller than PYRAMID_MIN_SIZE
+daisy_pyramid * newDaisyPyramid(daisy_params * base, int octavesNo){
+
+  daisy_pyramid * pyramid = (daisy_pyramid*)malloc(sizeof(daisy_pyramid));
+
+  pyramid->octaves[0] = base;
+  pyramid->octavesNo = 1;
+  pyramid->gradients[0] = pyramid->gradients[1] = NULL;
+  pyramid->gradientsSize = 0;
+  pyramid->difft = 0;
+
+  octavesNo = min(octavesNo, PYRAMID_MAX_OCTAVES);
+
+  for(int o = 1; o < octavesNo; o++){
+
+    int height = base->height >> o;
+    int width = base->width >> o;
+
+    if(height < PYRAMID_MIN_SIZE || width < PYRAMID_MIN_SIZE) break;
+
+    daisy_params * octave = newDaisyParams(base->filename, NULL, height, width, base->cpuTransfer);
+
+    free(octave->oclKernels);
+    octave->oclKernels = base->oclKernels;
+    memcpy(octave->smoothingModes, base->smoothingModes, sizeof(base->smoothingModes));
+    octave->memoryBudget = base->memoryBudget;
+    octave->halfStorage = base->halfStorage;
+    octave->padding = base->padding;
+    octave->orientDescriptors = base->orientDescriptors;
+
+    pyramid->octaves[pyramid->octavesNo++] = octave;
+
+  }
+
+  return pyramid;
+
+}
+
+// Releases the octaves above 0 and their descriptors, octave 0 stays with the caller
+void freeDaisyPyramid(daisy_pyramid * pyramid){
+
+  for(int o = 1; o < pyramid->octavesNo; o++){
+
+    daisy_params * octave = pyramid->octaves[o];
+
+    daisyReleaseBuffers(octave);
+
+    if(octave->cpuTransfer && octave->plan.sectionsNo > 1)
+      free(octave->descriptors);
+
+    free(octave->buffers);
+    free(octave->filename);
+    free(octave);
+
+  }
+
+  if(pyramid->gradients[0] != NULL) clReleaseMemObject(pyramid->gradients[0]);
+  if(pyramid->gradients[1] != NULL) clReleaseMemObject(pyramid->gradients[1]);
+
+  free(pyramid);
+
+}
+
+// Writes the gradients of octave from those of previous, octave->gradients
+// has to hold its planes laid out as oclDaisy pads them with every layer FIR
+int downsampleGradients(daisy_params * previous, daisy_params * octave, ocl_constructs * daisyCl){
+
+  cl_int error;
+
+  int padding = max(octave->padding, 1);
+  int width = roundUp(octave->width, padding);
+  int height = roundUp(octave->height, padding);
+  int halfStorage = octave->halfStorage;
+
+  size_t downGradWorkerSize[2] = {roundUp(width, 16), height * octave->gradientsNo};
+  size_t downGradGroupSize[2] = {16, 8};
+
+  clSetKernelArg(octave->oclKernels->downGrad, 0, sizeof(cl_mem), (void*)&previous->gradients);
+  clSetKernelArg(octave->oclKernels->downGrad, 1, sizeof(cl_mem), (void*)&octave->gradients);
+  clSetKernelArg(octave->oclKernels->downGrad, 2, sizeof(int), (void*)&previous->paddedWidth);
+  clSetKernelArg(octave->oclKernels->downGrad, 3, sizeof(int), (void*)&previous->paddedHeight);
+  clSetKernelArg(octave->oclKernels->downGrad, 4, sizeof(int), (void*)&width);
+  clSetKernelArg(octave->oclKernels->downGrad, 5, sizeof(int), (void*)&height);
+  clSetKernelArg(octave->oclKernels->downGrad, 6, sizeof(int), (void*)&halfStorage);
+
+  error = clEnqueueNDRangeKernel(daisyCl->ioqueue, octave->oclKernels->downGrad, 2, NULL,
+                                 downGradWorkerSize, downGradGroupSize, 0,
+                                 NULL, NULL);
+
+  if(oclErrorP("downsampleGradients","clEnqueueNDRangeKernel (downGrad)",error)) return oclCleanUp(octave->oclKernels,daisyCl,error);
+
+  error = clFinish(daisyCl->ioqueue);
+  if(oclErrorP("downsampleGradients","clFinish",error)) return oclCleanUp(octave->oclKernels,daisyCl,error);
+
+  return 0;
+
+}
+
+// Extracts every octave in one call. Octave 0 keeps its gradients, the next
+// octave is downsampled from them and so on, so denoising, the gradients and
+// the input transfer are done once for the whole pyramid; each octave then
+// runs the cascade and the descriptor transposition at its own size.
+// Needs all FIR layers, the descriptors of each octave end up where oclDaisy
+// leaves them (octaves[o]->buffers or ->descriptors).
+int oclDaisyPyramid(daisy_pyramid * pyramid, ocl_constructs * daisyCl, time_params * times){
+
+  cl_int error = 0;
+
+  daisy_params * base = pyramid->octaves[0];
+
+  for(int i = 0; i < base->smoothingsNo; i++){
+    if(base->smoothingModes[i] != SMOOTHING_FIR){
+      fprintf(stderr, "pyramid.cpp::oclDaisyPyramid needs every layer FIR\n");
+      return CL_INVALID_VALUE;
+    }
+  }
+
+  struct timeval start, end;
+  gettimeofday(&start,NULL);
+
+  // the planes of octave 1 are the largest that take turns in the two buffers
+  if(pyramid->octavesNo > 1 && pyramid->gradients[0] == NULL){
+
+    daisy_params * octave = pyramid->octaves[1];
+
+    int padding = max(octave->padding, 1);
+
+    pyramid->gradientsSize = (unsigned long int)roundUp(octave->width, padding) * roundUp(octave->height, padding) *
+                             octave->gradientsNo * (octave->halfStorage ? sizeof(cl_half) : sizeof(cl_float));
+
+    for(int b = 0; b < 2 && b < pyramid->octavesNo-1; b++){
+
+      pyramid->gradients[b] = clCreateBuffer(daisyCl->context, CL_MEM_READ_WRITE,
+                                             pyramid->gradientsSize, NULL, &error);
+
+      if(oclErrorP("oclDaisyPyramid","clCreateBuffer (gradients)",error)) return oclCleanUp(base->oclKernels,daisyCl,error);
+
+    }
+
+  }
+
+  for(int o = 0; o < pyramid->octavesNo && !error; o++){
+
+    daisy_params * octave = pyramid->octaves[o];
+
+    daisyReleaseBuffers(octave);
+
+    if(o > 0){
+
+      daisy_params * previous = pyramid->octaves[o-1];
+
+      octave->gradients = pyramid->gradients[(o-1) % 2];
+
+      error = downsampleGradients(previous, octave, daisyCl);
+
+      // octave 0's gradients were its massBuffer, the others belong to the pyramid
+      if(o == 1) clReleaseMemObject(previous->gradients);
+      previous->gradients = NULL;
+
+      if(error) break;
+
+    }
+
+    octave->keepGradients = (o == 0 && pyramid->octavesNo > 1);
+
+    error = oclDaisy(octave, daisyCl, times);
+
+    octave->keepGradients = 0;
+
+  }
+
+  pyramid->octaves[pyramid->octavesNo-1]->gradients = NULL;
+
+  gettimeofday(&end,NULL);
+
+  pyramid->difft = timeDiff(start,end);
+
+  return error;
+
+}
@@ -0,0 +1,39 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: pyramid.h
+
+*/
+
+#include "oclDaisy.h"
+
+#define PYRAMID_MAX_OCTAVES 8
+
+// Octaves stop before either side gets shorter than this
+#define PYRAMID_MIN_SIZE 32
+
+// Descriptors of an image and of its octaves at half, quarter, ... the size.
+// Octave 0 is the image's own daisy_params, the others share its kernels
+// and settings; only octave 0 reads the input, every other octave starts
+// from gradients downsampled on the device from those of the octave before
+#ifndef DAISY_PYRAMID
+#define DAISY_PYRAMID
+typedef struct daisy_pyramid_tag{
+  daisy_params * octaves[PYRAMID_MAX_OCTAVES];
+  int octavesNo;
+  cl_mem gradients[2];   // planes of octaves 1, 2, ... taking turns, sized for octave 1
+  unsigned long int gradientsSize;
+  double difft;          // ms of the last oclDaisyPyramid call
+} daisy_pyramid;
+#endif
+
+daisy_pyramid * newDaisyPyramid(daisy_params *, int);
+
+void freeDaisyPyramid(daisy_pyramid *);
+
+int downsampleGradients(daisy_params *, daisy_params *, ocl_constructs *);
+
+int oclDaisyPyramid(daisy_pyramid *, ocl_constructs *, time_params *);
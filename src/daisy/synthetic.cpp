@@ -0,0 +1,443 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: synthetic.cpp
+
+*/
+
+#include "synthetic.h"
+#include "kutility/math.h"
+#include "kutility/image.h"
+#include "kutility/corecv.h"
+#include "general.h"
+
+using kutility::bilinear_interpolation;
+using kutility::scale;
+using kutility::point_transform_via_homography;
+using kutility::save_image;
+
+const char * syntheticPatternNames[SYNTH_PATTERNS_NO] = {"ramp", "noise", "checker", "texture"};
+const char * warpNames[WARPS_NO] = {"none", "similarity", "homography"};
+
+// xorshift32, so that the images are the same on every platform for a given seed
+unsigned int nextRandom(unsigned int * state){
+
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+
+  return x;
+
+}
+
+int parseSyntheticPattern(const char * name){
+
+  for(int i = 0; i < SYNTH_PATTERNS_NO; i++)
+    if(!strcmp(name, syntheticPatternNames[i]))
+      return i;
+
+  return -1;
+
+}
+
+const char * syntheticPatternName(int pattern){
+
+  if(pattern < 0 || pattern >= SYNTH_PATTERNS_NO) return "unknown";
+
+  return syntheticPatternNames[pattern];
+
+}
+
+// Sum of value noise octaves (cell sizes 64 down to 4) bilinearly interpolated,
+// gives blob and edge structure at all the scales the descriptor looks at
+void generateTexture(unsigned char * image, int height, int width, unsigned int * state){
+
+  float * acc = (float*)malloc(sizeof(float) * height * width);
+
+  for(int i = 0; i < height * width; i++)
+    acc[i] = 0;
+
+  float amplitude = 1.0f;
+  float amplitudes = 0;
+
+  for(int cell = 64; cell >= 4; cell /= 2){
+
+    int gridHeight = height / cell + 2;
+    int gridWidth = width / cell + 2;
+
+    float * grid = (float*)malloc(sizeof(float) * gridHeight * gridWidth);
+
+    for(int i = 0; i < gridHeight * gridWidth; i++)
+      grid[i] = (nextRandom(state) % 1024) / 1023.0f;
+
+    for(int y = 0; y < height; y++)
+      for(int x = 0; x < width; x++)
+        acc[y * width + x] += amplitude * bilinear_interpolation(grid, gridWidth, x / (float)cell, y / (float)cell);
+
+    amplitudes += amplitude;
+    amplitude *= 0.6f;
+
+    free(grid);
+
+  }
+
+  for(int i = 0; i < height * width; i++)
+    image[i] = (unsigned char)min(255.0f, max(0.0f, 255.0f * acc[i] / amplitudes));
+
+  free(acc);
+
+}
+
+unsigned char * generateSyntheticImage(int pattern, int height, int width, unsigned int seed){
+
+  unsigned char * image = (unsigned char*)malloc(sizeof(unsigned char) * height * width);
+
+  unsigned int state = (seed ? seed : 1);
+
+  switch(pattern){
+
+    case SYNTH_RAMP:
+      for(int i = 0; i < height * width; i++)
+        image[i] = i % 255;
+      break;
+
+    case SYNTH_NOISE:
+      for(int i = 0; i < height * width; i++)
+        image[i] = nextRandom(&state) % 256;
+      break;
+
+    case SYNTH_CHECKER:
+      for(int y = 0; y < height; y++)
+        for(int x = 0; x < width; x++)
+          image[y * width + x] = (((y / 16) + (x / 16)) % 2 ? 224 : 32);
+      break;
+
+    case SYNTH_TEXTURE:
+      generateTexture(image, height, width, &state);
+      break;
+
+    default:
+      free(image);
+      return NULL;
+
+  }
+
+  return image;
+
+}
+
+unsigned char * cropImage(unsigned char * image, int height, int width,
+                          int top, int left, int cropHeight, int cropWidth){
+
+  if(top < 0 || left < 0 || top + cropHeight > height || left + cropWidth > width)
+    return NULL;
+
+  unsigned char * crop = (unsigned char*)malloc(sizeof(unsigned char) * cropHeight * cropWidth);
+
+  for(int y = 0; y < cropHeight; y++)
+    memcpy(crop + y * cropWidth, image + (top + y) * width + left, cropWidth);
+
+  return crop;
+
+}
+
+// Half the size of image, smoothed with the [1 3 3 1]/8 binomial that a pyramid
+// downsamples the gradients of each octave with
+unsigned char * halveImage(unsigned char * image, int height, int width){
+
+  int halfHeight = height / 2;
+  int halfWidth = width / 2;
+
+  const float taps[4] = {0.125f, 0.375f, 0.375f, 0.125f};
+
+  unsigned char * half = (unsigned char*)malloc(sizeof(unsigned char) * halfHeight * halfWidth);
+
+  for(int y = 0; y < halfHeight; y++)
+    for(int x = 0; x < halfWidth; x++){
+
+      float sum = 0;
+
+      for(int j = 0; j < 4; j++){
+
+        unsigned char * row = image + min(max(2 * y - 1 + j, 0), height-1) * width;
+
+        for(int i = 0; i < 4; i++)
+          sum += taps[j] * taps[i] * row[min(max(2 * x - 1 + i, 0), width-1)];
+
+      }
+
+      half[y * halfWidth + x] = (unsigned char)min(255.0f, sum + 0.5f);
+
+    }
+
+  return half;
+
+}
+
+int parseWarp(const char * name){
+
+  for(int i = 0; i < WARPS_NO; i++)
+    if(!strcmp(name, warpNames[i]))
+      return i;
+
+  return -1;
+
+}
+
+const char * warpName(int warp){
+
+  if(warp < 0 || warp >= WARPS_NO) return "unknown";
+
+  return warpNames[warp];
+
+}
+
+double randomUniform(unsigned int * state, double low, double high){
+
+  return low + (high - low) * (nextRandom(state) % 65536) / 65535.0;
+
+}
+
+// C = A * B for row major 3x3 matrices
+void multiplyHomography(double * A, double * B, double * C){
+
+  for(int r = 0; r < 3; r++)
+    for(int c = 0; c < 3; c++)
+      C[r * 3 + c] = A[r * 3] * B[c] + A[r * 3 + 1] * B[3 + c] + A[r * 3 + 2] * B[6 + c];
+
+}
+
+// H maps template pixels to target pixels. The template centre lands near the
+// target centre and the warped template stays inside the target.
+void randomHomography(double * H, int warp, int templateHeight, int templateWidth,
+                      int targetHeight, int targetWidth, unsigned int seed){
+
+  unsigned int state = (seed ? seed : 1);
+
+  double th = 0;
+  double s = 1;
+  double px = 0, py = 0;
+  double dx = 0, dy = 0;
+
+  if(warp != WARP_NONE){
+
+    th = randomUniform(&state, -M_PI, M_PI);
+    s = randomUniform(&state, 0.9, 1.1);
+
+    // keep the rotated template bounds inside the target
+    double radius = s * sqrt(templateHeight * templateHeight + templateWidth * templateWidth) / 2;
+    double maxDx = max(0.0, targetWidth / 2.0 - radius);
+    double maxDy = max(0.0, targetHeight / 2.0 - radius);
+
+    dx = randomUniform(&state, -maxDx, maxDx);
+    dy = randomUniform(&state, -maxDy, maxDy);
+
+  }
+
+  if(warp == WARP_HOMOGRAPHY){
+
+    // at the template borders the projective scale varies by up to 15%
+    double p = 0.3 / max(templateHeight, templateWidth);
+    px = randomUniform(&state, -p, p);
+    py = randomUniform(&state, -p, p);
+
+  }
+
+  double centre[9] = {1, 0, -templateWidth / 2.0,
+                      0, 1, -templateHeight / 2.0,
+                      0, 0, 1};
+
+  double perspective[9] = {1, 0, 0,
+                           0, 1, 0,
+                           px, py, 1};
+
+  double similarity[9] = {s * cos(th), -s * sin(th), targetWidth / 2.0 + dx,
+                          s * sin(th),  s * cos(th), targetHeight / 2.0 + dy,
+                          0, 0, 1};
+
+  double P[9];
+  multiplyHomography(perspective, centre, P);
+  multiplyHomography(similarity, P, H);
+
+  for(int i = 0; i < 9; i++)
+    H[i] /= H[8];
+
+}
+
+int invertHomography(double * H, double * Hinv){
+
+  double det = H[0] * (H[4] * H[8] - H[5] * H[7])
+             - H[1] * (H[3] * H[8] - H[5] * H[6])
+             + H[2] * (H[3] * H[7] - H[4] * H[6]);
+
+  if(fabs(det) < 1e-12) return 1;
+
+  Hinv[0] =  (H[4] * H[8] - H[5] * H[7]) / det;
+  Hinv[1] = -(H[1] * H[8] - H[2] * H[7]) / det;
+  Hinv[2] =  (H[1] * H[5] - H[2] * H[4]) / det;
+  Hinv[3] = -(H[3] * H[8] - H[5] * H[6]) / det;
+  Hinv[4] =  (H[0] * H[8] - H[2] * H[6]) / det;
+  Hinv[5] = -(H[0] * H[5] - H[2] * H[3]) / det;
+  Hinv[6] =  (H[3] * H[7] - H[4] * H[6]) / det;
+  Hinv[7] = -(H[0] * H[7] - H[1] * H[6]) / det;
+  Hinv[8] =  (H[0] * H[4] - H[1] * H[3]) / det;
+
+  return 0;
+
+}
+
+// Inverse mapping of every target pixel into the image, pixels that fall outside
+// of it come from the background (or are black without one)
+unsigned char * warpImage(unsigned char * image, int height, int width, double * H,
+                          unsigned char * background, int targetHeight, int targetWidth){
+
+  double Hinv[9];
+
+  if(invertHomography(H, Hinv)) return NULL;
+
+  unsigned char * warped = (unsigned char*)malloc(sizeof(unsigned char) * targetHeight * targetWidth);
+
+  for(int y = 0; y < targetHeight; y++){
+    for(int x = 0; x < targetWidth; x++){
+
+      double u, v;
+      point_transform_via_homography(Hinv, x, y, u, v);
+
+      int i = y * targetWidth + x;
+
+      if(u >= 0 && v >= 0 && u < width - 1 && v < height - 1)
+        warped[i] = (unsigned char)min(255.0f, bilinear_interpolation(image, width, (float)u, (float)v) + 0.5f);
+      else
+        warped[i] = (background != NULL ? background[i] : 0);
+
+    }
+  }
+
+  return warped;
+
+}
+
+// Template of the given pattern warped with a random transform into a target
+// whose background is an unrelated texture. Returns the target, H maps template
+// pixels to target pixels.
+unsigned char * generateWarpedPair(int pattern, int warp, int templateHeight, int templateWidth,
+                                   int targetHeight, int targetWidth, unsigned int seed,
+                                   unsigned char ** templateImage, double * H){
+
+  unsigned char * templ = generateSyntheticImage(pattern, templateHeight, templateWidth, seed);
+
+  if(templ == NULL) return NULL;
+
+  randomHomography(H, warp, templateHeight, templateWidth, targetHeight, targetWidth, seed);
+
+  unsigned char * background = generateSyntheticImage(pattern, targetHeight, targetWidth, seed ^ 0x9e3779b9);
+
+  unsigned char * source = templ;
+  int sourceHeight = templateHeight;
+  int sourceWidth = templateWidth;
+
+  double Hsource[9];
+  for(int i = 0; i < 9; i++)
+    Hsource[i] = H[i];
+
+  // shrink the template first when the warp minifies it to avoid aliasing,
+  // scale() leaves the last row and column empty so they are cropped out
+  float sc = sqrt(fabs(H[0] * H[4] - H[1] * H[3]));
+
+  if(sc < 0.95f){
+
+    int scaledHeight = (int)(templateHeight * sc);
+    int scaledWidth = (int)(templateWidth * sc);
+
+    unsigned char * scaled = (unsigned char*)malloc(sizeof(unsigned char) * scaledHeight * scaledWidth);
+    scale(templ, templateHeight, templateWidth, sc, scaled, scaledHeight, scaledWidth);
+
+    sourceHeight = scaledHeight - 1;
+    sourceWidth = scaledWidth - 1;
+    source = cropImage(scaled, scaledHeight, scaledWidth, 0, 0, sourceHeight, sourceWidth);
+
+    free(scaled);
+
+    double unscale[9] = {1.0 / sc, 0, 0,
+                         0, 1.0 / sc, 0,
+                         0, 0, 1};
+
+    multiplyHomography(H, unscale, Hsource);
+
+  }
+
+  unsigned char * target = warpImage(source, sourceHeight, sourceWidth, Hsource,
+                                     background, targetHeight, targetWidth);
+
+  if(source != templ) free(source);
+  free(background);
+
+  *templateImage = templ;
+
+  return target;
+
+}
+
+// Writes <prefix>-template.pgm, <prefix>-target.pgm and <prefix>-H.txt, the
+// latter holds the template and target sizes and the row major homography
+int writeWarpedPair(const char * prefix, unsigned char * templateImage, int templateHeight, int templateWidth,
+                    unsigned char * targetImage, int targetHeight, int targetWidth, double * H){
+
+  char filename[1024];
+
+  snprintf(filename, sizeof(filename), "%s-template.pgm", prefix);
+  save_image(filename, templateImage, templateHeight, templateWidth, 1);
+
+  snprintf(filename, sizeof(filename), "%s-target.pgm", prefix);
+  save_image(filename, targetImage, targetHeight, targetWidth, 1);
+
+  snprintf(filename, sizeof(filename), "%s-H.txt", prefix);
+
+  FILE * fp = fopen(filename, "w");
+
+  if(fp == NULL){
+    fprintf(stderr, "synthetic.cpp::writeWarpedPair cannot open %s\n", filename);
+    return 1;
+  }
+
+  fprintf(fp, "%d %d %d %d\n", templateHeight, templateWidth, targetHeight, targetWidth);
+
+  for(int r = 0; r < 3; r++)
+    fprintf(fp, "%.12g %.12g %.12g\n", H[r * 3], H[r * 3 + 1], H[r * 3 + 2]);
+
+  fclose(fp);
+
+  return 0;
+
+}
+
+int loadHomography(const char * filename, double * H){
+
+  FILE * fp = fopen(filename, "r");
+
+  if(fp == NULL){
+    fprintf(stderr, "synthetic.cpp::loadHomography cannot open %s\n", filename);
+    return 1;
+  }
+
+  int sizes[4];
+  int read = fscanf(fp, "%d %d %d %d", sizes, sizes + 1, sizes + 2, sizes + 3);
+
+  for(int i = 0; i < 9; i++)
+    read += fscanf(fp, "%lf", H + i);
+
+  fclose(fp);
+
+  if(read != 13){
+    fprintf(stderr, "synthetic.cpp::loadHomography %s is not a ground truth file\n", filename);
+    return 1;
+  }
+
+  return 0;
+
+}
@@ -0,0 +1,59 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: synthetic.h
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Synthetic input patterns for benchmarking
+#define SYNTH_RAMP 0    // i % 255, what the old profileSpeed used
+#define SYNTH_NOISE 1   // uniform white noise
+#define SYNTH_CHECKER 2 // 16x16 checkerboard
+#define SYNTH_TEXTURE 3 // multi-octave value noise, closest to natural images
+#define SYNTH_PATTERNS_NO 4
+
+// Ground truth warps of the synthetic matching pairs
+#define WARP_NONE 0       // template is a crop of the target, pure translation
+#define WARP_SIMILARITY 1 // rotation, scale and translation
+#define WARP_HOMOGRAPHY 2 // similarity with a mild perspective distortion
+#define WARPS_NO 3
+
+unsigned char * generateSyntheticImage(int pattern, int height, int width, unsigned int seed);
+
+int parseSyntheticPattern(const char * name);
+
+const char * syntheticPatternName(int pattern);
+
+unsigned char * cropImage(unsigned char * image, int height, int width,
+                          int top, int left, int cropHeight, int cropWidth);
+
+unsigned char * halveImage(unsigned char * image, int height, int width);
+
+int parseWarp(const char * name);
+
+const char * warpName(int warp);
+
+void randomHomography(double * H, int warp, int templateHeight, int templateWidth,
+                      int targetHeight, int targetWidth, unsigned int seed);
+
+int invertHomography(double * H, double * Hinv);
+
+unsigned char * warpImage(unsigned char * image, int height, int width, double * H,
+                          unsigned char * background, int targetHeight, int targetWidth);
+
+unsigned char * generateWarpedPair(int pattern, int warp, int templateHeight, int templateWidth,
+                                   int targetHeight, int targetWidth, unsigned int seed,
+                                   unsigned char ** templateImage, double * H);
+
+int writeWarpedPair(const char * prefix, unsigned char * templateImage, int templateHeight, int templateWidth,
+                    unsigned char * targetImage, int targetHeight, int targetWidth, double * H);
+
+int loadHomography(const char * filename, double * H);
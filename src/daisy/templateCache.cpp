@@ -0,0 +1,243 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: templateCache.cpp
+
+*/
+
+#include "templateCache.h"
+#include "general.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+int oclErrorC(const char * function, const char * functionCall, int error){
+
+  if(error){
+    fprintf(stderr, "templateCache.cpp::%s %s failed: %d\n",function,functionCall,error);
+    return error;
+  }
+
+  return 0;
+
+}
+
+unsigned long long fnv1a(unsigned long long hash, const void * data, size_t size){
+
+  const unsigned char * bytes = (const unsigned char*)data;
+
+  for(size_t i = 0; i < size; i++){
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+
+}
+
+// Hash of the template's pixels and of every setting its matcher descriptors
+// depend on, the DAISY parameters the kernels are built with included
+unsigned long long templateCacheKey(daisy_params * daisyTemplate){
+
+  int settings[SMOOTHINGS_NO + 10] = {daisyTemplate->width, daisyTemplate->height, max(daisyTemplate->padding, 1),
+                                      daisyTemplate->halfStorage, daisyTemplate->orientDescriptors,
+                                      COARSE_TEMPLATES_NO, MIDDLE_TEMPLATES_NO, DESCRIPTOR_LENGTH, SUBSAMPLE_RATE,
+                                      GRADIENTS_NO};
+
+  for(int i = 0; i < SMOOTHINGS_NO; i++)
+    settings[10 + i] = daisyTemplate->smoothingModes[i];
+
+  float sigmas[4] = {SIGMA_DEN, SIGMA_A, SIGMA_B, SIGMA_C};
+
+  unsigned long long key = fnv1a(FNV_OFFSET, daisyTemplate->array, (size_t)daisyTemplate->width * daisyTemplate->height);
+
+  key = fnv1a(key, settings, sizeof(settings));
+
+  return fnv1a(key, sigmas, sizeof(sigmas));
+
+}
+
+// name has to hold the template's filename and 24 more characters
+void templateCacheName(daisy_params * daisyTemplate, char * name){
+
+  sprintf(name, "%s-%016llx.tcache", daisyTemplate->filename, templateCacheKey(daisyTemplate));
+
+}
+
+// Writes the descriptors of the matcher's points of a template oclDaisy has
+// just extracted whole into buffers[0], 0 on success
+int saveTemplateCache(daisy_params * daisyTemplate, ocl_constructs * daisyCl){
+
+  cl_int error = 0;
+
+  if(daisyTemplate->buffersSize < 1 || daisyTemplate->plan.sectionsNo > 1 ||
+     daisyTemplate->roiWidth || daisyTemplate->matchPointsOnly){
+    fprintf(stderr, "templateCache.cpp::saveTemplateCache needs the descriptors of the whole template in one buffer\n");
+    return CL_INVALID_VALUE;
+  }
+
+  // the padding of the header is written too
+  template_cache_header header;
+  memset(&header, 0, sizeof(header));
+
+  memcpy(header.magic, TEMPLATE_CACHE_MAGIC, sizeof(header.magic));
+  header.key = templateCacheKey(daisyTemplate);
+  header.width = daisyTemplate->width;
+  header.height = daisyTemplate->height;
+  header.paddedWidth = daisyTemplate->paddedWidth;
+  header.paddedHeight = daisyTemplate->paddedHeight;
+  header.coarsePointsNo = COARSE_TEMPLATES_NO;
+  header.seedPointsNo = MIDDLE_TEMPLATES_NO;
+  header.descriptorLength = DESCRIPTOR_LENGTH;
+
+  int pointsNo = header.coarsePointsNo + header.seedPointsNo;
+
+  // the grids the matcher generates, coarse then seed
+  point * points = (point*)malloc(sizeof(point) * pointsNo);
+
+  point * grid = generateTemplatePoints(daisyTemplate, header.coarsePointsNo, 0, 0);
+  memcpy(points, grid, sizeof(point) * header.coarsePointsNo);
+  free(grid);
+
+  grid = generateTemplatePoints(daisyTemplate, header.seedPointsNo, 0, 0);
+  memcpy(points + header.coarsePointsNo, grid, sizeof(point) * header.seedPointsNo);
+  free(grid);
+
+  float * descriptors = (float*)malloc(sizeof(float) * pointsNo * DESCRIPTOR_LENGTH);
+
+  for(int i = 0; i < pointsNo && !error; i++){
+
+    size_t descriptorNo = (size_t)points[i].y * daisyTemplate->paddedWidth + points[i].x;
+
+    error = clEnqueueReadBuffer(daisyCl->ioqueue, daisyTemplate->buffers[0], CL_FALSE,
+                                descriptorNo * DESCRIPTOR_LENGTH * sizeof(float), DESCRIPTOR_LENGTH * sizeof(float),
+                                descriptors + i * DESCRIPTOR_LENGTH, 0, NULL, NULL);
+
+  }
+
+  if(!error)
+    error = clFinish(daisyCl->ioqueue);
+
+  if(oclErrorC("saveTemplateCache","clEnqueueReadBuffer (descriptors)",error)){
+    free(points);
+    free(descriptors);
+    return error;
+  }
+
+  char * name = (char*)malloc(sizeof(char) * (strlen(daisyTemplate->filename) + 32));
+  templateCacheName(daisyTemplate, name);
+
+  FILE * fp = fopen(name, "wb");
+
+  short int written = (fp != NULL &&
+                       fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                       fwrite(points, sizeof(point), pointsNo, fp) == (size_t)pointsNo &&
+                       fwrite(descriptors, sizeof(float), pointsNo * DESCRIPTOR_LENGTH, fp) == (size_t)pointsNo * DESCRIPTOR_LENGTH);
+
+  if(fp != NULL) fclose(fp);
+
+  if(!written){
+    fprintf(stderr, "templateCache.cpp::saveTemplateCache could not write %s\n", name);
+    remove(name);
+  }
+
+  free(name);
+  free(points);
+  free(descriptors);
+
+  return (written ? 0 : CL_INVALID_VALUE);
+
+}
+
+// Uploads the cached descriptors of a template (pixels in array, settings as
+// it would be extracted with) to buffers[0] instead of running oclDaisy on
+// it; non-zero and daisyTemplate untouched when there is no valid cache
+int loadTemplateCache(daisy_params * daisyTemplate, ocl_constructs * daisyCl){
+
+  cl_int error = 0;
+
+  char * name = (char*)malloc(sizeof(char) * (strlen(daisyTemplate->filename) + 32));
+  templateCacheName(daisyTemplate, name);
+
+  FILE * fp = fopen(name, "rb");
+
+  if(fp == NULL){
+    free(name);
+    return CL_INVALID_VALUE;
+  }
+
+  template_cache_header header;
+
+  int padding = max(daisyTemplate->padding, 1);
+
+  short int valid = (fread(&header, sizeof(header), 1, fp) == 1 &&
+                     !memcmp(header.magic, TEMPLATE_CACHE_MAGIC, sizeof(header.magic)) &&
+                     header.key == templateCacheKey(daisyTemplate) &&
+                     header.width == daisyTemplate->width && header.height == daisyTemplate->height &&
+                     header.paddedWidth == roundUp(daisyTemplate->width, padding) &&
+                     header.paddedHeight == roundUp(daisyTemplate->height, padding) &&
+                     header.coarsePointsNo == COARSE_TEMPLATES_NO && header.seedPointsNo == MIDDLE_TEMPLATES_NO &&
+                     header.descriptorLength == DESCRIPTOR_LENGTH);
+
+  int pointsNo = (valid ? header.coarsePointsNo + header.seedPointsNo : 0);
+
+  point * points = (point*)malloc(sizeof(point) * pointsNo);
+  float * descriptors = (float*)malloc(sizeof(float) * pointsNo * DESCRIPTOR_LENGTH);
+
+  valid = valid &&
+          fread(points, sizeof(point), pointsNo, fp) == (size_t)pointsNo &&
+          fread(descriptors, sizeof(float), pointsNo * DESCRIPTOR_LENGTH, fp) == (size_t)pointsNo * DESCRIPTOR_LENGTH;
+
+  fclose(fp);
+
+  // the matcher generates its grids again, they have to be the cached ones
+  for(int layer = 0; layer < 2 && valid; layer++){
+
+    int first = (layer ? header.coarsePointsNo : 0);
+    int gridNo = (layer ? header.seedPointsNo : header.coarsePointsNo);
+
+    point * grid = generateTemplatePoints(daisyTemplate, gridNo, 0, 0);
+    valid = !memcmp(grid, points + first, sizeof(point) * gridNo);
+    free(grid);
+
+  }
+
+  if(!valid){
+    fprintf(stderr, "templateCache.cpp::loadTemplateCache %s does not match the template, extract it again\n", name);
+    free(name);
+    free(points);
+    free(descriptors);
+    return CL_INVALID_VALUE;
+  }
+
+  unsigned long int size = (unsigned long int)pointsNo * DESCRIPTOR_LENGTH * sizeof(float);
+
+  cl_mem buffer = clCreateBuffer(daisyCl->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                 size, descriptors, &error);
+
+  free(name);
+  free(points);
+  free(descriptors);
+
+  if(oclErrorC("loadTemplateCache","clCreateBuffer (descriptors)",error)) return error;
+
+  daisyReleaseBuffers(daisyTemplate);
+
+  daisyTemplate->buffers[daisyTemplate->buffersSize++] = buffer;
+  daisyTemplate->paddedWidth = header.paddedWidth;
+  daisyTemplate->paddedHeight = header.paddedHeight;
+  daisyTemplate->matchPointsOnly = 1;
+  daisyTemplate->generation++;
+
+  memset(&daisyTemplate->plan, 0, sizeof(memory_plan));
+  daisyTemplate->plan.sectionSize = size;
+  daisyTemplate->plan.sectionsNo = 1;
+  daisyTemplate->plan.buffersNo = 1;
+  daisyTemplate->plan.fits = 1;
+
+  return 0;
+
+}
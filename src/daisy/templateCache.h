@@ -0,0 +1,40 @@
+/*
+
+  Project  : DAISY in OpenCL
+  Author   : Ioannis Panousis - ip223@bath.ac.uk
+  Creation : October/2026
+
+  File: templateCache.h
+
+*/
+
+#include "oclMatchDaisy.h"
+
+#define TEMPLATE_CACHE_MAGIC "DAISYTC1"
+
+// Header of a template cache file, followed by the coarse then the seed
+// points (x,y floats) and their descriptors in the same order. The key
+// hashes the template's pixels and every setting its descriptors depend on,
+// the file is named after it next to the image
+#ifndef TEMPLATE_CACHE_HEADER
+#define TEMPLATE_CACHE_HEADER
+typedef struct template_cache_header_tag{
+  char magic[8];
+  unsigned long long key;
+  int width;
+  int height;
+  int paddedWidth;
+  int paddedHeight;
+  int coarsePointsNo;
+  int seedPointsNo;
+  int descriptorLength;
+} template_cache_header;
+#endif
+
+unsigned long long templateCacheKey(daisy_params *);
+
+void templateCacheName(daisy_params *, char *);
+
+int saveTemplateCache(daisy_params *, ocl_constructs *);
+
+int loadTemplateCache(daisy_params *, ocl_constructs *);
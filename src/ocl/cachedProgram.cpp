@@ -9,6 +9,7 @@
 */
 #include "ocl/cachedProgram.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 cl_program CreateProgram(cl_context context, cl_device_id device, 
                          const char * clFilename, const char * options){
@@ -28,9 +29,15 @@ cl_program CreateProgram(cl_context context, cl_device_id device,
 
   }
 
-  char srcStr[65536];
+  // read the whole source, the kernels file has outgrown any fixed size buffer
+  fseek(fp, 0, SEEK_END);
+  long int srcSize = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  char * srcStr = (char*)malloc(sizeof(char) * (srcSize + 1));
 
-  error = (cl_int)fread(srcStr, 1, 65536, fp);
+  srcSize = (long int)fread(srcStr, 1, srcSize, fp);
+  srcStr[srcSize] = '\0';
 
   fclose(fp);
 
@@ -38,6 +45,8 @@ cl_program CreateProgram(cl_context context, cl_device_id device,
 
   program = clCreateProgramWithSource(context, 1, (const char**)&srcStr2, NULL, NULL);
 
+  free(srcStr);
+
   if(program == NULL){
 
     fprintf(stderr, "cachedProgram.c::CreateProgram failed to create program with source\n");